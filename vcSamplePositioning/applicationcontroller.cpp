@@ -20,15 +20,67 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include <ctime>
+#include <algorithm>
+#include <thread>
+#include <sstream>
+#include <visp/vpMeterPixelConversion.h>
 
 /**
  * Constructor
  */
-applicationcontroller::applicationcontroller(bool stereo,QObject *parent) :
-    QObject(parent), tdcDrive(true),bscDrives(false)
+std::atomic<bool> applicationcontroller::latencyReportRequested(false);
+
+applicationcontroller::applicationcontroller(bool stereo, cameraSource source, std::string replayPath,
+                                             bool headless, QObject *parent) :
+    QObject(parent), source(source), replayPath(replayPath), replayGrabber2(replay, 0), replayGrabber3(replay, 1),
+    capture2(frameGrabber2, "camera2"), capture3(frameGrabber3, "camera3"),
+    pairer(capture2, capture3),
+    tdcDrive(true),bscDrives(false),
+    headless(headless),
+    persistQueue("persist", 4, stagequeue<persistjob>::DROP_OLDEST),
+    controlQueue("control", 8, stagequeue<trackresult>::BLOCK),
+    driveQueue("drive", 4, stagequeue<drivecommand>::BLOCK),
+    trackStats("track"), controlStats("control"), driveStats("drive I/O"),
+    pipelineRunning(false), stopRequested(false), moveFinished(false), driveProblem(0),
+    trackWorker("tracker3"), warmingUp(false), statusStreaming(false), tracing(false)
 {
     basePath = "/home/szb/Documents/";
     positionSample = false;
+    savingcount = 0;
+    commandsSent = 0;
+    //one archive per camera rather than a file per frame
+    imageFormat = imagewriter::ARCHIVE;
+    pngLevel = 1;// when png is chosen, the fastest compression
+    persistWriters = 2;
+    nextSaveNumber = 0;
+    savedFrames = 0;
+    persistFailures = 0;
+    savedBytes = 0;
+    acquireLatency = &latency.add("acquire");
+    frameLatency = &latency.add("frame");
+    track2Latency = &latency.add("track camera2");
+    track3Latency = &latency.add("track camera3");
+    stereoTrackLatency = &latency.add("track stereo");
+    writeLatency = &latency.add("image write");
+    logLatency = &latency.add("log write");
+    moveLatency = &latency.add("drive move");
+    tdcStatusLatency = &latency.add("tdc status");
+    bscStatusLatency = &latency.add("bsc status");
+    motionLatency = &latency.add("drive motion");
+    display.setLatency(&latency.add("display render"), &latency.add("display draw"));
+    //the frame argument of a span is the capture number of the camera 2 frame
+    acquireSpan = trace.addSpan("acquire", "tracking");
+    frameSpan = trace.addSpan("frame", "tracking");
+    track2Span = trace.addSpan("track camera2", "tracking");
+    track3Span = trace.addSpan("track camera3", "tracking");
+    stereoTrackSpan = trace.addSpan("track stereo", "tracking");
+    writeSpan = trace.addSpan("image write", "persist", "frame", "saved");
+    logSpan = trace.addSpan("log write", "control");
+    capture2.setTrace(&trace, trace.addSpan("camera2 grab", "camera"));
+    capture3.setTrace(&trace, trace.addSpan("camera3 grab", "camera"));
+    display.setTrace(&trace, trace.addSpan("display render", "display"), trace.addSpan("display draw", "display"));
+    tdcDrive.setTrace(&trace, trace.addSpan("tdc apt", "drive", "message", "destination", true));
+    bscDrives.setTrace(&trace, trace.addSpan("bsc apt", "drive", "message", "destination", true));
     initAllEquipment(stereo);
     // prepare the motor drive position mapping
     fillmapX();
@@ -42,6 +94,9 @@ applicationcontroller::applicationcontroller(bool stereo,QObject *parent) :
  * Destructor
  */
 applicationcontroller::~applicationcontroller(){
+    stopPipeline();
+    capture2.stop();
+    capture3.stop();
     if(frameGrabber2.isConnected){
       frameGrabber2.close();
     }
@@ -49,8 +104,7 @@ applicationcontroller::~applicationcontroller(){
       frameGrabber3.close();
     }
     //close displays
-    d2.close(img2);
-    d3.close(img3);
+    display.stop();
     //disconect from actuators
     tdcDrive.disconnect(0x50);
     bscDrives.disconnect(0x21);
@@ -65,6 +119,17 @@ void applicationcontroller::initAllEquipment(bool stereo){
     //read file data on current ports in use etc. - static for debugging
     portnumC2 = 19; //should be first line of input file
     portnumC3 = 17;
+    //largest capture time difference (ms) accepted between the two frames given to the stereo tracker
+    pairer.setMaxSkew(20);
+    //read only the part of the sensors around the sample holder once it is tracked
+    trackedAOI = false;
+    aoiMargin = 60;
+    aoiChanged2 = 0;
+    aoiChanged3 = 0;
+    //full resolution, binning (rather than subsampling) when reduced
+    binning = 1;
+    trackedBinning = 1;
+    binAverage = true;
     // initialise the run path and output files
     if(stereo){
         experimentPath = "sample_tracking/stereo/";
@@ -97,21 +162,6 @@ void applicationcontroller::initAllEquipment(bool stereo){
     makeFolder(nfp2_char);
 
     initCameras();
-    // initialise displays
-    //d2.setDownScalingFactor(vpDisplay::SCALE_5);
-    //d3.setDownScalingFactor(vpDisplay::SCALE_5);
-    d2.init(img2, 0, 0, "Camera2 - sample tracking");
-    d3.init(img3,10, 10, "Camera3 - sample tracking");
-    /**d2.display(img2);
-    d3.display(img3);
-    d2.flush(img2);
-    d3.flush(img3);*/
-
-    //display captured images
-    vpDisplay::display(img2);
-    vpDisplay::display(img3);
-    vpDisplay::flush(img2);
-    vpDisplay::flush(img2);
     if(stereo){
         initStereoTracker();
     }
@@ -119,8 +169,59 @@ void applicationcontroller::initAllEquipment(bool stereo){
         //initialise trackers
         initTrackers();
     }
+    //the display overlays are rendered from the model rather than drawn by the trackers, so that the display
+    //does not have to run on the tracking thread
+    if(!headless){
+        // the display windows open with the first tracked frames
+        display.setModel(modelFile);
+        display.start();
+    }
+    //the camera parameter files are for the full resolution images
+    cam2Full = cam2;
+    cam3Full = cam3;
+    fullWidth2 = img2.getWidth();
+    fullWidth3 = img3.getWidth();
+    trackedWidth2 = fullWidth2;
+    trackedWidth3 = fullWidth3;
+    cam2Calibrated = cam2;
+    cam3Calibrated = cam3;
+    calibratedWidth = img2.getWidth();
+    calibratedHeight = img2.getHeight();
 
-
+}
+void applicationcontroller::setDisplayRate(double hz){
+    display.setRefreshRate(hz);
+}
+void applicationcontroller::setMaxSkew(double ms){
+    pairer.setMaxSkew(ms);
+}
+void applicationcontroller::setImageOutput(imagewriter::format f, int pngLevel, unsigned int writers){
+    imageFormat = f;
+    this->pngLevel = pngLevel;
+    persistWriters = writers < 1 ? 1 : writers;
+}
+void applicationcontroller::setWarmup(double threshold, double timeoutS){
+    warmup.setLimits(threshold, 3, timeoutS * 1000);
+}
+void applicationcontroller::setTracing(bool on){
+    tracing = on;
+}
+void applicationcontroller::setStatusStreaming(bool on){
+    statusStreaming = on;
+}
+void applicationcontroller::requestLatencyReport(){
+    latencyReportRequested = true;
+}
+void applicationcontroller::writeLatencyReport(){
+    if(latencyPath.empty()){
+        return;
+    }
+    if(latency.write(latencyPath)){
+        std::cout<<"latency report written to "<<latencyPath<<std::endl;
+    }
+    else{
+        std::cout<<"cannot write the latency report "<<latencyPath<<std::endl;
+    }
 }
 /**
  * Creates the data folder for all output
@@ -183,35 +284,237 @@ void applicationcontroller::printErrVector(std::ofstream &errwriter, vpColVector
  * Initialises the cameras
  */
 void applicationcontroller::initCameras(){
-  try{
-      frameGrabber2.open(img2);
-      std::cout << "camera 2 is online" << std::endl;
-      frameGrabber3.open(img3);
-      std::cout << "camera 3 is online" << std::endl;
-   }
-   catch(...){
+  if(source == SIMULATED_CAMERAS){
+      initSimulatedCameras();
+      return;
+  }
+  if(source == REPLAY_REALTIME || source == REPLAY_FAST){
+      initReplayCameras();
+      return;
+  }
+  //both cameras are opened and warmed up at the same time. Camera 3 only starts opening once camera 2 is
+  //open so that with automatic camera selection each one gets the same camera as when opened in turn
+  std::promise<void> opened2;
+  std::shared_future<void> cam2Open = opened2.get_future().share();
+  cameraStartup start2, start3;
+  std::thread t2([&](){
+      startCamera(frameGrabber2, 12, img2, start2, &opened2, std::shared_future<void>());
+  });
+  std::thread t3([&](){
+      startCamera(frameGrabber3, 15, img3, start3, NULL, cam2Open);
+  });
+  t2.join();
+  t3.join();
+  if(!start2.opened || !start3.opened){
      perror("Opening vpUeyeFrameGrabber Failed");
      exit(1);
-
-   }
-   if(frameGrabber2.isConnected){
-     //check the ports and based on that initialise the cameras params
-     frameGrabber2.initialiseCamera(12);
-   }
-   if(frameGrabber3.isConnected){
-     frameGrabber3.initialiseCamera(15);
-   }
-   try{
-       //read the images from framegrabbers
-       frameGrabber2.acquire(img2);
-       frameGrabber3.acquire(img3);
-   }
-   catch(...){
+  }
+  if(!start2.read || !start3.read){
        std::cout << "Cannot read one or both images "<< std::endl;
-   }
-   initialisedAndReady = true;
+  }
+  std::cout << "camera 2 startup " << start2.totalMs << " ms (open " << start2.openMs << " ms, "
+            << start2.warmupFrames << " warm up frames)" << std::endl;
+  std::cout << "camera 3 startup " << start3.totalMs << " ms (open " << start3.openMs << " ms, "
+            << start3.warmupFrames << " warm up frames)" << std::endl;
+  initialisedAndReady = true;
 
 }
+/**
+ * Opens one camera, settles its settings and reads a first frame, run on its own thread by initCameras.
+ * @param grabber the camera
+ * @param pixelClock pixel clock to set
+ * @param I the first frame
+ * @param startup result and timings
+ * @param opened set once the camera is open (or failed to), can be NULL
+ * @param waitFor the camera is only opened once this is ready, if valid
+ */
+void applicationcontroller::startCamera(vpUeyeFrameGrabber& grabber, int pixelClock, vpImage<unsigned char>& I,
+                                        cameraStartup& startup, std::promise<void>* opened,
+                                        std::shared_future<void> waitFor){
+    double start = capturethread::now();
+    startup.opened = false;
+    startup.read = false;
+    startup.warmupFrames = 0;
+    if(waitFor.valid()){
+        waitFor.wait();
+    }
+    double openStart = capturethread::now();
+    try{
+        grabber.open(I);
+        startup.opened = true;
+    }
+    catch(...){
+    }
+    startup.openMs = capturethread::now() - openStart;
+    if(opened != NULL){
+        opened->set_value();
+    }
+    if(startup.opened && grabber.isConnected){
+        startup.warmupFrames = grabber.initialiseCamera(pixelClock);
+    }
+    if(startup.opened){
+        try{
+            grabber.acquire(I);
+            startup.read = true;
+        }
+        catch(...){
+        }
+    }
+    startup.totalMs = capturethread::now() - start;
+}
+/**
+ * Initialises the simulated cameras, they render the sample holder model from the initial poses and
+ * camera parameters used by the stereo tracker
+ */
+void applicationcontroller::initSimulatedCameras(){
+    std::string CONFIG_PATH = basePath + "sample_tracking/config/";
+    std::string modelFileCao = CONFIG_PATH + "sampleholder-march17.cao";
+    if(!simGrabber2.setScene(modelFileCao, CONFIG_PATH + "cam_settings/2016-03/camera2160.xml",
+                             CONFIG_PATH + "cam2_i7HM.txt")
+            || !simGrabber3.setScene(modelFileCao, CONFIG_PATH + "cam_settings/2016-03/camera3160.xml",
+                                     CONFIG_PATH + "cam3-i12HM.txt")){
+        std::cout << "Cannot set up the simulated cameras" << std::endl;
+        exit(1);
+    }
+    //an optional scripted stage trajectory replaces the default swing of the holder
+    std::string trajectoryFile = CONFIG_PATH + "simtrajectory.txt";
+    if(fs::exists(trajectoryFile)){
+        simGrabber2.loadTrajectory(trajectoryFile);
+        simGrabber3.loadTrajectory(trajectoryFile);
+    }
+    //no frame rate limit, frames are produced as fast as they can be rendered
+    simGrabber2.open(img2);
+    std::cout << "simulated camera 2 is online" << std::endl;
+    simGrabber3.open(img3);
+    std::cout << "simulated camera 3 is online" << std::endl;
+    simGrabber2.acquire(img2);
+    simGrabber3.acquire(img3);
+    capture2.setGrabber(simGrabber2);
+    capture3.setGrabber(simGrabber3);
+    initialisedAndReady = true;
+}
+/**
+ * Initialises playback of a recorded run, both cameras are replayed in lockstep from the
+ * image_out/camN/data frames of the run directory
+ */
+void applicationcontroller::initReplayCameras(){
+    std::vector<std::string> frameDirs;
+    frameDirs.push_back(replayPath + "/image_out/cam2/data/");
+    frameDirs.push_back(replayPath + "/image_out/cam3/data/");
+    if(!replay.open(frameDirs, source == REPLAY_REALTIME)){
+        std::cout << "Cannot replay " << replayPath << std::endl;
+        exit(1);
+    }
+    replayGrabber2.open(img2);
+    replayGrabber3.open(img3);
+    //the first frames are the ones the trackers are initialised on
+    replayGrabber2.acquire(img2);
+    replayGrabber3.acquire(img3);
+    capture2.setGrabber(replayGrabber2);
+    capture3.setGrabber(replayGrabber3);
+    initialisedAndReady = true;
+}
+/**
+ * Requests reduced images from the cameras, only the uEye grabbers support it
+ */
+void applicationcontroller::setBinning(int factor){
+    if(source != UEYE_CAMERAS){
+        std::cout << "binning is only available with the cameras" << std::endl;
+        return;
+    }
+    if(factor != 1 && factor != 2 && factor != 4){
+        std::cout << "binning factor " << factor << " not supported, use 1, 2 or 4" << std::endl;
+        return;
+    }
+    binning = factor;
+    frameGrabber2.setBinning(binning, binAverage);
+    frameGrabber3.setBinning(binning, binAverage);
+}
+/**
+ * For cameras whose sensors are not the size the camera parameter files were calibrated at, only the uEye
+ * grabbers support it
+ */
+void applicationcontroller::setSensorSize(int w, int h){
+    if(source != UEYE_CAMERAS){
+        std::cout << "sensor size is only available with the cameras" << std::endl;
+        return;
+    }
+    if(w < 128 || h < 96 || w > 0xffff || h > 0xffff){
+        std::cout << "sensor size " << w << "x" << h << " not supported" << std::endl;
+        return;
+    }
+    frameGrabber2.setSensorSize(w, h);
+    frameGrabber3.setSensorSize(w, h);
+    vpUeyeFrameGrabber::resizeCameraParameters(cam2Calibrated, calibratedWidth, calibratedHeight, w, h, cam2Full);
+    vpUeyeFrameGrabber::resizeCameraParameters(cam3Calibrated, calibratedWidth, calibratedHeight, w, h, cam3Full);
+    fullWidth2 = w;
+    fullWidth3 = w;
+}
+/**
+ * Reads only the area of the sensors around the tracked model, only the uEye grabbers support it
+ */
+void applicationcontroller::setTrackedAOI(bool on, int margin){
+    if(on && source != UEYE_CAMERAS){
+        std::cout << "area of interest is only available with the cameras" << std::endl;
+        return;
+    }
+    if(margin > 0){
+        aoiMargin = margin;
+    }
+    if(trackedAOI && !on){
+        frameGrabber2.clearAOI();
+        frameGrabber3.clearAOI();
+    }
+    trackedAOI = on;
+}
+/**
+ * Called after each new pair of frames. Once both cameras deliver frames at the requested sensor size and binning
+ * the camera parameters are scaled from the full resolution ones and the trackers restarted from their last pose, which does not depend on the resolution.
+ * @param stereo the stereo tracker is in use
+ * @return false while the frames are not at the size the trackers are set for, they must not be tracked
+ */
+bool applicationcontroller::followImageSize(bool stereo){
+    if(img2.getWidth() * binning != fullWidth2 || img3.getWidth() * binning != fullWidth3){
+        //still frames from before the change, or the other camera has not changed yet
+        return img2.getWidth() * trackedBinning == trackedWidth2 && img3.getWidth() * trackedBinning == trackedWidth3;
+    }
+    if(binning == trackedBinning && fullWidth2 == trackedWidth2 && fullWidth3 == trackedWidth3){
+        return true;
+    }
+    vpUeyeFrameGrabber::scaleCameraParameters(cam2Full, binning, binAverage, cam2);
+    vpUeyeFrameGrabber::scaleCameraParameters(cam3Full, binning, binAverage, cam3);
+    if(stereo){
+        tracker->setCameraParameters(cam2, cam3);
+        tracker->initFromPose(img2, img3, cMo2, cMo3, true);
+    }
+    else{
+        tracker2.setCameraParameters(cam2);
+        tracker3.setCameraParameters(cam3);
+        tracker2.initFromPose(img2, cMo2);
+        tracker3.initFromPose(img3, cMo3);
+    }
+    trackedBinning = binning;
+    trackedWidth2 = fullWidth2;
+    trackedWidth3 = fullWidth3;
+    std::cout << "tracking at " << img2.getWidth() << "x" << img2.getHeight() << std::endl;
+    return true;
+}
+/**
+ * Prints the settings and acquisition statistics of the cameras in use
+ */
+void applicationcontroller::printCameraStats(){
+    if(source == SIMULATED_CAMERAS){
+        simGrabber2.printCameraParameters();
+        simGrabber3.printCameraParameters();
+    }
+    else if(source == REPLAY_REALTIME || source == REPLAY_FAST){
+        replay.printStats();
+    }
+    else{
+        frameGrabber2.printCameraParameters();
+        frameGrabber3.printCameraParameters();
+    }
+}
 /**
  * Initialises the model based trackers
  */
@@ -242,8 +545,9 @@ void applicationcontroller::initTrackers(){
         initFile2 = CONFIG_PATH +  "modposSH_02-19.pos";
     }
 
-    tracker2.setDisplayFeatures(true);
-    tracker3.setDisplayFeatures(true);
+    //the trackers never draw, the overlays are rendered from the model
+    tracker2.setDisplayFeatures(false);
+    tracker3.setDisplayFeatures(false);
     tracker2.setGoodMovingEdgesRatioThreshold(0.1);
     //tracker2.setProjectionErrorComputation(true);
     tracker3.setGoodMovingEdgesRatioThreshold(0.1);
@@ -265,14 +569,13 @@ void applicationcontroller::initTrackers(){
     tracker3.getCameraParameters(cam3);
     tracker2.loadModel(modelFileCao);
     tracker3.loadModel(modelFileCao);
+    modelFile = modelFileCao;
 
     //initialise the tracker
     tracker2.initFromPose(img2,initFile2.c_str());
     tracker3.initFromPose(img3,initFile3.c_str());
     tracker2.getPose(c2I_cmo);
     tracker3.getPose(c3I_cmo);
-    vpDisplay::flush(img2);
-    vpDisplay::flush(img3);
 
 }
 /**
@@ -280,6 +583,8 @@ void applicationcontroller::initTrackers(){
  */
 void applicationcontroller::doSamplePositioning(std::map<std::string, double> moveMap){
     std::cout<<"signal received \n";
+    //the control stage may be running the previous moves
+    std::lock_guard<std::mutex> lk(controlMutex);
     desired_pose.push_back(moveMap.find("z")->second);
     desired_pose.push_back(moveMap.find("y")->second);
     desired_pose.push_back(moveMap.find("x")->second);
@@ -293,6 +598,518 @@ void applicationcontroller::doSamplePositioning(std::map<std::string, double> mo
     positionSample = true;
 
 }
+/**
+ * @brief applicationcontroller::startPipeline starts the persist, control and drive stages of the tracking loop.
+ * From here until stopPipeline the drive stage is the only one using the serial ports.
+ * @param stereo - the results come from the stereo tracker
+ * @param imageoutBase - folder holding the cam2 and cam3 image folders
+ */
+void applicationcontroller::startPipeline(bool stereo, const std::string& imageoutBase){
+    try{
+        rawWriter2.open(imageoutBase + "cam2/data/img", imageFormat, pngLevel);
+        rawWriter3.open(imageoutBase + "cam3/data/img", imageFormat, pngLevel);
+    }
+    catch(const std::exception& e){
+        //the frames fail to save and are counted as such, tracking goes on
+        std::cout<<e.what()<<std::endl;
+    }
+    nextSaveNumber = 0;
+    savedFrames = 0;
+    persistFailures = 0;
+    savedBytes = 0;
+    commandsSent = 0;
+    {
+        std::lock_guard<std::mutex> lk(controlMutex);
+        controlcMo2 = cMo2;
+        controlcMo3 = cMo3;
+    }
+    {
+        std::lock_guard<std::mutex> lk(statusMutex);
+        latestStatus.positions.assign(3, 0);
+        latestStatus.positions[0] = tdcDrive.getScaledZ();
+        latestStatus.positions[1] = bscDrives.getScaledY();
+        latestStatus.positions[2] = bscDrives.getscaledX();
+        latestStatus.moving = false;
+        latestStatus.movingRead = false;
+        latestStatus.polls = 0;
+        latestStatus.commandsDone = 0;
+    }
+    persistQueue.setConsumers(persistWriters);
+    persistQueue.reopen();
+    controlQueue.reopen();
+    driveQueue.reopen();
+    trackStats.reset();
+    latency.reset();
+    persistStats.clear();
+    for(unsigned int w = 0; w < persistWriters; w++){
+        std::ostringstream name;
+        name<<"persist "<<w;
+        persistStats.push_back(stagestats(name.str()));
+    }
+    controlStats.reset();
+    driveStats.reset();
+    stopRequested = false;
+    moveFinished = false;
+    driveProblem = 0;
+    //the drive stage reads the drive motion from its first poll
+    warmingUp = true;
+    warmup.reset(capturethread::now());
+    trace.nameThread("tracking");
+    if(tracing && !tracePath.empty() && trace.start(tracePath)){
+        std::cout<<"tracing to "<<tracePath<<std::endl;
+    }
+    if(statusStreaming){
+        tdcDrive.startStatusStream();
+        bscDrives.startStatusStream();
+    }
+    pipelineRunning = true;
+    for(unsigned int w = 0; w < persistWriters; w++){
+        persistThreads.push_back(std::thread(&applicationcontroller::persistLoop, this, w));
+    }
+    controlThread = std::thread(&applicationcontroller::controlLoop, this);
+    driveThread = std::thread(&applicationcontroller::driveLoop, this);
+    std::cout<<(stereo ? "stereo" : "dual camera")<<" tracking pipeline started"<<std::endl;
+}
+
+/**
+ * @brief applicationcontroller::stopPipeline lets the persist and control stages finish their queues, then stops
+ * the drive stage. Moves the control stage issued but the drives have not started are not run.
+ */
+void applicationcontroller::stopPipeline(){
+    if(!pipelineRunning){
+        return;
+    }
+    persistQueue.close();
+    controlQueue.close();
+    for(size_t w = 0; w < persistThreads.size(); w++){
+        persistThreads[w].join();
+    }
+    persistThreads.clear();
+    rawWriter2.close();
+    rawWriter3.close();
+    if(controlThread.joinable()){
+        controlThread.join();
+    }
+    pipelineRunning = false;
+    driveQueue.close();
+    if(driveThread.joinable()){
+        driveThread.join();
+    }
+    tdcDrive.stopStatusStream();
+    bscDrives.stopStatusStream();
+    trace.stop();
+}
+
+/**
+ * @brief applicationcontroller::persistLoop persist stage - one of the threads writing the raw frames queued by the
+ * tracking thread with the poses tracked in them, the overlays are regenerated offline from these by
+ * vcOverlayRender. Frames are numbered as they are taken from the queue
+ * so the saved sequence has no gaps when frames are dropped, only a frame that fails to write leaves one.
+ * @param writer - index of the thread
+ */
+void applicationcontroller::persistLoop(unsigned int writer){
+    stagestats& stats = persistStats[writer];
+    {
+        std::ostringstream name;
+        name<<"persist "<<writer;
+        trace.nameThread(name.str());
+    }
+    //grown to the image size by the first frame, then reused
+    imagewriter::encodebuffer buf;
+    persistjob* job;
+    while(true){
+        unsigned int number;
+        {
+            //the frame order and the numbers stay the same when several threads take frames
+            std::lock_guard<std::mutex> lk(persistTakeMutex);
+            job = persistQueue.beginPop();
+            if(job == NULL){
+                break;
+            }
+            number = nextSaveNumber++;
+        }
+        stats.begin();
+        //what the archives keep with each frame
+        framearchive::frameinfo info2,info3;
+        info2.number = info3.number = number;
+        info2.captureNumber = job->frame2.frameNumber();
+        info2.timestamp = job->frame2.timestamp();
+        info2.cam = job->cam2;
+        info2.cMo = job->cMo2;
+        info3.captureNumber = job->frame3.frameNumber();
+        info3.timestamp = job->frame3.timestamp();
+        info3.cam = job->cam3;
+        info3.cMo = job->cMo3;
+        for(int a = 0; a < 3; a++){
+            info2.positions[a] = info3.positions[a] = job->positions[a];
+        }
+        try{
+            latencyspan span(*writeLatency);
+            tracespan traced(trace, writeSpan, info2.captureNumber, number);
+            unsigned long bytes = rawWriter2.write(job->frame2.image(), info2, buf);
+            bytes += rawWriter3.write(job->frame3.image(), info3, buf);
+            savedBytes += bytes;
+            savedFrames++;
+        }
+        catch(const std::exception& e){
+            if(persistFailures++ == 0){
+                std::cout<<"cannot save frame "<<number<<": "<<e.what()<<std::endl;
+            }
+        }
+        //back to the capture pools
+        job->frame2.release();
+        job->frame3.release();
+        persistQueue.endPop(job);
+        stats.end();
+    }
+}
+
+/**
+ * @brief applicationcontroller::controlLoop control stage - takes every tracked frame in order, runs the motion
+ * state machine and writes the pose, residual and actuator files.
+ */
+void applicationcontroller::controlLoop(){
+    unsigned long lastPoll = 0;
+    trackresult* result;
+    trace.nameThread("control");
+    while((result = controlQueue.beginPop()) != NULL){
+        controlStats.begin();
+        drivestatus status = getDriveStatus();
+        {
+            std::lock_guard<std::mutex> lk(controlMutex);
+            controlcMo2 = result->cMo2;
+            controlcMo3 = result->cMo3;
+            cdp = status.positions;
+            if(positionSample){
+                //one decision per drive status, and only on a status read after the last move was run
+                if(status.movingRead && status.polls != lastPoll && status.commandsDone == commandsSent){
+                    lastPoll = status.polls;
+                    positioningStep(status, result->stereo);
+                }
+                latencyspan span(*logLatency);
+                tracespan traced(trace, logSpan, result->frameNumber);
+                logResult(*result, status);
+            }
+        }
+        controlQueue.endPop();
+        controlStats.end();
+    }
+}
+
+/**
+ * @brief applicationcontroller::driveLoop drive stage - runs the moves issued by the control stage and a requested
+ * stop, then reads the drive positions, and whether they are moving while positioning. The serial reads block so
+ * the stage is paced by the drives, with a short rest when they answer at once.
+ */
+void applicationcontroller::driveLoop(){
+    const double minPollMs = 10;
+    unsigned long commandsDone = 0;
+    unsigned long polls = 0;
+    drivecommand* command;
+    trace.nameThread("drive");
+    while(pipelineRunning){
+        driveStats.begin();
+        try{
+            if(stopRequested.exchange(false)){
+                int problem = stopActiveDrive();
+                if(problem != 0){
+                    driveProblem = problem;
+                }
+                //moves queued before the stop are not run
+                while((command = driveQueue.tryPop()) != NULL){
+                    driveQueue.endPop();
+                    commandsDone++;
+                }
+            }
+            while((command = driveQueue.tryPop()) != NULL){
+                latencyspan span(*moveLatency);
+                command->drive->moveRelative(0x01, command->distance, command->destination);
+                driveQueue.endPop();
+                commandsDone++;
+            }
+            unsigned long done = commandsDone;
+            double start = latencyhistogram::now();
+            if(statusStreaming){
+                //the latest status the controllers pushed, they are only asked when it stops coming
+                bscDrives.updateDrivePositions();
+                bscStatusLatency->record(latencyhistogram::now() - start);
+                tdcDrive.updateDrivePositions();
+                tdcStatusLatency->record(latencyhistogram::now() - start);
+            }
+            else{
+                //the controllers are on their own ports, the stepper bays are read while the tdc answers
+                double tdcAsked = tdcDrive.requestStatusUpdate(0x50, 0x01);
+                bscDrives.updateDrivePositions();
+                bscStatusLatency->record(latencyhistogram::now() - start);
+                if(!tdcDrive.waitStatusUpdate(0x50, tdcAsked, 10000)){
+                    std::cout<<"drive stage - no status from the tdc"<<std::endl;
+                }
+                tdcStatusLatency->record(latencyhistogram::now() - start);
+            }
+            bool movingRead = positionSample || warmingUp;
+            bool moving = false;
+            if(movingRead){
+                latencyspan span(*motionLatency);
+                moving = tdcDrive.isDriveMoving();
+                if(!moving){
+                    //tdc not active - check other drives
+                    moving = bscDrives.isDriveMoving();
+                }
+            }
+            polls++;
+            std::lock_guard<std::mutex> lk(statusMutex);
+            latestStatus.positions[0] = tdcDrive.getScaledZ();
+            latestStatus.positions[1] = bscDrives.getScaledY();
+            latestStatus.positions[2] = bscDrives.getscaledX();
+            latestStatus.moving = moving;
+            latestStatus.movingRead = movingRead;
+            latestStatus.polls = polls;
+            latestStatus.commandsDone = done;
+        }
+        catch(...){
+            std::cout<<"drive stage - error talking to the drives"<<std::endl;
+        }
+        driveStats.end();
+        double elapsedMs = driveStats.getLastMs();
+        if(elapsedMs < minPollMs){
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(minPollMs - elapsedMs));
+        }
+    }
+}
+
+/**
+ * @brief applicationcontroller::positioningStep one step of the motion state machine, issues the next move once the
+ * drives have stopped and evaluates the position once all the moves have been run. Called with controlMutex held.
+ * @param status - drive status read after the last move was run
+ * @param stereo - the stereo tracker does not evaluate the position yet
+ */
+void applicationcontroller::positioningStep(const drivestatus& status, bool stereo){
+    double moveVal;
+    std::cout<<" in motor moves if block\n";
+    isMoving = status.moving;
+    std::cout<<"is moving "<<isMoving<<"\n";
+    if(isMoving){
+        return;
+    }
+    std::cout<<"not moving "<<isMoving<<"\n";
+    //drives not moving
+    if(!moves.empty()){
+        std::cout<<"moves not empty \n";
+        //z+rotation first
+        if(moves.find("z")!= moves.end()){
+            moveVal = moves.find("z")->second;
+            std::cout<<"the z move value is "<<moveVal<<"\n";
+            //moves used to be split in 50 and 10 degree steps, the whole move is now done at once
+            if(!moveVal == 0){
+                std::cout<<"doing whole move\n";
+                issueMove(tdcDrive, moveVal, 0x50);
+            }
+            //empty the moves hash map of this move element
+            moves.erase("z");
+        }
+        else if(moves.find("y")!= moves.end()){
+            std::cout<<"moving y \n";
+            moveVal = moves.find("y")->second;
+            std::cout<<"the y move value is "<<moveVal<<"\n";
+            if(!moveVal == 0){
+                issueMove(bscDrives, moveVal, 0x22);
+            }
+            moves.erase("y");
+        }
+        else if(moves.find("x")!= moves.end()){
+            std::cout<<"moving x\n";
+            moveVal = moves.find("x")->second;
+            std::cout<<"the x move value is "<<moveVal<<"\n";
+            if(!moveVal == 0){
+                issueMove(bscDrives, moveVal, 0x21);
+            }
+            moves.erase("x");
+        }
+        else{
+            // some error has occurred because there are only supposed
+            // to be three keys
+            std::cout<<"****CASE1-ERROR\n";
+            positionSample = false;
+        }
+    }
+    else{
+        //moves have all been issued, motors are not moving - evaluate
+        std::cout<<"moves is empty \n";
+        bool reposition = stereo ? false : evaluateReposition();
+        if(reposition){
+            calculateMovesFromCurrentPose(true);
+        }
+        else{
+            std::cout<<"saving count is:"<<savingcount<<" \n";
+            //positioning cycle can temporarily be halted
+            if(savingcount == 15){
+                //emitted by the tracking thread
+                moveFinished = true;
+                positionSample = false;
+                savingcount = 0;
+                std::cout<<"position sample stopping now \n";
+            }
+            savingcount++;
+        }
+    }
+}
+
+/**
+ * @brief applicationcontroller::issueMove hands a relative move to the drive stage, never dropped
+ */
+void applicationcontroller::issueMove(thordrive& drive, double distance, unsigned char destination){
+    drivecommand* command = driveQueue.beginPush();
+    if(command == NULL){
+        return;
+    }
+    command->drive = &drive;
+    command->distance = distance;
+    command->destination = destination;
+    driveQueue.commitPush();
+    commandsSent++;
+}
+
+/**
+ * @brief applicationcontroller::logResult pose, residual and actuator output for one tracked frame
+ */
+void applicationcontroller::logResult(const trackresult& result, const drivestatus& status){
+    //calculate output data from homogenous pose matrix
+    vpPoseVector pv2(result.cMo2);
+    vpPoseVector pv3(result.cMo3);
+    vpRotationMatrix rm2(pv2[3],pv2[4],pv2[5]);
+    vpRotationMatrix rm3(pv3[3],pv3[4],pv3[5]);
+    vpRzyxVector eulvec2(rm2);
+    vpRzyxVector eulvec3(rm3);
+    // poses
+    outstream2 << vpMath::deg( eulvec2[2])<< "\t"<< vpMath::deg( eulvec2[1]) << "\t"<< vpMath::deg(eulvec2[0])<< "\t"<<pv2[0]<< "\t"<<pv2[1]<< "\t"<<pv2[2]<<std::endl;
+    outstream3 << vpMath::deg( eulvec3[2])<< "\t"<< vpMath::deg( eulvec3[1]) << "\t"<< vpMath::deg(eulvec3[0])<< "\t"<<pv3[0]<< "\t"<<pv3[1]<< "\t"<<pv3[2]<<std::endl;
+    //errors / residuals
+    outstream4<<sqrt(result.error2.sumSquare()) <<","<< sqrt(result.error2.sumSquare())/result.error2.size() <<","<< result.error2.size() << ","<< result.projError2<< std::endl;
+    //motors - actuators
+    outstream6<<status.positions.at(0)<<","<<status.positions.at(1)<<","<<status.positions.at(2)<<std::endl;
+    //whole error vectors
+    printErrVector(outstream1,result.error2);
+    printErrVector(outstream8, result.weights2);
+    if(!result.stereo){
+        outstream5<<sqrt(result.error3.sumSquare()) <<","<< sqrt(result.error3.sumSquare())/result.error3.size() <<","<< result.error3.size() << ","<< result.projError3<< std::endl;
+        printErrVector(outstream7,result.error3);
+        printErrVector(outstream9, result.weights3);
+    }
+}
+
+applicationcontroller::drivestatus applicationcontroller::getDriveStatus(){
+    std::lock_guard<std::mutex> lk(statusMutex);
+    return latestStatus;
+}
+
+/**
+ * @brief applicationcontroller::getDriveMotion drive motion of the last status read by the drive stage
+ * @param motionRead - the motion was read at that poll
+ * @param moving - a drive was moving
+ * @param polls - number of the poll
+ */
+void applicationcontroller::getDriveMotion(bool& motionRead, bool& moving, unsigned long& polls){
+    std::lock_guard<std::mutex> lk(statusMutex);
+    motionRead = latestStatus.movingRead;
+    moving = latestStatus.moving;
+    polls = latestStatus.polls;
+}
+
+/**
+ * @brief applicationcontroller::warmupDone tracking thread, feeds the warm-up gate with the frames in img2 and img3
+ * until it opens. With the cameras the drives have to be read as stationary, the drive stage only starts
+ * polling with the pipeline so any read comes after the start positions were sent.
+ * @param stereo - for the message
+ * @return true once tracking can start
+ */
+bool applicationcontroller::warmupDone(bool stereo){
+    if(!warmingUp){
+        return true;
+    }
+    bool motionRead, moving;
+    unsigned long polls;
+    getDriveMotion(motionRead, moving, polls);
+    if(!warmup.update(img2, img3, motionRead && polls > 0, moving, source == UEYE_CAMERAS, capturethread::now())){
+        return false;
+    }
+    warmingUp = false;
+    std::cout<<(stereo ? "stereo" : "dual camera")<<" tracking started"<<std::endl;
+    warmup.print();
+    return true;
+}
+
+/**
+ * @brief applicationcontroller::getDrivePositions latest drive positions z, y, x read by the drive stage, without
+ * copying the whole status
+ */
+void applicationcontroller::getDrivePositions(double positions[3]){
+    std::lock_guard<std::mutex> lk(statusMutex);
+    for(int a = 0; a < 3; a++){
+        positions[a] = latestStatus.positions[a];
+    }
+}
+
+/**
+ * @brief applicationcontroller::emitPipelineEvents the signals of the other stages are emitted from the tracking
+ * thread, the gui is updated from there. A latency report asked for is written from here too.
+ * @param lastPoll - drive status last sent to the gui
+ */
+void applicationcontroller::emitPipelineEvents(unsigned long& lastPoll){
+    drivestatus status = getDriveStatus();
+    if(status.polls != lastPoll){
+        lastPoll = status.polls;
+        emit driveStatusUpdated(status.positions);
+    }
+    if(moveFinished.exchange(false)){
+        emit moveCompleted();
+    }
+    int problem = driveProblem.exchange(0);
+    if(problem != 0){
+        emit stopProblem(problem);
+    }
+    if(latencyReportRequested.exchange(false)){
+        writeLatencyReport();
+    }
+}
+
+/**
+ * @brief applicationcontroller::printPipelineStats per stage throughput, the stage with the longest mean time
+ * per frame is the one limiting the loop
+ */
+void applicationcontroller::printPipelineStats(){
+    trackStats.print();
+    for(size_t w = 0; w < persistStats.size(); w++){
+        persistStats[w].print();
+    }
+    persistQueue.printStats();
+    std::cout<<"persist - format \t"<<imagewriter::formatName(imageFormat);
+    if(imageFormat == imagewriter::PNG){
+        std::cout<<" level "<<pngLevel;
+    }
+    std::cout<<std::endl;
+    std::cout<<"persist - frames saved \t"<<savedFrames<<std::endl;
+    std::cout<<"persist - frames dropped \t"<<persistQueue.getDropped()<<std::endl;
+    std::cout<<"persist - frames not saved \t"<<persistFailures<<std::endl;
+    std::cout<<"persist - MB written \t"<<savedBytes / 1e6<<std::endl;
+    controlStats.print();
+    controlQueue.printStats();
+    driveStats.print();
+    driveQueue.printStats();
+    tdcDrive.printPortStats();
+    bscDrives.printPortStats();
+    //the persist threads share the frames, their stage takes the mean time of one thread divided among them
+    std::string slowest = trackStats.getName();
+    double slowestMs = trackStats.getMeanMs();
+    if(!persistStats.empty() && persistStats[0].getMeanMs() / persistStats.size() > slowestMs){
+        slowest = "persist";
+        slowestMs = persistStats[0].getMeanMs() / persistStats.size();
+    }
+    if(controlStats.getMeanMs() > slowestMs){
+        slowest = controlStats.getName();
+    }
+    std::cout<<"slowest stage per frame \t"<<slowest<<std::endl;
+}
+
 /**
  * @brief applicationcontroller::doTrackSamplePositioning - copy of sample tracking function except that in this case
  * this method only exits when the application exits - or when stop tracking button pressed.
@@ -302,18 +1119,12 @@ void applicationcontroller::doTrackSamplePositioning(){
     std::cout<<"In doSamplePositioning \n";
     track = true;
     isMoving = false;
-    int savingcount = 0;
+    savingcount = 0;
     //bool printstats = false;
     //output filenames for pose data and names with c for residuals
-    std::string outpath2,outpath3,resoutpathc2,resoutpathc3,actuatorsout,cam2out,cam3out;
+    std::string outpath2,outpath3,resoutpathc2,resoutpathc3,actuatorsout;
     //output file names for stats
     std::string outstats2,outstats3,errstats2,errstats3,ext,errWeights2,errWeights3;
-    //output file names for images
-    std::string pathoutimg2,pathoutimg3,imgExt;
-    //for output filenames
-    std::stringstream ss;
-    bool end = false;
-    imgExt=".png";
     ext = ".csv";
     std::string outputfilepath = basePath + experimentPath + "run_data/" + runName + "/";
     std::cout << "first files" << std::endl;
@@ -324,12 +1135,10 @@ void applicationcontroller::doTrackSamplePositioning(){
     //errstats3 = outputfilepath + "errstats3_";
     errWeights2 = outputfilepath + "errWeights2.csv";
     errWeights3 = outputfilepath + "errWeights3.csv";
-    //output images with tracking results overlay
+    //output raw frames with the poses tracked in them
     std::string imageoutBase = outputfilepath + "image_out/";
-    pathoutimg2 = imageoutBase + "cam2/track_out";
-    pathoutimg3 = imageoutBase + "cam3/track_out";
-    cam2out = imageoutBase + "cam2/data/img";
-    cam3out = imageoutBase + "cam3/data/img";
+    latencyPath = outputfilepath + "latency.csv";
+    tracePath = outputfilepath + "trace.json";
     //pose data output file paths
     outpath2= outputfilepath +"outfile2.dat";
     outpath3= outputfilepath + "outfile3.dat";
@@ -338,8 +1147,6 @@ void applicationcontroller::doTrackSamplePositioning(){
     resoutpathc3= outputfilepath + "residuals3.csv";
     actuatorsout = outputfilepath + "actuatorsout.csv";
 
-    //rgb image for output
-    vpImage<vpRGBa> outimg2,outimg3;
     //open output streams for writing data to
     outstream2.open(outpath2.c_str(),std::ios_base::app);
     outstream3.open(outpath3.c_str(),std::ios_base::app);
@@ -350,266 +1157,174 @@ void applicationcontroller::doTrackSamplePositioning(){
     outstream8.open(errWeights2.c_str(), std::ios_base::app);
     outstream9.open(errWeights3.c_str(), std::ios_base::app);
     outstream1.open(outstats2.c_str(),std::ios_base::app);
-    bool isMoving = false;
-    int frame_num = 0;
+    //frames of the capture pools, held until they have been tracked and handed to the persist stage
+    frameref frame2,frame3;
+    startPipeline(false, imageoutBase);
+    //frames are grabbed in the background from here on, the frames queued for saving or display stay out of the pools
+    unsigned int heldFrames = 2 + (unsigned int)persistQueue.getSlots().size() + display.getHeldFrames();
+    capture2.start(img2.getHeight(), img2.getWidth(), heldFrames);
+    capture3.start(img3.getHeight(), img3.getWidth(), heldFrames);
+    trackWorker.start();
+    trackWorker.submit([this]{trace.nameThread("tracker3");});
+    trackWorker.wait();
+    //tracking times, ms
+    double t3 = 0, sumT2 = 0, sumT3 = 0, sumWall = 0;
+    unsigned long trackedFrames = 0;
     try{
-        int i = 0;
-        double moveVal;
+        unsigned long lastPoll = 0;
         while (track){
             //std::cout<<"track = "<<track<<std::endl;
 
+            double acquired;
             try{
-                //read the images from framegrabbers
-                frameGrabber2.acquire(img2);
-                frameGrabber3.acquire(img3);
+                //take the newest frames from the capture threads
+                double waitStart = latencyhistogram::now();
+                capture2.getLatest(frame2);
+                capture3.getLatest(frame3);
+                acquired = latencyhistogram::now();
+                acquireLatency->record(acquired - waitStart);
+                trace.record(acquireSpan, waitStart, acquired, frame2.frameNumber());
+                trackStats.begin();
+                //the displays are attached to img2 and img3
+                frame2.copyTo(img2);
+                frame3.copyTo(img3);
             }
             catch(...){
                 std::cout << "Cannot read one or both images "<< std::endl;
-                //close all output streams
-                outstream2.close();
-                outstream3.close();
-                outstream4.close();
-                outstream5.close();
-                outstream6.close();
-                outstream7.close();
-                outstream8.close();
-                outstream9.close();
-                outstream1.close();
+                //the output streams are closed once the stages have finished
                 track = false;
-                end=true;
-
+                break;
             }
-            //display images
-            vpDisplay::display(img2);
-            vpDisplay::display(img3);
+            //the binning may have changed, frames of a new size are only tracked once both cameras have it
+            bool sizeSettled = followImageSize(false);
+            //the drives are centring and the first frames are only saved until both drives and images are still
+            bool tracking = warmupDone(false);
             // Track the model
-            if(i > 30){
-                // gives the drives enough time to centre before starting to track
-                tracker2.track(img2);
-                tracker3.track(img3);
+            if(tracking && sizeSettled){
+                // the trackers are independent, camera 3 is tracked on the worker while camera 2 is tracked here
+                double start = capturethread::now();
+                unsigned long frameNumber = frame2.frameNumber();
+                trackWorker.submit([this, &t3, frameNumber]{
+                    double start3 = capturethread::now();
+                    tracker3.track(img3);
+                    t3 = capturethread::now() - start3;
+                    track3Latency->record(t3 * 1000);
+                    trace.record(track3Span, start3 * 1000, (start3 + t3) * 1000, frameNumber);
+                });
+                std::exception_ptr failure;
+                try{
+                    tracker2.track(img2);
+                }
+                catch(...){
+                    failure = std::current_exception();
+                }
+                double t2 = capturethread::now() - start;
+                track2Latency->record(t2 * 1000);
+                trace.record(track2Span, start * 1000, (start + t2) * 1000, frameNumber);
+                //both poses are needed from here on
+                trackWorker.wait();
+                if(failure){
+                    std::rethrow_exception(failure);
+                }
+                sumT2 += t2;
+                sumT3 += t3;
+                sumWall += capturethread::now() - start;
+                trackedFrames++;
                 //std::cout<<"i > 15 tracking now "<<std::endl;
             }
 
-            //display the results of tracking, model and frame
-            tracker2.display(img2,cMo2,cam2,vpColor::yellow,1);
-            vpDisplay::displayFrame(img2,cMo2,cam2,0.05,vpColor::none,2);
-            vpDisplay::flush(img2);
-            tracker3.display(img3,cMo3,cam3,vpColor::yellow,1);
-            vpDisplay::displayFrame(img3,cMo3,cam3,0.05,vpColor::none,2);
-            vpDisplay::flush(img3);
-            //save images - only want to do this while positioning is taking place and initially
-            //(first 10 frames for finding correct sampleholder transformation)
-            if(i < 30 || positionSample){
-                vpDisplay::getImage(img2, outimg2);
-                ss.str( std::string() ); //clear it
-                ss.clear();
-                ss<<pathoutimg2<<frame_num<<imgExt;
-                vpImageIo::write(outimg2,ss.str());
-                ss.str( std::string() ); //clear it
-                ss.clear();
-                ss<<cam2out<<frame_num<<imgExt;
-                vpImageIo::write(img2,ss.str());
-
-                vpDisplay::getImage(img3, outimg3);
-                ss.str( std::string() ); //clear it
-                ss.clear();
-                ss<<cam3out<<frame_num<<imgExt;
-                vpImageIo::write(img3,ss.str());
-
-                ss.str( std::string() ); //clear it
-                ss.clear();
-                ss<<pathoutimg3<<frame_num<<imgExt;
-                vpImageIo::write(outimg3,ss.str());
-                frame_num++;
-                //std::cout<<"saving images and i is:"<<i<<"\n";
-            }
             //get the pose data
             tracker2.getPose(cMo2);
             tracker3.getPose(cMo3);
-            //calculate output data from homogenous pose matrix
-            //thetau?
-            vpPoseVector pv2(cMo2);
-            vpPoseVector pv3(cMo3);
-            vpRotationMatrix rm2(pv2[3],pv2[4],pv2[5]);
-            vpRotationMatrix rm3(pv3[3],pv3[4],pv3[5]);
-            vpRzyxVector eulvec2(rm2);
-            vpRzyxVector eulvec3(rm3);
+            if(trackedAOI && source == UEYE_CAMERAS && tracking){
+                bool moving = isSampleMoving();
+                std::list<vpMbtDistanceLine*> lines;
+                tracker2.getLline(lines);
+                updateCameraAOI(frameGrabber2, lines, cMo2, cam2, moving, aoiChanged2);
+                lines.clear();
+                tracker3.getLline(lines);
+                updateCameraAOI(frameGrabber3, lines, cMo3, cam3, moving, aoiChanged3);
+            }
+            //latest frames and poses to the display thread, taken at its refresh rate
+            display.offer(frame2, frame3, cMo2, cMo3, cam2, cam3, false);
+            //save images - only want to do this while positioning is taking place and initially
+            //(the warm-up frames for finding correct sampleholder transformation)
+            if((!tracking || positionSample) && !frame2.empty() && !frame3.empty()){
+                //the frames and their poses are written by the persist stage
+                persistjob* job = persistQueue.beginPush();
+                if(job != NULL){
+                    job->frame2 = frame2;
+                    job->frame3 = frame3;
+                    job->cMo2 = cMo2;
+                    job->cMo3 = cMo3;
+                    job->cam2 = cam2;
+                    job->cam3 = cam3;
+                    getDrivePositions(job->positions);
+                    persistQueue.commitPush();
+                }
+            }
             //emit the signal for frontend updating of tracking position
             cc2 = getCurrentStagePose(cMo2,c2I_cmo);
             cc3 = getCurrentStagePose(cMo3, c3I_cmo);
             emit posesChanged(cc2,cc3);
-            //get drive positions and emit update signal?
-            //std::cout<<" About to update the drive positions \n";
-            tdcDrive.updateDrivePositions();
-            bscDrives.updateDrivePositions();
-            getCurrentDrivePositions(); // gets updated values and sets them in current drive position (cdp) vector
-            emit driveStatusUpdated(cdp);
-
-            //std::cout<<"poses vals emitted "<<"\n";
-            if(positionSample){
-                std::cout<<" in motor moves if block\n";
-                isMoving = tdcDrive.isDriveMoving();
-                std::cout<<"is moving "<<isMoving<<"\n";
-                if(!isMoving){
-                    //tdc not active - check other drives
-                    isMoving = bscDrives.isDriveMoving();
-                    std::cout<<"checking if dsc drives are moving "<<isMoving<<"\n";
-                    if(!isMoving){
-                        std::cout<<"not moving "<<isMoving<<"\n";
-                        //drives not moving
-                        if(!moves.empty()){
-                            std::cout<<"moves not empty \n";
-                            //z+rotation first
-                            if(moves.find("z")!= moves.end()){
-
-                                moveVal = moves.find("z")->second;
-
-                                std::cout<<"the z move value is "<<moveVal<<"\n";
-                                //need to only move in small increments when rotating, anything above 50 degrees will
-                                //move 50 at a time, anything less than 50 will move at 10 degree increments
-                                /**if(fabs(moveVal) > 50){
-                                    // because the rotations will be using relative moves, negative values are possible
-                                    if(moveVal < 0){
-                                        std::cout<<"move is larger than a - 50 degrees \n";
-                                        //negative direction ensure that the value is reduced correctly
-                                        std::cout<<"new moveval is now "<<moveVal +50<<"\n";
-                                        moves.find("z")->second =  moveVal + 50;
-                                        tdcDrive.moveRelative(0x01,-50.00,0x50);
-                                    }
-                                    else{
-                                        std::cout<<"move is greater than 50 degrees\n";
-                                        //positive direction ensure val is reduced correctly
-                                        std::cout<<"MAGEnTA new moveval is now "<<moveVal -50<<"\n";
-                                        moves.find("z")->second = moveVal - 50;
-                                        tdcDrive.moveRelative(0x01,50.00,0x50);
-                                    }
-                                }
-                                else if(50.00 >fabs(moveVal) && fabs(moveVal) > 10.00){
-                                    std::cout<<"move is between 50 and 10 \n";
-                                    if(moveVal < 0){
-                                        std::cout<<"negative direction\n";
-                                        //negative direction ensure that the value is reduced correctly
-                                        std::cout<<"White new moveval is now "<<moveVal +10<<"\n";
-                                        moves.find("z")->second = moveVal + 10;
-                                        tdcDrive.moveRelative(0x01,-10.00,0x50);
-                                    }
-                                    else{
-                                        std::cout<<"positive direction \n";
-                                        //positive direction ensure val is reduced correctly
-                                        std::cout<<"PEARL new moveval is now "<<moveVal-10<<"\n";
-                                        moves.find("z")->second = moveVal - 10;
-                                        tdcDrive.moveRelative(0x01,10.00,0x50);
-                                    }
-                                }
-                                else{*/
-                                    // only have less than 10 degrees left to move, do whole move
-                                    if(!moveVal == 0){
-                                        std::cout<<"doing whole move\n";
-                                        tdcDrive.moveRelative(0x01,moveVal,0x50);
-                                        //tdcDrive.moveAbsolute(0x01,moveVal,0x50);
-                                    }
-                                    //empty the moves hash map of this move element
-                                    moves.erase("z");
-                                //}
-                            }
-                            else if(moves.find("y")!= moves.end()){
-                                std::cout<<"moving y \n";
-                                moveVal = moves.find("y")->second;
-                                std::cout<<"the y move value is "<<moveVal<<"\n";
-                                if(!moveVal == 0){
-                                    //bscDrives.moveAbsolute(0x01,moveVal,0x22);
-                                    bscDrives.moveRelative(0x01,moveVal,0x22);
-                                }
-                                moves.erase("y");
-                            }
-                            else if(moves.find("x")!= moves.end()){
-                                std::cout<<"moving x\n";
-                                moveVal = moves.find("x")->second;
-                                std::cout<<"the x move value is "<<moveVal<<"\n";
-                                if(!moveVal == 0){
-                                    //bscDrives.moveAbsolute(0x01,moveVal,0x21);
-                                    bscDrives.moveRelative(0x01,moveVal,0x21);
-                                }
-                                moves.erase("x");
-                            }
-                            else{
-                                // some error has occurred because there are only supposed
-                                // to be three keys
-                                std::cout<<"****CASE1-ERROR\n";
-                                positionSample = false;
-                            }
-
-                        }
-                        else{
-                            //moves have all been issued, motors are not moving - evaluate
-                            std::cout<<"moves is empty \n";
-                            bool reposition = evaluateReposition();
-                            if(reposition){
-                                calculateMovesFromCurrentPose(true);
-                                std::cout<<"$%%&*£***!! \n";
-                            }
-                            else{
-
-                                std::cout<<"saving count is:"<<savingcount<<" \n";
-                                //positioning cycle can temporarily be halted
-                                if(savingcount ==15){
-                                    emit moveCompleted();
-                                    positionSample = false;
-                                    savingcount = 0;
-                                    std::cout<<"position sample stopping now \n";
-                                }
-                                savingcount++;
-                            }
-                        }
-                    }
-                }
-
-                //step 2 - start motor drives if not already moving
-
-
-                /** File output**/
-                // poses
-                outstream2 << vpMath::deg( eulvec2[2])<< "\t"<< vpMath::deg( eulvec2[1]) << "\t"<< vpMath::deg(eulvec2[0])<< "\t"<<pv2[0]<< "\t"<<pv2[1]<< "\t"<<pv2[2]<<std::endl;
-                outstream3 << vpMath::deg( eulvec3[2])<< "\t"<< vpMath::deg( eulvec3[1]) << "\t"<< vpMath::deg(eulvec3[0])<< "\t"<<pv3[0]<< "\t"<<pv3[1]<< "\t"<<pv3[2]<<std::endl;
-                //errors / residuals
-                outstream4<<sqrt( (tracker2.getError()).sumSquare()) <<","<< sqrt( (tracker2.getError()).sumSquare())/tracker2.getError().size() <<","<< tracker2.getError().size() << ","<< tracker2.getProjectionError()<< std::endl;
-                outstream5<<sqrt( (tracker3.getError()).sumSquare()) <<","<< sqrt( (tracker3.getError()).sumSquare())/tracker3.getError().size() <<","<< tracker3.getError().size() << ","<< tracker3.getProjectionError()<< std::endl;
-                //motors - actuators
-                outstream6<<cdp.at(0)<<","<<cdp.at(1)<<","<<cdp.at(2)<<std::endl;
-                //whole error vectors
-                printErrVector(outstream1,tracker2.getError());
-                printErrVector(outstream7,tracker3.getError());
-                printErrVector(outstream8, tracker2.getRobustWeights());
-                printErrVector(outstream9, tracker3.getRobustWeights());
-
-
+            //the motion state machine and the file output run on the control stage
+            trackresult* result = controlQueue.beginPush();
+            if(result != NULL){
+                result->cMo2 = cMo2;
+                result->cMo3 = cMo3;
+                result->error2 = tracker2.getError();
+                result->error3 = tracker3.getError();
+                result->weights2 = tracker2.getRobustWeights();
+                result->weights3 = tracker3.getRobustWeights();
+                result->projError2 = tracker2.getProjectionError();
+                result->projError3 = tracker3.getProjectionError();
+                result->stereo = false;
+                result->frameNumber = frame2.frameNumber();
+                controlQueue.commitPush();
             }
-            i++;
+            //drive positions and what the other stages have to report to the gui
+            emitPipelineEvents(lastPoll);
+            trackStats.end();
+            frameLatency->record(trackStats.getLastMs() * 1000);
+            trace.record(frameSpan, acquired, latencyhistogram::now(), frame2.frameNumber());
       }
     }
     catch(...){
-      outstream2.close();
-      outstream3.close();
-      outstream4.close();
-      outstream5.close();
-      outstream6.close();
-      outstream7.close();
-      outstream8.close();
-      outstream9.close();
-      outstream1.close();
-      end=true;
-    }
-    if(!end){
-       outstream2.close();
-       outstream3.close();
-       outstream4.close();
-       outstream5.close();
-       outstream6.close();
-       outstream7.close();
-       outstream8.close();
-       outstream9.close();
-       outstream1.close();
-     }
+    }
+    //the stages finish what is queued before the output streams are closed
+    stopPipeline();
+    outstream2.close();
+    outstream3.close();
+    outstream4.close();
+    outstream5.close();
+    outstream6.close();
+    outstream7.close();
+    outstream8.close();
+    outstream9.close();
+    outstream1.close();
+    frame2.release();
+    frame3.release();
+    capture2.stop();
+    capture3.stop();
+    //acquisition rate achieved during the run and whether tracking kept up with it
+    printCameraStats();
+    capture2.printStats();
+    capture3.printStats();
+    printPipelineStats();
+    if(display.isRunning()){
+        display.printStats();
+    }
+    latency.print();
+    writeLatencyReport();
+    trackWorker.stop();
+    if(trackedFrames > 0){
+        std::cout<<"frames tracked concurrently \t"<<trackedFrames<<std::endl;
+        std::cout<<"mean camera 2 / camera 3 tracking time (ms) \t"<<sumT2 / trackedFrames<<" / "<<sumT3 / trackedFrames<<std::endl;
+        std::cout<<"mean concurrent tracking time (ms) \t"<<sumWall / trackedFrames<<std::endl;
+        if(sumWall > 0){
+            std::cout<<"speedup over tracking in sequence \t"<<(sumT2 + sumT3) / sumWall<<std::endl;
+        }
+    }
 
 }
 
@@ -637,7 +1352,33 @@ std::vector<double> applicationcontroller::getPosesAsStdVector(vpPoseVector pv,
  */
 
 void applicationcontroller::stopMotors(){
-    //only one motor is active at a time find out which and stop it
+    {
+        std::lock_guard<std::mutex> lk(controlMutex);
+        //exit motor drive loop
+        isMoving = false;
+        positionSample = false;
+        moves.clear();
+    }
+    if(pipelineRunning){
+        //the drive stage owns the serial ports while tracking, it stops the drive before its next read
+        stopRequested = true;
+        std::cout<<"Stop requested \n";
+    }
+    else{
+        int problem = stopActiveDrive();
+        if(problem != 0){
+            emit stopProblem(problem);
+        }
+    }
+    std::cout<<"Stopped moves is now "<< moves.size()<<" in size";
+}
+
+/**
+ * @brief applicationcontroller::stopActiveDrive
+ * only one motor is active at a time find out which and stop it
+ * @return 0 or the problem to report, 1 or 2 if no motor was active
+ */
+int applicationcontroller::stopActiveDrive(){
     if(tdcDrive.getIsActive()){
         tdcDrive.stopMotor(0x01, 0x50); //channel and destimation
         std::cout<<"Stopped tdc drive \n";
@@ -653,18 +1394,14 @@ void applicationcontroller::stopMotors(){
         }
         else{
             //if here then an error has occurred where none of the motors is supposedly active
-            emit stopProblem(1);
+            return 1;
         }
     }
     else{
         //if here then an error has occurred where none of the motors is supposedly active
-        emit stopProblem(2);
+        return 2;
     }
-    //exit motor drive loop
-    isMoving = false;
-    positionSample = false;
-    moves.clear();
-    std::cout<<"Stopped moves is now "<< moves.size()<<" in size";
+    return 0;
 }
 
 /**
@@ -928,8 +1665,7 @@ void applicationcontroller::samplePositioningComplete(){
 void applicationcontroller::shutdown(){
     //here every object is closed.
     //close displays
-    vpDisplay::close(img2);
-    vpDisplay::close(img3);
+    display.stop();
     //or alternatively
     //d2.close(img2);
     //d3.close(img3);
@@ -963,7 +1699,8 @@ void applicationcontroller::startTracking(){
  * @brief applicationcontroller::calculateMovesFromCurrentPose
  * @brief given a desired position for the sample holder, the drive moves are
  * calculated based on the current position extrapolated from the two camera poses.
- * Will calculate all three move parameters at once
+ * Will calculate all three move parameters at once. Called with controlMutex held, from the pose the control
+ * stage last received
  */
 
 
@@ -982,8 +1719,8 @@ void applicationcontroller::calculateMovesFromCurrentPose(bool relative){
     // the motor could therefore constantly be moving too even though user has not requested a change - this will have to
     // be addressed
     // get the current position of stage as viewed from a camera.
-    std::vector<double> cstage_pos2 = getCurrentStagePose(cMo2, c2I_cmo);
-    std::vector<double> cstage_pos3 = getCurrentStagePose(cMo3, c3I_cmo);
+    std::vector<double> cstage_pos2 = getCurrentStagePose(controlcMo2, c2I_cmo);
+    std::vector<double> cstage_pos3 = getCurrentStagePose(controlcMo3, c3I_cmo);
     //std::cout<<"current desired pos is this size:"<<cdp.size()<<"\n";
     std::cout<<"BLACK current stage y/ zrotation is:"<<cstage_pos2.at(4)<<"\n";
     double diff = cstage_pos3.at(4) - cdp.at(0);
@@ -1275,8 +2012,8 @@ bool applicationcontroller::evaluateReposition(){
     double translation_padding = 0.00005;
     //get current position of sample holder relative to current camera position in euler because
     //rememeber - rotations still in rads
-    std::vector<double> co_vfc2_pose = getCurrentStagePose(cMo2,c2I_cmo);
-    std::vector<double> co_vfc3_pose = getCurrentStagePose(cMo3,c3I_cmo);
+    std::vector<double> co_vfc2_pose = getCurrentStagePose(controlcMo2,c2I_cmo);
+    std::vector<double> co_vfc3_pose = getCurrentStagePose(controlcMo3,c3I_cmo);
     //check whether positioning is within an acceptable range - current object's position should be near the desired pose
     double cc2_resx,cc2_resy, cc2_resz,cc3_resx,cc3_resy,cc3_resz;
     cc2_resx = fabs(co_vfc2_pose[0] - desired_pose[2]);
@@ -1362,6 +2099,11 @@ void applicationcontroller::testVector(std::vector<double> v){
 }
 
 void applicationcontroller::getCurrentDrivePositions(){
+    if(pipelineRunning){
+        //the drives are only read by the drive stage while tracking
+        cdp = getDriveStatus().positions;
+        return;
+    }
     std::vector<double> current_drive_positions;
     current_drive_positions.push_back(tdcDrive.getScaledZ());
     current_drive_positions.push_back(bscDrives.getScaledY());
@@ -1373,25 +2115,18 @@ void applicationcontroller::getCurrentDrivePositions(){
 void applicationcontroller::doStereoTracking(){
     track = true;
     isMoving = false;
+    savingcount = 0;
     //bool printstats = false;
     //output filenames for pose data and names with c for residuals
-    //camera poses,residuals, actuators, images without overlay
-    std::string outpath2,outpath3,resoutpathc2,resoutpathc3,actuatorsout,cam2out,cam3out;
-
-    //output file names for images
-    std::string pathoutimg2,pathoutimg3,imgExt;
-    //for output filenames
-    std::stringstream ss;
-    bool end = false;
-    imgExt=".png";
+    //camera poses,residuals, actuators
+    std::string outpath2,outpath3,resoutpathc2,resoutpathc3,actuatorsout;
+
     std::string outputfilepath = basePath + experimentPath + "run_data/" + runName + "/";
 
-    //output images with tracking results overlay
+    //output raw frames with the poses tracked in them
     std::string imageoutBase = outputfilepath + "image_out/";
-    pathoutimg2 = imageoutBase + "cam2/track_out";
-    pathoutimg3 = imageoutBase + "cam3/track_out";
-    cam2out = imageoutBase + "cam2/data/img";
-    cam3out = imageoutBase + "cam3/data/img";
+    latencyPath = outputfilepath + "latency.csv";
+    tracePath = outputfilepath + "trace.json";
     //pose data output file paths
     outpath2= outputfilepath +"outfile2.dat";
     outpath3= outputfilepath + "outfile3.dat";
@@ -1403,8 +2138,6 @@ void applicationcontroller::doStereoTracking(){
     std::string outstats2,outstats3,ext,errWeights2,errWeights3;
     ext =".csv";
 
-    //rgb image for output
-    vpImage<vpRGBa> outimg2,outimg3;
     //open output streams for writing data to
     outstream2.open(outpath2.c_str(),std::ios_base::app);
     outstream3.open(outpath3.c_str(),std::ios_base::app);
@@ -1414,252 +2147,128 @@ void applicationcontroller::doStereoTracking(){
     outstream8.open(errWeights2.c_str(), std::ios_base::app);
     outstream1.open(outstats2.c_str(),std::ios_base::app);
 
-    //bool isMoving = false;
-    int frame_num = 0;
-    int savingcount = 0;
+    //frames of the capture pools, held until they have been tracked and handed to the persist stage
+    frameref frame2,frame3;
+    pairer.openSkewLog(outputfilepath + "pairskew.csv");
+    startPipeline(true, imageoutBase);
+    //frames are grabbed in the background from here on, the frames queued for saving or display stay out of the pools
+    unsigned int heldFrames = 2 + (unsigned int)persistQueue.getSlots().size() + display.getHeldFrames();
+    capture2.start(img2.getHeight(), img2.getWidth(), heldFrames);
+    capture3.start(img3.getHeight(), img3.getWidth(), heldFrames);
     try{
-        int i = 0;
-        double moveVal;
+        unsigned long lastPoll = 0;
         while (track){
             //std::cout<<"track = "<<track<<std::endl;
 
+            double acquired;
             try{
-                //read the images from framegrabbers
-                frameGrabber2.acquire(img2);
-                frameGrabber3.acquire(img3);
-                //std::cout<<"got images"<<std::endl;
+                //closest pair of frames in capture time from the two capture threads
+                double waitStart = latencyhistogram::now();
+                pairer.getPair(frame2, frame3);
+                acquired = latencyhistogram::now();
+                acquireLatency->record(acquired - waitStart);
+                trace.record(acquireSpan, waitStart, acquired, frame2.frameNumber());
+                trackStats.begin();
+                //the displays are attached to img2 and img3
+                frame2.copyTo(img2);
+                frame3.copyTo(img3);
             }
             catch(...){
                 std::cout << "Cannot read one or both images "<< std::endl;
-                //close all output streams
-                outstream2.close();
-                outstream3.close();
-                outstream4.close();
-                outstream5.close();
-                outstream6.close();
-                outstream1.close();
-                outstream8.close();
+                //the output streams are closed once the stages have finished
                 track = false;
-                end=true;
-
+                break;
             }
-            //display images
-            vpDisplay::display(img2);
-            vpDisplay::display(img3);
+            //the binning may have changed, frames of a new size are only tracked once both cameras have it
+            bool sizeSettled = followImageSize(true);
+            //the drives are centring and the first frames are only saved until both drives and images are still
+            bool tracking = warmupDone(true);
             // Track the model
-            if(i > 30){
-                // gives the drives enough time to centre before starting to track
+            if(tracking && sizeSettled){
+                latencyspan span(*stereoTrackLatency);
+                tracespan traced(trace, stereoTrackSpan, frame2.frameNumber());
                 tracker->track(img2,img3);
                 //std::cout<<"i > 15 tracking now "<<std::endl;
             }
-            //std::cout<<"displaying"<<std::endl;
-            //display the results of tracking, model and frame
-            tracker->display(img2, img3, cMo2, cMo3, cam2, cam3, vpColor::orange, 2);
-            vpDisplay::displayFrame(img2,cMo2,cam2,0.05,vpColor::none,2);
-            vpDisplay::displayFrame(img3,cMo3,cam3,0.05,vpColor::none,2);
-            vpDisplay::flush(img2);
-            vpDisplay::flush(img3);
-            //save images - only want to do this while positioning is taking place and initially
-            //(first 10 frames for finding correct sampleholder transformation)
-            if(i < 30 || positionSample){
-                //std::cout<<"about to save"<<std::endl;
-                vpDisplay::getImage(img2, outimg2);
-                ss.str( std::string() ); //clear it
-                ss.clear();
-                ss<<pathoutimg2<<frame_num<<imgExt;
-                vpImageIo::write(outimg2,ss.str());
-                ss.str( std::string() ); //clear it
-                ss.clear();
-                ss<<cam2out<<frame_num<<imgExt;
-                vpImageIo::write(img2,ss.str());
-                //std::cout<<"now cam 3"<<std::endl;
-                vpDisplay::getImage(img3, outimg3);
-                ss.str( std::string() ); //clear it
-                ss.clear();
-                ss<<cam3out<<frame_num<<imgExt;
-                vpImageIo::write(img3,ss.str());
-
-                ss.str( std::string() ); //clear it
-                ss.clear();
-                ss<<pathoutimg3<<frame_num<<imgExt;
-                vpImageIo::write(outimg3,ss.str());
-                frame_num++;
-                //std::cout<<"saving images and i is:"<<i<<"\n";
-            }
 
             //get the pose data
             tracker->getPose(cMo2,cMo3);
-            //calculate output data from homogenous pose matrix
-            //thetau?
-            vpPoseVector pv2(cMo2);
-            vpPoseVector pv3(cMo3);
-            vpRotationMatrix rm2(pv2[3],pv2[4],pv2[5]);
-            vpRotationMatrix rm3(pv3[3],pv3[4],pv3[5]);
-            vpRzyxVector eulvec2(rm2);
-            vpRzyxVector eulvec3(rm3);
+            if(trackedAOI && source == UEYE_CAMERAS && tracking){
+                bool moving = isSampleMoving();
+                std::list<vpMbtDistanceLine*> lines;
+                tracker->getLline("Camera1", lines);
+                updateCameraAOI(frameGrabber2, lines, cMo2, cam2, moving, aoiChanged2);
+                lines.clear();
+                tracker->getLline("Camera2", lines);
+                updateCameraAOI(frameGrabber3, lines, cMo3, cam3, moving, aoiChanged3);
+            }
+            //latest frames and poses to the display thread, taken at its refresh rate
+            display.offer(frame2, frame3, cMo2, cMo3, cam2, cam3, true);
+            //save images - only want to do this while positioning is taking place and initially
+            //(the warm-up frames for finding correct sampleholder transformation)
+            if((!tracking || positionSample) && !frame2.empty() && !frame3.empty()){
+                //the frames and their poses are written by the persist stage
+                persistjob* job = persistQueue.beginPush();
+                if(job != NULL){
+                    job->frame2 = frame2;
+                    job->frame3 = frame3;
+                    job->cMo2 = cMo2;
+                    job->cMo3 = cMo3;
+                    job->cam2 = cam2;
+                    job->cam3 = cam3;
+                    getDrivePositions(job->positions);
+                    persistQueue.commitPush();
+                }
+            }
             //emit the signal for frontend updating of tracking position
             cc2 = getCurrentStagePose(cMo2,c2I_cmo);
             cc3 = getCurrentStagePose(cMo3, c3I_cmo);
             emit posesChanged(cc2,cc3);
-            //std::cout<<"poses vals emitted "<<"\n";
-            //step 2 - start motor drives if not already moving
-
-            //get drive positions and emit update signal?
-            //std::cout<<" About to update the drive positions \n";
-            tdcDrive.updateDrivePositions();
-            bscDrives.updateDrivePositions();
-            getCurrentDrivePositions(); // gets updated values and sets them in current drive position (cdp) vector
-            emit driveStatusUpdated(cdp);
-
-            if(positionSample){
-                std::cout<<" in motor moves if block\n";
-                isMoving = tdcDrive.isDriveMoving();
-                std::cout<<"is moving "<<isMoving<<"\n";
-                if(!isMoving){
-                    //tdc not active - check other drives
-                    isMoving = bscDrives.isDriveMoving();
-                    std::cout<<"checking if dsc drives are moving "<<isMoving<<"\n";
-                    if(!isMoving){
-                        std::cout<<"not moving "<<isMoving<<"\n";
-                        //drives not moving
-                        if(!moves.empty()){
-                            std::cout<<"moves not empty \n";
-                            //z+rotation first
-                            if(moves.find("z")!= moves.end()){
-                                std::cout<<"doing z move "<<isMoving<<"\n";
-                                moveVal = moves.find("z")->second;
-                                std::cout<<"the z move value is "<<moveVal<<"\n";
-                                //need to only move in small increments when rotating, anything above 50 degrees will
-                                //move 50 at a time, anything less than 50 will move at 10 degree increments
-                                /**if(fabs(moveVal) > 50){
-                                    // because the rotations will be using relative moves, negative values are possible
-                                    if(moveVal < 0){
-                                        std::cout<<"move is more than - 50 degrees \n";
-                                        //negative direction ensure that the value is reduced correctly
-                                        moves.find("z")->second =  moveVal + 50;
-                                        tdcDrive.moveRelative(0x01,-50.00,0x50);
-                                    }
-                                    else{
-                                        std::cout<<"move is greater than 50 degrees\n";
-                                        //positive direction ensure val is reduced correctly
-                                        moves.find("z")->second = moveVal - 50;
-                                        tdcDrive.moveRelative(0x01,50.00,0x50);
-                                    }
-                                }
-                                else if(50.00 >fabs(moveVal) && fabs(moveVal) > 10.00){
-                                    std::cout<<"move is between 50 and 10 \n";
-                                    if(moveVal < 0){
-                                        std::cout<<"negative direction\n";
-                                        //negative direction ensure that the value is reduced correctly
-                                        moves.find("z")->second = moveVal + 10;
-                                        tdcDrive.moveRelative(0x01,-10.00,0x50);
-                                    }
-                                    else{
-                                        std::cout<<"positive direction \n";
-                                        //positive direction ensure val is reduced correctly
-                                        moves.find("z")->second = moveVal - 10;
-                                        tdcDrive.moveRelative(0x01,10.00,0x50);
-                                    }
-                                }
-                                else{*/
-                                    // only have less than 10 degrees left to move, do whole move
-                                    std::cout<<"doing whole move\n";
-                                    if(!moveVal == 0){
-                                        tdcDrive.moveRelative(0x01,moveVal,0x50);
-                                    }
-                                    //empty the moves hash map of this move element
-                                    moves.erase("z");
-                                //}
-                            }
-                            else if(moves.find("y")!= moves.end()){
-                                std::cout<<"moving y \n";
-                                moveVal = moves.find("y")->second;
-                                std::cout<<"the y move value is "<<moveVal<<"\n";
-                                if(!moveVal == 0){
-                                    //bscDrives.moveAbsolute(0x01,moveVal,0x22);
-                                    bscDrives.moveRelative(0x01,moveVal,0x22);
-                                }
-                                moves.erase("y");
-                            }
-                            else if(moves.find("x")!= moves.end()){
-                                std::cout<<"moving x\n";
-                                moveVal = moves.find("x")->second;
-                                std::cout<<"the x move value is "<<moveVal<<"\n";
-                                if(!moveVal == 0){
-                                    //bscDrives.moveAbsolute(0x01,moveVal,0x21);
-                                    bscDrives.moveRelative(0x01,moveVal,0x21);
-                                }
-                                moves.erase("x");
-                            }
-                            else{
-                                // some error has occurred because there are only supposed
-                                // to be three keys
-                                std::cout<<"****CASE1-ERROR\n";
-                                positionSample = false;
-                            }
-
-                        }
-                        else{
-                            //moves have all been issued, motors are not moving - evaluate
-                            std::cout<<"moves is empty \n";
-                            bool reposition = false;//evaluateReposition();
-                            if(reposition){
-                                calculateMovesFromCurrentPose(true);
-                                std::cout<<"$%%&*£***!! \n";
-                            }
-                            else{
-
-                                std::cout<<"saving count is:"<<savingcount<<" \n";
-                                //positioning cycle can temporarily be halted
-                                if(savingcount == 15){
-                                    emit moveCompleted();
-                                    positionSample = false;
-                                    savingcount = 0;
-                                    std::cout<<"position sample stopping now \n";
-                                }
-                                savingcount++;
-                            }
-                        }
-                    }
-                }
-
-
-                /** File output**/
-                // poses
-                outstream2 << vpMath::deg( eulvec2[2])<< "\t"<< vpMath::deg( eulvec2[1]) << "\t"<< vpMath::deg(eulvec2[0])<< "\t"<<pv2[0]<< "\t"<<pv2[1]<< "\t"<<pv2[2]<<std::endl;
-                outstream3 << vpMath::deg( eulvec3[2])<< "\t"<< vpMath::deg( eulvec3[1]) << "\t"<< vpMath::deg(eulvec3[0])<< "\t"<<pv3[0]<< "\t"<<pv3[1]<< "\t"<<pv3[2]<<std::endl;
-                //errors / residuals
-                outstream4<<sqrt( (tracker->getError()).sumSquare()) <<","<< sqrt( (tracker->getError()).sumSquare())/tracker->getError().size() <<","<< tracker->getError().size() << ","<< tracker->getProjectionError()<< std::endl;
-                //motors - actuators
-                outstream6<<cdp.at(0)<<","<<cdp.at(1)<<","<<cdp.at(2)<<std::endl;
-                //whole error vectors
-                printErrVector(outstream1,tracker->getError());
-                printErrVector(outstream8, tracker->getRobustWeights());
-
-
+            //the motion state machine and the file output run on the control stage
+            trackresult* result = controlQueue.beginPush();
+            if(result != NULL){
+                result->cMo2 = cMo2;
+                result->cMo3 = cMo3;
+                result->error2 = tracker->getError();
+                result->weights2 = tracker->getRobustWeights();
+                result->projError2 = tracker->getProjectionError();
+                result->stereo = true;
+                result->frameNumber = frame2.frameNumber();
+                controlQueue.commitPush();
             }
-            i++;
+            //drive positions and what the other stages have to report to the gui
+            emitPipelineEvents(lastPoll);
+            trackStats.end();
+            frameLatency->record(trackStats.getLastMs() * 1000);
+            trace.record(frameSpan, acquired, latencyhistogram::now(), frame2.frameNumber());
       }
     }
     catch(...){
-      outstream2.close();
-      outstream3.close();
-      outstream4.close();
-      outstream5.close();
-      outstream6.close();
-      outstream8.close();
-      outstream1.close();
-      end=true;
-    }
-    if(!end){
-       outstream2.close();
-       outstream3.close();
-       outstream4.close();
-       outstream5.close();
-       outstream6.close();
-       outstream8.close();
-       outstream1.close();
-     }
+    }
+    //the stages finish what is queued before the output streams are closed
+    stopPipeline();
+    outstream2.close();
+    outstream3.close();
+    outstream4.close();
+    outstream5.close();
+    outstream6.close();
+    outstream8.close();
+    outstream1.close();
+    frame2.release();
+    frame3.release();
+    capture2.stop();
+    capture3.stop();
+    //acquisition rate achieved during the run and whether tracking kept up with it
+    printCameraStats();
+    capture2.printStats();
+    capture3.printStats();
+    pairer.printStats();
+    printPipelineStats();
+    if(display.isRunning()){
+        display.printStats();
+    }
+    latency.print();
+    writeLatencyReport();
 }
 
 void applicationcontroller::initStereoTracker(){
@@ -1712,7 +2321,8 @@ void applicationcontroller::initStereoTracker(){
 
     //load model and config display
     tracker->loadModel(modelFileCao);
-    tracker->setDisplayFeatures(true);
+    modelFile = modelFileCao;
+    tracker->setDisplayFeatures(false);
     std::cout<<"!!22222222222222222222222222\n";
     //set the transformation matrix
     std::map<std::string, vpHomogeneousMatrix> mapOfCameraTransformationMatrix;
@@ -1723,14 +2333,75 @@ void applicationcontroller::initStereoTracker(){
     tracker->initFromPose(img2,img3,cMo2, cMo3, true);
     //get init matrices
     tracker->getPose(c2I_cmo, c3I_cmo);
-    //display
-    vpDisplay::flush(img2);
-    vpDisplay::flush(img3);
     std::cout<<"!!3333333333333333333333333333\n";
 
 }
 
 
+/**
+ * @brief applicationcontroller::isSampleMoving true while a positioning is running or the drive stage last read a
+ * drive as moving
+ */
+bool applicationcontroller::isSampleMoving(){
+    bool motionRead, moving;
+    unsigned long polls;
+    getDriveMotion(motionRead, moving, polls);
+    return positionSample || (motionRead && moving);
+}
+
+/**
+ * @brief applicationcontroller::updateCameraAOI moves the sensor area of interest of a camera so that it
+ * contains the model projected at the current pose plus a margin. Changing the area reopens the camera, which
+ * stalls its capture for a few frames, so the area is only moved when the model gets within half a margin of
+ * its border. While the sample moves it is set with three margins on each side and never shrunk, it is only
+ * shrunk once it is much larger than needed and has not moved for two seconds.
+ * @param grabber camera to update
+ * @param lines model lines of the tracker for this camera
+ * @param cMo current pose
+ * @param cam camera parameters
+ * @param moving the sample is being moved
+ * @param lastChange when the area of this camera was last moved, in ms, updated
+ */
+void applicationcontroller::updateCameraAOI(vpUeyeFrameGrabber& grabber, std::list<vpMbtDistanceLine*>& lines,
+                                            const vpHomogeneousMatrix& cMo, const vpCameraParameters& cam,
+                                            bool moving, double& lastChange){
+    const double settleMs = 2000;
+    double umin = 1e9, vmin = 1e9, umax = -1e9, vmax = -1e9;
+    for(std::list<vpMbtDistanceLine*>::const_iterator it = lines.begin(); it != lines.end(); ++it){
+        vpPoint ends[2] = {*(*it)->p1, *(*it)->p2};
+        for(int k = 0; k < 2; k++){
+            ends[k].project(cMo);
+            double u,v;
+            vpMeterPixelConversion::convertPoint(cam, ends[k].get_x(), ends[k].get_y(), u, v);
+            umin = std::min(umin, u);
+            umax = std::max(umax, u);
+            vmin = std::min(vmin, v);
+            vmax = std::max(vmax, v);
+        }
+    }
+    if(umax < umin){
+        return;
+    }
+    //the area of interest is in sensor pixels, the images may be binned
+    umin *= trackedBinning;
+    umax *= trackedBinning;
+    vmin *= trackedBinning;
+    vmax *= trackedBinning;
+    int x,y,w,h;
+    grabber.getAOI(x,y,w,h);
+    double now = capturethread::now();
+    double half = aoiMargin / 2.0;
+    bool outside = umin - half < x || vmin - half < y || umax + half > x + w || vmax + half > y + h;
+    double needed = (umax - umin + 2 * aoiMargin) * (vmax - vmin + 2 * aoiMargin);
+    bool oversized = !moving && now - lastChange > settleMs && (double)w * h > 4 * needed;
+    if(outside || oversized){
+        int margin = moving ? 3 * aoiMargin : aoiMargin;
+        grabber.setAOI((int)(umin - margin), (int)(vmin - margin),
+                       (int)(umax - umin) + 2 * margin, (int)(vmax - vmin) + 2 * margin);
+        lastChange = now;
+    }
+}
+
 /**
  * there is a difference in how the camera rotations are provided and how the front end input and motors expect
  * rotation moves to be given.  Cameras work in pi -180 to 180 range while motors work in 0 - 360
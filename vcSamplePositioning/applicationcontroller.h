@@ -30,6 +30,18 @@
 #include <visp/vpPose.h>
 #include <visp/vpMbtDistanceLine.h>
 #include "vpUeyeFrameGrabber.h"
+#include "vpSimulatedFrameGrabber.h"
+#include "vpReplayFrameGrabber.h"
+#include "overlaydisplay.h"
+#include "imagewriter.h"
+#include "capturethread.h"
+#include "stereopairer.h"
+#include "stagequeue.h"
+#include "stagestats.h"
+#include "workerthread.h"
+#include "warmupgate.h"
+#include "latencylog.h"
+#include "tracelog.h"
 #include <boost/lexical_cast.hpp>
 #include <visp/vpImageIo.h>
 #include "boost/filesystem/operations.hpp"
@@ -38,6 +50,9 @@
 #include <thordrive.h>
 #include <map>
 #include <unordered_map>
+#include <future>
+#include <atomic>
+#include <mutex>
 #include "vcuserinputwindow.h"
 
 namespace fs = boost::filesystem;
@@ -46,7 +61,17 @@ class applicationcontroller : public QObject
 {
     Q_OBJECT
 public:
-    explicit applicationcontroller(bool stereo,QObject *parent = 0);
+    //where the camera images come from
+    enum cameraSource {UEYE_CAMERAS, SIMULATED_CAMERAS, REPLAY_REALTIME, REPLAY_FAST};
+    /*!
+    * \brief Constructor.
+    * \param[in] stereo use the stereo tracker.
+    * \param[in] source where the images come from.
+    * \param[in] replayPath run directory to play back with the replay sources.
+    * \param[in] headless no display windows.
+    */
+    explicit applicationcontroller(bool stereo, cameraSource source = UEYE_CAMERAS, std::string replayPath = "",
+                                   bool headless = false, QObject *parent = 0);
     ~applicationcontroller();
     void getAndDisplayImage(int portNum, std::string name);
     void doTrackSamplePositioning();    
@@ -61,8 +86,64 @@ public slots:
     void doSamplePositioning(std::map<std::string, double> moves);
     void samplePositioningComplete();
     void shutdown();
+    /*!
+    * \brief Write the latency histograms recorded so far in the run to latency.csv in the run folder.
+    */
+    void writeLatencyReport();
     void stopTracking();
     void startTracking();
+    /*!
+    * \brief Reduce the camera images by factor (1, 2 or 4), low resolution for coarse positioning and
+    * full resolution for the final alignment. The trackers follow once the new frames arrive.
+    */
+    void setBinning(int factor);
+    /*!
+    * \brief Size of the camera sensors when it is not the 1600x1200 the camera parameter files were calibrated
+    * at, the parameters are resized for the same field of view and the trackers follow once the new frames arrive.
+    */
+    void setSensorSize(int w, int h);
+    /*!
+    * \brief Read only the part of the sensors around the sample holder once it is tracked, for a higher frame
+    * rate and less USB bandwidth. Moving the area reopens the cameras, it is moved as seldom as the model allows.
+    * \param[in] on follow the model, false to read the whole sensors again.
+    * \param[in] margin pixels kept around the projected model, 0 to keep the current margin.
+    */
+    void setTrackedAOI(bool on, int margin = 0);
+    /*!
+    * \brief Views per second of the display windows, independent of the tracking rate.
+    */
+    void setDisplayRate(double hz);
+    /*!
+    * \brief Largest capture time difference between the two frames given to the stereo tracker, 20 ms by default.
+    */
+    void setMaxSkew(double ms);
+    /*!
+    * \brief How the frames saved while tracking are written, applies from the next tracking run.
+    * \param[in] f file format.
+    * \param[in] pngLevel zlib level of PNG files, 0 (fastest) to 9 (smallest).
+    * \param[in] writers number of persist threads writing frames.
+    */
+    void setImageOutput(imagewriter::format f, int pngLevel, unsigned int writers);
+    /*!
+    * \brief When tracking starts, once the drives are stationary and the images stable.
+    * \param[in] threshold mean grey level difference between consecutive frames below which the images are stable.
+    * \param[in] timeoutS longest wait before tracking starts regardless.
+    */
+    void setWarmup(double threshold, double timeoutS);
+    /*!
+    * \brief Write a timeline of every tracking run to trace.json in the run folder, one span per stage and frame,
+    * to open in chrome://tracing or Perfetto.
+    */
+    void setTracing(bool on);
+    /*!
+    * \brief Have the drive controllers push their status while tracking instead of the drive stage asking for it
+    * every poll, applies from the next tracking run.
+    */
+    void setStatusStreaming(bool on);
+    /*!
+    * \brief Ask the tracking thread to write the latency report, safe to call from a signal handler.
+    */
+    static void requestLatencyReport();
 private:
     void initAllEquipment(bool stereo);
     void initTrackers();
@@ -71,6 +152,19 @@ private:
     void calculateMovesFromCurrentPose(bool relative);
     std::string getCurrentDT();
     void initCameras();
+    //outcome and timings of starting one camera
+    struct cameraStartup
+    {
+        bool opened, read;
+        int warmupFrames;
+        double openMs, totalMs;
+    };
+    void startCamera(vpUeyeFrameGrabber& grabber, int pixelClock, vpImage<unsigned char>& I,
+                     cameraStartup& startup, std::promise<void>* opened, std::shared_future<void> waitFor);
+    void initSimulatedCameras();
+    void initReplayCameras();
+    void printCameraStats();
+    bool followImageSize(bool stereo);
     int makeFolder(char* foldername);
     void printStats(std::string filename,std::vector<std::vector<double > > stats);
     std::vector<double> getPosesAsStdVector(vpPoseVector pv, vpRzyxVector eulvec);
@@ -80,15 +174,91 @@ private:
     bool evaluateReposition();
     std::vector<double> getCurrentStagePose(vpHomogeneousMatrix hmatC,vpHomogeneousMatrix hmatI);
     std::vector<double>getCurrentStagePoseAsStdVec(vpHomogeneousMatrix hmatC, vpHomogeneousMatrix hmatI);
+    void updateCameraAOI(vpUeyeFrameGrabber& grabber, std::list<vpMbtDistanceLine*>& lines,
+                         const vpHomogeneousMatrix& cMo, const vpCameraParameters& cam, bool moving,
+                         double& lastChange);
+    bool isSampleMoving();
+    //tracking pipeline - the tracking thread owns the trackers and feeds the persist, control and drive
+    //stages through bounded queues, the capture threads are the acquisition stage
+    //frames to save with the poses tracked in them
+    struct persistjob
+    {
+        frameref frame2,frame3;
+        vpHomogeneousMatrix cMo2,cMo3;
+        vpCameraParameters cam2,cam3;
+        double positions[3];// drives z, y, x when the frame was tracked
+    };
+    //what the control stage needs from one tracked frame
+    struct trackresult
+    {
+        vpHomogeneousMatrix cMo2,cMo3;
+        vpColVector error2,error3,weights2,weights3;
+        double projError2,projError3;
+        bool stereo;
+        unsigned long frameNumber;// capture number of the camera 2 frame
+    };
+    //drive positions and motion read by the drive stage
+    struct drivestatus
+    {
+        std::vector<double> positions;
+        bool moving,movingRead;
+        unsigned long polls;
+        unsigned long commandsDone;// moves run before this status was read
+    };
+    //relative move issued by the control stage and run by the drive stage
+    struct drivecommand
+    {
+        thordrive* drive;
+        double distance;
+        unsigned char destination;
+    };
+    void startPipeline(bool stereo, const std::string& imageoutBase);
+    void stopPipeline();
+    void persistLoop(unsigned int writer);
+    void controlLoop();
+    void driveLoop();
+    void positioningStep(const drivestatus& status, bool stereo);
+    void logResult(const trackresult& result, const drivestatus& status);
+    void issueMove(thordrive& drive, double distance, unsigned char destination);
+    int stopActiveDrive();
+    drivestatus getDriveStatus();
+    void getDrivePositions(double positions[3]);
+    void getDriveMotion(bool& motionRead, bool& moving, unsigned long& polls);
+    bool warmupDone(bool stereo);
+    void emitPipelineEvents(unsigned long& lastPoll);
+    void printPipelineStats();
 
+    cameraSource source;
     vpUeyeFrameGrabber frameGrabber3,frameGrabber2;
+    vpSimulatedFrameGrabber simGrabber2,simGrabber3;
+    std::string replayPath;
+    replaysequence replay;
+    vpReplayFrameGrabber replayGrabber2,replayGrabber3;
+    capturethread capture2,capture3;
+    stereopairer pairer;
     vpCameraParameters cam2,cam3;
     thordrive tdcDrive;
     thordrive bscDrives;
     std::vector<double> desired_pose;
     vpHomogeneousMatrix c2I_cmo,c3I_cmo;//the initial poses of the cameras
 
-    bool initialisedAndReady,positionSample,track,isMoving;
+    bool initialisedAndReady,track,isMoving;
+    //set by the gui slots and the control stage, read by the tracking thread to decide what to save
+    std::atomic<bool> positionSample;
+    //sensor area of interest follows the projected model, margin in pixels around it, and when it was last moved
+    //for each camera
+    bool trackedAOI;
+    int aoiMargin;
+    double aoiChanged2,aoiChanged3;
+    //image reduction requested and the one the trackers are set for, the camera parameters are scaled from
+    //the full resolution ones
+    unsigned int binning,trackedBinning;
+    bool binAverage;
+    unsigned int fullWidth2,fullWidth3,trackedWidth2,trackedWidth3;
+    vpCameraParameters cam2Full,cam3Full;
+    //the camera parameter files and the image size they were calibrated at, setSensorSize resizes from these
+    vpCameraParameters cam2Calibrated,cam3Calibrated;
+    unsigned int calibratedWidth,calibratedHeight;
     std::string basePath,experimentPath,runName;
     int portnumC2,portnumC3,activeDrive;
     vpImage<unsigned char> img2,img3;
@@ -97,7 +267,10 @@ private:
     vpMbEdgeTracker tracker2,tracker3;
     vpMbEdgeMultiTracker *tracker;
     vpHomogeneousMatrix cMo2,cMo3,c3Mc2;
-    vpDisplayOpenCV d2,d3;
+    //live view, not started in headless mode
+    bool headless;
+    overlaydisplay display;
+    std::string modelFile;
     std::map<std::string, double> moves;
     std::unordered_map<double,double> movesmapX,movesmapY;
     double lastx,lasty;
@@ -105,6 +278,50 @@ private:
     void testVector(std::vector<double> v);
     void getCurrentDrivePositions();
     void convertBetweenCamDegsAndMotorDegs(std::vector<double> &posevector);
+
+    stagequeue<persistjob> persistQueue;// drops the oldest frames when writing falls behind
+    stagequeue<trackresult> controlQueue;// never drops, the tracking thread waits instead
+    stagequeue<drivecommand> driveQueue;
+    stagestats trackStats,controlStats,driveStats;
+    std::vector<stagestats> persistStats;// one per persist thread
+    std::thread controlThread,driveThread;
+    std::vector<std::thread> persistThreads;
+    std::atomic<bool> pipelineRunning,stopRequested,moveFinished;
+    std::atomic<int> driveProblem;
+    //guards moves, desired_pose, cdp and the pose the control stage decides from against the gui slots
+    std::mutex controlMutex;
+    vpHomogeneousMatrix controlcMo2,controlcMo3;
+    int savingcount;
+    unsigned long commandsSent;
+    std::mutex statusMutex;
+    drivestatus latestStatus;
+    //saved frames, numbered in the order the persist threads take them
+    imagewriter rawWriter2,rawWriter3;
+    imagewriter::format imageFormat;
+    int pngLevel;
+    unsigned int persistWriters;
+    std::mutex persistTakeMutex;
+    unsigned int nextSaveNumber;
+    std::atomic<unsigned long> savedFrames,persistFailures,savedBytes;
+    //tracks camera 3 while the tracking thread tracks camera 2 in dual camera mode
+    workerthread trackWorker;
+    //tracking starts once the drives have reached their start positions, the drive stage reads their motion
+    //until then
+    warmupgate warmup;
+    std::atomic<bool> warmingUp;
+    //always on latency histograms of the run, by the thread doing the work
+    latencylog latency;
+    latencyhistogram *acquireLatency,*frameLatency,*track2Latency,*track3Latency,*stereoTrackLatency;
+    latencyhistogram *writeLatency,*logLatency,*moveLatency,*tdcStatusLatency,*bscStatusLatency,*motionLatency;
+    //the drive stage reads the status the controllers push rather than asking for it
+    bool statusStreaming;
+    std::string latencyPath;
+    static std::atomic<bool> latencyReportRequested;
+    //optional timeline of the run, the spans of the stages above that are traced
+    tracelog trace;
+    bool tracing;
+    std::string tracePath;
+    unsigned int acquireSpan,frameSpan,track2Span,track3Span,stereoTrackSpan,writeSpan,logSpan;
 };
 
 #endif // APPLICATIONCONTROLLER_H
@@ -0,0 +1,77 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "aptframer.h"
+#include <cstring>
+
+aptframer::aptframer() :
+    skipped(0)
+{
+    reset();
+}
+
+void aptframer::reset()
+{
+    state = HEADER;
+    received = 0;
+    expected = aptmessage::HEADER_LENGTH;
+}
+
+void aptframer::next()
+{
+    reset();
+}
+
+size_t aptframer::push(const unsigned char* data, size_t n)
+{
+    size_t used = 0;
+    while(used < n && state != COMPLETE){
+        size_t take = expected - received;
+        if(take > n - used){
+            take = n - used;
+        }
+        memcpy(current.data + received, data + used, take);
+        received += take;
+        used += take;
+        if(received < expected){
+            break;
+        }
+        if(state == DATA){
+            state = COMPLETE;
+            break;
+        }
+        //a whole header, bit 7 of the destination says a data packet follows
+        const unsigned char* h = current.data;
+        bool withData = (h[4] & 0x80) != 0;
+        unsigned int length = aptmessage::HEADER_LENGTH + (withData ? (h[2] | (h[3] << 8)) : 0);
+        if((h[4] & 0x7F) != 0x01 || !isControllerAddress(h[5]) || length > aptmessage::MAX_LENGTH){
+            //not a header, try again one byte on
+            memmove(current.data, current.data + 1, aptmessage::HEADER_LENGTH - 1);
+            received = aptmessage::HEADER_LENGTH - 1;
+            skipped++;
+            continue;
+        }
+        current.length = length;
+        if(withData && length > aptmessage::HEADER_LENGTH){
+            state = DATA;
+            expected = length;
+        }
+        else{
+            state = COMPLETE;
+        }
+    }
+    return used;
+}
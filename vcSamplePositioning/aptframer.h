@@ -0,0 +1,101 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef APTFRAMER_H
+#define APTFRAMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * \brief Read only view of the bytes of a message with the little endian fields APT uses, fields past its end
+ * read as 0.
+ */
+struct aptspan
+{
+  aptspan(const unsigned char* data, unsigned int length) : data(data), length(length){}
+  unsigned char u8(unsigned int at) const {return at < length ? data[at] : 0;}
+  uint16_t u16(unsigned int at) const {return (uint16_t)(u8(at) | (u8(at + 1) << 8));}
+  uint32_t u32(unsigned int at) const {return (uint32_t)u16(at) | ((uint32_t)u16(at + 2) << 16);}
+  int32_t i32(unsigned int at) const {return (int32_t)u32(at);}
+  const unsigned char* data;
+  unsigned int length;
+};
+
+/*!
+ * \brief One APT message as framed from the serial stream, the 6 byte header and the data packet following it
+ * when bit 7 of the destination byte is set, its length in header bytes 2 and 3.
+ */
+struct aptmessage
+{
+  //the longest reply used is HW_GET_INFO, 90 bytes
+  enum {HEADER_LENGTH = 6, MAX_LENGTH = 96};
+  unsigned char data[MAX_LENGTH];
+  unsigned int length;
+  double time;// received, us on the latency clock
+  uint16_t id() const {return (uint16_t)(data[0] | (data[1] << 8));}
+  unsigned char source() const {return data[5];}
+  aptspan span() const {return aptspan(data, length);}
+};
+
+/*!
+ * \brief Incremental framer of the APT byte stream, fed whatever the port returns and never waiting for more.
+ *
+ * Collects the 6 byte header, checks it is addressed to the host by a controller address and, when bit 7 of
+ * the destination is set, collects the data packet of the length the header gives. A header that fails the
+ * checks is line noise or the tail of a lost message, the framer drops its first byte and tries the next
+ * position so it falls back into step within one message.
+ */
+class aptframer
+{
+public:
+  aptframer();
+  /*!
+  * \brief Forget a partly received message.
+  */
+  void reset();
+  /*!
+  * \brief Consume bytes up to the end of the next complete message.
+  * \return number of bytes used, fewer than n when a message was completed.
+  */
+  size_t push(const unsigned char* data, size_t n);
+  /*!
+  * \brief True once push has completed a message, until next().
+  */
+  bool complete() const {return state == COMPLETE;}
+  /*!
+  * \brief The completed message, its time is left to the caller.
+  */
+  aptmessage& message() {return current;}
+  /*!
+  * \brief Start framing the following message.
+  */
+  void next();
+  unsigned long long getSkippedBytes() const {return skipped;}
+  /*!
+  * \brief True for the addresses a controller sends from: its motherboard, a bay or a single channel unit.
+  */
+  static bool isControllerAddress(unsigned char a) {return a == 0x11 || (a >= 0x21 && a <= 0x2A) || a == 0x50;}
+
+private:
+  enum {HEADER, DATA, COMPLETE} state;
+  aptmessage current;
+  unsigned int received,expected;
+  unsigned long long skipped;
+};
+
+#endif // APTFRAMER_H
@@ -0,0 +1,278 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "aptport.h"
+#include "latencylog.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+aptport::aptport() :
+    fd(-1), epollFd(-1), wakeFd(-1), reading(false), messages(0), discarded(0), replaced(0)
+{
+    for(unsigned int s = 0; s < MAILBOX_SLOTS; s++){
+        mailbox[s].used = false;
+    }
+}
+
+aptport::~aptport()
+{
+    close();
+}
+
+double aptport::now()
+{
+    return latencyhistogram::now();
+}
+
+bool aptport::open(int fd, const std::string& name)
+{
+    close();
+    if(fd < 0){
+        return false;
+    }
+    this->fd = fd;
+    this->name = name;
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(epollFd < 0 || wakeFd < 0){
+        perror("aptport::open() (epoll)");
+        close();
+        return false;
+    }
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    ev.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+    framer.reset();
+    reading = true;
+    reader = std::thread(&aptport::readLoop, this);
+    return true;
+}
+
+void aptport::close()
+{
+    if(reader.joinable()){
+        uint64_t one = 1;
+        if(write(wakeFd, &one, sizeof(one)) < 0){
+            perror("aptport::close() (write())");
+        }
+        reader.join();
+    }
+    if(epollFd >= 0){
+        ::close(epollFd);
+        epollFd = -1;
+    }
+    if(wakeFd >= 0){
+        ::close(wakeFd);
+        wakeFd = -1;
+    }
+}
+
+double aptport::send(const unsigned char* data, unsigned int length)
+{
+    std::lock_guard<std::mutex> lk(writeLock);
+    if(fd < 0){
+        return -1;
+    }
+    double sent = now();
+    unsigned int written = 0;
+    while(written < length){
+        ssize_t n = write(fd, data + written, length - written);
+        if(n > 0){
+            written += n;
+        }
+        else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            //the output buffer is full, wait for it to drain
+            pollfd p;
+            p.fd = fd;
+            p.events = POLLOUT;
+            if(poll(&p, 1, 1000) <= 0){
+                break;
+            }
+        }
+        else if(n < 0 && errno == EINTR){
+            continue;
+        }
+        else{
+            perror("aptport::send() (write())");
+            break;
+        }
+    }
+    if(written != length){
+        std::cout<<name<<": only "<<written<<" of "<<length<<" bytes written"<<std::endl;
+        return -1;
+    }
+    return sent;
+}
+
+void aptport::setHandler(uint16_t id, handler h)
+{
+    std::lock_guard<std::mutex> lk(handlerLock);
+    for(size_t i = 0; i < handlers.size(); i++){
+        if(handlers[i].first == id){
+            handlers[i].second = h;
+            return;
+        }
+    }
+    handlers.push_back(std::make_pair(id, h));
+}
+
+bool aptport::receive(uint16_t id, unsigned char source, double since, double timeoutMs, aptmessage& m)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+            std::chrono::microseconds((long long)(timeoutMs * 1000));
+    std::unique_lock<std::mutex> lk(mailLock);
+    while(true){
+        //the oldest matching message when any source will do
+        int found = -1;
+        for(unsigned int s = 0; s < MAILBOX_SLOTS; s++){
+            const mailslot& slot = mailbox[s];
+            if(slot.used && !slot.taken && slot.message.id() == id && slot.message.time >= since &&
+                    (source == 0 || slot.message.source() == source) &&
+                    (found < 0 || slot.message.time < mailbox[found].message.time)){
+                found = s;
+            }
+        }
+        if(found >= 0){
+            mailbox[found].taken = true;
+            m = mailbox[found].message;
+            return true;
+        }
+        if(!reading || std::chrono::steady_clock::now() >= deadline){
+            return false;
+        }
+        mailArrived.wait_until(lk, deadline);
+    }
+}
+
+/**
+ * @brief aptport::readLoop reader thread - reads whatever the port has whenever it has something and frames it
+ */
+void aptport::readLoop()
+{
+    readPort();
+    //nothing more will come, the callers waiting are let go
+    {
+        std::lock_guard<std::mutex> lk(mailLock);
+        reading = false;
+    }
+    mailArrived.notify_all();
+}
+
+void aptport::readPort()
+{
+    epoll_event events[2];
+    unsigned char chunk[256];
+    while(true){
+        int n = epoll_wait(epollFd, events, 2, -1);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            perror("aptport::readLoop() (epoll_wait())");
+            break;
+        }
+        for(int e = 0; e < n; e++){
+            if(events[e].data.fd == wakeFd){
+                return;
+            }
+            if(events[e].events & (EPOLLERR | EPOLLHUP)){
+                std::cout<<name<<": port closed, reading stopped"<<std::endl;
+                return;
+            }
+            ssize_t r;
+            while((r = read(fd, chunk, sizeof(chunk))) > 0){
+                size_t used = 0;
+                while(used < (size_t)r){
+                    used += framer.push(chunk + used, r - used);
+                    if(framer.complete()){
+                        framer.message().time = now();
+                        deliver(framer.message());
+                        framer.next();
+                    }
+                }
+                discarded = framer.getSkippedBytes();
+            }
+            if(r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                perror("aptport::readLoop() (read())");
+            }
+        }
+    }
+}
+
+void aptport::deliver(const aptmessage& m)
+{
+    messages++;
+    {
+        std::lock_guard<std::mutex> lk(handlerLock);
+        for(size_t i = 0; i < handlers.size(); i++){
+            if(handlers[i].first == m.id() && handlers[i].second){
+                handlers[i].second(m);
+            }
+        }
+    }
+    uint32_t key = ((uint32_t)m.id() << 8) | m.source();
+    {
+        std::lock_guard<std::mutex> lk(mailLock);
+        //same id and source, else a free slot, else the oldest message
+        int slot = -1;
+        for(unsigned int s = 0; s < MAILBOX_SLOTS && slot < 0; s++){
+            if(mailbox[s].used && mailbox[s].key == key){
+                slot = s;
+            }
+        }
+        for(unsigned int s = 0; s < MAILBOX_SLOTS && slot < 0; s++){
+            if(!mailbox[s].used){
+                slot = s;
+            }
+        }
+        if(slot < 0){
+            slot = 0;
+            for(unsigned int s = 1; s < MAILBOX_SLOTS; s++){
+                if(mailbox[s].message.time < mailbox[slot].message.time){
+                    slot = s;
+                }
+            }
+        }
+        if(mailbox[slot].used && !mailbox[slot].taken){
+            replaced++;
+        }
+        mailbox[slot].key = key;
+        mailbox[slot].used = true;
+        mailbox[slot].taken = false;
+        mailbox[slot].message = m;
+    }
+    mailArrived.notify_all();
+}
+
+void aptport::printStats()
+{
+    std::cout<<name<<" - APT messages received \t"<<messages<<"\t not taken \t"<<replaced
+             <<"\t bytes skipped \t"<<discarded<<std::endl;
+}
@@ -0,0 +1,109 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef APTPORT_H
+#define APTPORT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "aptframer.h"
+
+/*!
+ * \brief Event driven APT connection over one serial port.
+ *
+ * A reader thread waits on the port with epoll, frames every message as the bytes arrive and hands it to the
+ * handler registered for its id, then leaves it in a mailbox holding the latest message of each id and source.
+ * Nothing the controllers send is thrown away, messages nobody asked for reach their handlers too. Callers
+ * send a request and either wait for the reply or come back for it later, so a slow controller only holds up the
+ * thread that needs its answer.
+ */
+class aptport
+{
+public:
+  typedef std::function<void(const aptmessage&)> handler;
+  aptport();
+  /*!
+  * \brief Destructor, stops the reader.
+  */
+  ~aptport();
+  /*!
+  * \brief Start reading a configured serial port, the port is made non blocking and stays owned by the caller.
+  * \param[in] name used in the messages.
+  */
+  bool open(int fd, const std::string& name);
+  /*!
+  * \brief Stop the reader, the port is not closed.
+  */
+  void close();
+  bool isOpen() const {return reading.load();}
+  /*!
+  * \brief Write a message, any thread.
+  * \return time just before the write, replies received from then on answer it, negative if not written.
+  */
+  double send(const unsigned char* data, unsigned int length);
+  /*!
+  * \brief Take the message with the id received since a time, waiting for it.
+  * \param[in] source address of the sender, 0 for any.
+  * \param[in] since time returned by send, older messages are not taken.
+  * \param[in] timeoutMs longest wait, 0 to only look.
+  * \param[out] m the message.
+  * \return false if it did not come in time.
+  */
+  bool receive(uint16_t id, unsigned char source, double since, double timeoutMs, aptmessage& m);
+  /*!
+  * \brief Called on the reader thread with every message of the id, before it goes to the mailbox.
+  */
+  void setHandler(uint16_t id, handler h);
+  static double now();
+  unsigned long long getMessages() const {return messages.load();}
+  unsigned long long getDiscardedBytes() const {return discarded.load();}
+  void printStats();
+
+private:
+  void readLoop();
+  void readPort();
+  void deliver(const aptmessage& m);
+  int fd,epollFd,wakeFd;
+  std::string name;
+  std::thread reader;
+  std::atomic<bool> reading;
+  std::mutex writeLock;
+  //latest message of each id and source not yet taken
+  struct mailslot
+  {
+    uint32_t key;
+    bool used,taken;
+    aptmessage message;
+  };
+  enum {MAILBOX_SLOTS = 32};
+  mailslot mailbox[MAILBOX_SLOTS];
+  std::mutex mailLock;
+  std::condition_variable mailArrived;
+  std::mutex handlerLock;
+  std::vector<std::pair<uint16_t, handler> > handlers;
+  //reader thread only
+  aptframer framer;
+  std::atomic<unsigned long long> messages,discarded,replaced;
+};
+
+#endif // APTPORT_H
@@ -0,0 +1,91 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "framearchive.h"
+#include "imagewriter.h"
+#include <cstdlib>
+#include <iostream>
+
+/**
+ * Exports the frames of a frame archive as img<N>.png files, as the runs saved them before the archives, with
+ * the capture time, drive positions, camera parameters and pose of every frame in img_frames.csv.
+ * usage: vcArchiveExport <archive.vca> <output folder> [png level 0-9]
+ */
+int main(int argc, char *argv[])
+{
+    if(argc < 3){
+        std::cout<<"usage: "<<argv[0]<<" <archive.vca> <output folder> [png level 0-9]"<<std::endl;
+        return 1;
+    }
+    std::string outDir(argv[2]);
+    if(!outDir.empty() && outDir[outDir.size() - 1] != '/'){
+        outDir += "/";
+    }
+    int pngLevel = argc > 3 ? atoi(argv[3]) : 6;
+    framearchivereader reader;
+    if(!reader.open(argv[1])){
+        std::cout<<"cannot read the frame archive "<<argv[1]<<std::endl;
+        return 1;
+    }
+    if(reader.wasRecovered()){
+        std::cout<<"the archive was not closed, "<<reader.getNbFrames()<<" complete frames found"<<std::endl;
+    }
+    const framearchive::fileheader& header = reader.getHeader();
+    std::cout<<reader.getNbFrames()<<" frames, first "<<header.width<<"x"<<header.height
+             <<", px "<<header.px<<" py "<<header.py<<" u0 "<<header.u0<<" v0 "<<header.v0<<std::endl;
+    imagewriter writer;
+    try{
+        writer.open(outDir + (header.channels == 1 ? "img" : "track_out"), imagewriter::PNG, pngLevel);
+    }
+    catch(const std::exception& e){
+        std::cout<<e.what()<<std::endl;
+        return 1;
+    }
+    imagewriter::encodebuffer buf;
+    vpImage<unsigned char> grey;
+    vpImage<vpRGBa> colour;
+    unsigned int failed = 0;
+    for(unsigned int i = 0; i < reader.getNbFrames(); i++){
+        framearchive::framerecord r = reader.getRecord(i);
+        framearchive::frameinfo info;
+        info.number = r.number;
+        info.captureNumber = r.captureNumber;
+        info.timestamp = r.timestamp;
+        for(int a = 0; a < 3; a++){
+            info.positions[a] = r.positions[a];
+        }
+        info.cam = reader.getCameraParameters(i);
+        info.cMo = reader.getPose(i);
+        try{
+            if(header.channels == 1){
+                reader.getFrame(i, grey);
+                writer.write(grey, info, buf);
+            }
+            else{
+                reader.getFrame(i, colour);
+                writer.write(colour, info, buf);
+            }
+        }
+        catch(const std::exception& e){
+            if(failed++ == 0){
+                std::cout<<e.what()<<std::endl;
+            }
+        }
+    }
+    std::cout<<reader.getNbFrames() - failed<<" frames exported to "<<outDir<<std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "capturethread.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+capturethread::capturethread(vpFrameGrabber& grabber, std::string name, unsigned int ringSize) :
+    grabber(&grabber), name(name), ring(ringSize), running(false), failed(false),
+    capturedFrames(0), droppedFrames(0), trace(NULL), traceSpan(0), queued(ring.capacity()), queuedCount(0),
+    skippedFrames(0), maxQueueDepth(0)
+{
+}
+
+capturethread::~capturethread()
+{
+    stop();
+}
+
+void capturethread::setGrabber(vpFrameGrabber& g)
+{
+    if(!running){
+        grabber = &g;
+    }
+}
+
+void capturethread::setTrace(tracelog* log, unsigned int span)
+{
+    if(!running){
+        trace = log;
+        traceSpan = span;
+    }
+}
+
+double capturethread::now()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief capturethread::start all frame buffers are allocated here so the capture loop itself never allocates. The
+ * pool holds the frames queued in the ring and on the consumer side, the frame being acquired and the frames the
+ * consumers may hold.
+ */
+void capturethread::start(unsigned int height, unsigned int width, unsigned int heldFrames)
+{
+    if(running){
+        return;
+    }
+    //frames still queued from a previous run go back to the pool before it is reallocated
+    frameref old;
+    while(ring.pop(old)){
+        old.release();
+    }
+    dropQueued(queuedCount);
+    pool.allocate(2 * ring.capacity() + 1 + heldFrames, height, width);
+    scratch.resize(height, width);
+    failed = false;
+    running = true;
+    worker = std::thread(&capturethread::captureLoop, this);
+}
+
+void capturethread::stop()
+{
+    running = false;
+    if(worker.joinable()){
+        worker.join();
+    }
+}
+
+/**
+ * @brief capturethread::captureLoop producer side - grabs continuously. When the consumer is behind and the ring is
+ * full the oldest queued frame is taken back out of it, released and counted as dropped, so the ring always ends
+ * with the newest frame. Only when the consumers hold every pooled frame does the new frame go to a scratch image
+ * and count as dropped.
+ */
+void capturethread::captureLoop()
+{
+    unsigned long frameNumber = 0;
+    frameref frame;
+    if(trace != NULL){
+        trace->nameThread("capture " + name);
+    }
+    frameref oldest;
+    while(running){
+        bool pooled = pool.get(frame);
+        if(!pooled && ring.pop(oldest)){
+            //the buffer of the oldest queued frame is reused
+            oldest.release();
+            droppedFrames++;
+            pooled = pool.get(frame);
+        }
+        vpImage<unsigned char>& target = pooled ? frame.image() : scratch;
+        unsigned char* buffer = target.bitmap;
+        double grabStart = tracelog::now();
+        try{
+            grabber->acquire(target);
+        }
+        catch(...){
+            std::cout<<name<<": frame grabber failed, capture stopped"<<std::endl;
+            failed = true;
+            running = false;
+            break;
+        }
+        if(target.bitmap != buffer){
+            //the grabber changed the image size
+            framepool::countAllocation();
+        }
+        double timestamp = now();
+        if(trace != NULL){
+            trace->record(traceSpan, grabStart, tracelog::now(), frameNumber);
+        }
+        capturedFrames++;
+        if(pooled){
+            frame.setCaptureInfo(timestamp, frameNumber);
+            if(!ring.push(frame)){
+                if(ring.pop(oldest)){
+                    oldest.release();
+                    droppedFrames++;
+                }
+                if(!ring.push(frame)){
+                    //the consumer was taking the oldest slot at that instant
+                    droppedFrames++;
+                }
+            }
+            frame.release();
+        }
+        else{
+            droppedFrames++;
+        }
+        frameNumber++;
+    }
+}
+
+unsigned long capturethread::getLatest(vpImage<unsigned char>& I, double& timestamp)
+{
+    while(true){
+        unsigned int n = getQueueDepth();
+        if(n > 0){
+            return takeFrame(n - 1, I, timestamp);
+        }
+        checkRunning();
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+unsigned long capturethread::getLatest(frameref& frame)
+{
+    while(true){
+        unsigned int n = getQueueDepth();
+        if(n > 0){
+            return takeFrame(n - 1, frame);
+        }
+        checkRunning();
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+/**
+ * @brief capturethread::collectFrames consumer side - moves the frames published since the last call out of the ring,
+ * a consumer side queue already full loses its oldest frames
+ */
+void capturethread::collectFrames()
+{
+    frameref frame;
+    while(ring.pop(frame)){
+        if(queuedCount == queued.size()){
+            dropQueued(1);
+            droppedFrames++;
+        }
+        queued[queuedCount++] = frame;
+        frame.release();
+    }
+}
+
+void capturethread::dropQueued(unsigned int n)
+{
+    for(unsigned int k = 0; k < queuedCount; k++){
+        if(k + n < queuedCount){
+            queued[k] = queued[k + n];
+        }
+        else{
+            queued[k].release();
+        }
+    }
+    queuedCount -= n;
+}
+
+unsigned int capturethread::getQueueDepth()
+{
+    collectFrames();
+    if(queuedCount > maxQueueDepth){
+        maxQueueDepth = queuedCount;
+    }
+    return queuedCount;
+}
+
+double capturethread::peekTimestamp(unsigned int i)
+{
+    return queued[i].timestamp();
+}
+
+unsigned long capturethread::takeFrame(unsigned int i, vpImage<unsigned char>& I, double& timestamp)
+{
+    frameref frame;
+    unsigned long frameNumber = takeFrame(i, frame);
+    frame.copyTo(I);
+    timestamp = frame.timestamp();
+    return frameNumber;
+}
+
+unsigned long capturethread::takeFrame(unsigned int i, frameref& frame)
+{
+    frame = queued[i];
+    skippedFrames += i;
+    dropQueued(i + 1);
+    return frame.frameNumber();
+}
+
+void capturethread::discardFrames(unsigned int n)
+{
+    skippedFrames += n;
+    dropQueued(n);
+}
+
+void capturethread::checkRunning() const
+{
+    if(failed || !running){
+        throw std::runtime_error(name + ": no frame available, capture is not running");
+    }
+}
+
+void capturethread::printStats()
+{
+    std::cout<<name<<" captured frames \t"<<capturedFrames<<std::endl;
+    std::cout<<name<<" dropped (overwritten or no free frame) \t"<<droppedFrames<<std::endl;
+    std::cout<<name<<" skipped (superseded) \t"<<skippedFrames<<std::endl;
+    std::cout<<name<<" max queue depth \t"<<maxQueueDepth<<" of "<<ring.capacity()<<std::endl;
+    std::cout<<name<<" pooled frames \t"<<pool.getSize()<<std::endl;
+    std::cout<<"frame buffer allocations (all pools) \t"<<framepool::getAllocations()<<std::endl;
+}
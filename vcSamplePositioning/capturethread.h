@@ -0,0 +1,153 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPTURETHREAD_H
+#define CAPTURETHREAD_H
+
+#include <visp/vpFrameGrabber.h>
+#include <visp/vpImage.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mpmcring.h"
+#include "framepool.h"
+#include "tracelog.h"
+
+/*!
+ * \brief Runs a frame grabber on its own thread so that the tracking loop never waits on the sensor
+ * exposure. Frames are acquired straight into the buffers of a preallocated pool and queued in a ring
+ * of references, consumers take a reference and keep the frame for as long as they need it.
+ *
+ * A consumer that falls behind loses the oldest queued frames, never the newest: when the ring is full
+ * the capture thread takes the oldest frame back out of it to make room.
+ */
+class capturethread
+{
+public:
+  /*!
+  * \brief Constructor.
+  * \param[in] grabber opened frame grabber, only used from the capture thread once started.
+  * \param[in] name used in the statistics output.
+  * \param[in] ringSize number of frames that can be queued, in the ring and on the consumer side each.
+  */
+  capturethread(vpFrameGrabber& grabber, std::string name, unsigned int ringSize = 4);
+  /*!
+  * \brief Capture from another frame grabber, only while stopped.
+  */
+  void setGrabber(vpFrameGrabber& g);
+  /*!
+  * \brief Trace every grab as a span with its frame number, before start.
+  */
+  void setTrace(tracelog* log, unsigned int span);
+  /*!
+  * \brief Destructor, stops the capture thread.
+  */
+  ~capturethread();
+  /*!
+  * \brief Preallocate the frame pool for frames of the given size and start capturing.
+  * \param[in] height,width frame size.
+  * \param[in] heldFrames frames the consumers may hold at once besides the queued ones.
+  */
+  void start(unsigned int height, unsigned int width, unsigned int heldFrames = 2);
+  /*!
+  * \brief Stop capturing and join the capture thread.
+  */
+  void stop();
+  /*!
+  * \brief Copy the newest captured frame into I, waiting for a frame newer than the last one taken.
+  * Older queued frames are skipped. Throws if the grabber failed.
+  * \param[out] I the image.
+  * \param[out] timestamp capture time in ms.
+  * \return the frame number.
+  */
+  unsigned long getLatest(vpImage<unsigned char>& I, double& timestamp);
+  /*!
+  * \brief Same as getLatest without copying, the frame stays out of the pool while referenced.
+  */
+  unsigned long getLatest(frameref& frame);
+  /*!
+  * \brief Capture time of the i-th oldest queued frame, i < getQueueDepth().
+  */
+  double peekTimestamp(unsigned int i);
+  /*!
+  * \brief Copy the i-th oldest queued frame into I and release it with all the frames queued before it.
+  * \return the frame number.
+  */
+  unsigned long takeFrame(unsigned int i, vpImage<unsigned char>& I, double& timestamp);
+  /*!
+  * \brief Take a reference on the i-th oldest queued frame and release it with all the frames queued before it.
+  * \return the frame number.
+  */
+  unsigned long takeFrame(unsigned int i, frameref& frame);
+  /*!
+  * \brief Release the n oldest queued frames without reading them.
+  */
+  void discardFrames(unsigned int n);
+  /*!
+  * \brief Throws if the grabber failed or the capture was stopped.
+  */
+  void checkRunning() const;
+  /*!
+  * \brief Queued frames overwritten by newer ones because the consumer was behind, and new frames no pooled
+  * buffer was free for.
+  */
+  unsigned long getDroppedFrames() const {return droppedFrames.load();}
+  /*!
+  * \brief Frames superseded by a newer one before the consumer took them.
+  */
+  unsigned long getSkippedFrames() const {return skippedFrames;}
+  unsigned long getCapturedFrames() const {return capturedFrames.load();}
+  /*!
+  * \brief Consumer side, frames currently queued and the largest queue depth seen.
+  */
+  unsigned int getQueueDepth();
+  unsigned int getMaxQueueDepth() const {return maxQueueDepth;}
+  bool isRunning() const {return running.load();}
+  /*!
+  * \brief Print the capture counters.
+  */
+  void printStats();
+  /*!
+  * \brief Current time in ms on the monotonic clock used for the frame timestamps.
+  */
+  static double now();
+
+private:
+  void captureLoop();
+  void collectFrames();
+  void dropQueued(unsigned int n);
+  vpFrameGrabber* grabber;
+  std::string name;
+  framepool pool;
+  mpmcring<frameref> ring;
+  vpImage<unsigned char> scratch;
+  std::thread worker;
+  std::atomic<bool> running;
+  std::atomic<bool> failed;
+  std::atomic<unsigned long> capturedFrames;
+  std::atomic<unsigned long> droppedFrames;
+  tracelog* trace;
+  unsigned int traceSpan;
+  //consumer side only, the frames taken out of the ring in capture order
+  std::vector<frameref> queued;
+  unsigned int queuedCount;
+  unsigned long skippedFrames;
+  unsigned int maxQueueDepth;
+};
+
+#endif // CAPTURETHREAD_H
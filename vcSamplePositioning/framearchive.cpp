@@ -0,0 +1,308 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "framearchive.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+framearchive::framearchive() :
+    out(NULL), channels(1), offset(0)
+{
+}
+
+framearchive::~framearchive()
+{
+    close();
+}
+
+void framearchive::create(const std::string& path, const vpCameraParameters& cam, unsigned int width,
+                          unsigned int height, unsigned int channels)
+{
+    close();
+    std::lock_guard<std::mutex> lk(lock);
+    out = fopen(path.c_str(), "wb");
+    if(out == NULL){
+        throw std::runtime_error("cannot create " + path);
+    }
+    this->path = path;
+    this->channels = channels;
+    fileheader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "VCFA", 4);
+    h.version = 1;
+    h.width = width;
+    h.height = height;
+    h.channels = channels;
+    h.distortion = cam.get_projModel() == vpCameraParameters::perspectiveProjWithDistortion ? 1 : 0;
+    h.px = cam.get_px();
+    h.py = cam.get_py();
+    h.u0 = cam.get_u0();
+    h.v0 = cam.get_v0();
+    h.kud = cam.get_kud();
+    h.kdu = cam.get_kdu();
+    h.created = (double)time(NULL);
+    if(fwrite(&h, sizeof(h), 1, out) != 1){
+        fclose(out);
+        out = NULL;
+        throw std::runtime_error("cannot write " + path);
+    }
+    offset = sizeof(h);
+    //a frame every 100 ms for an hour before the index grows
+    index.clear();
+    index.reserve(36000);
+}
+
+unsigned long framearchive::append(const vpImage<unsigned char>& I, const frameinfo& info)
+{
+    return appendPixels(I.bitmap, I.getWidth(), I.getHeight(), 1, info);
+}
+
+unsigned long framearchive::append(const vpImage<vpRGBa>& I, const frameinfo& info)
+{
+    return appendPixels((const unsigned char*)I.bitmap, I.getWidth(), I.getHeight(), 4, info);
+}
+
+unsigned long framearchive::appendPixels(const unsigned char* pixels, unsigned int width, unsigned int height,
+                                         unsigned int channels, const frameinfo& info)
+{
+    framerecord r;
+    memset(&r, 0, sizeof(r));
+    memcpy(r.magic, "VCFR", 4);
+    r.number = info.number;
+    r.width = width;
+    r.height = height;
+    r.captureNumber = info.captureNumber;
+    r.timestamp = info.timestamp;
+    for(int a = 0; a < 3; a++){
+        r.positions[a] = info.positions[a];
+    }
+    r.px = info.cam.get_px();
+    r.py = info.cam.get_py();
+    r.u0 = info.cam.get_u0();
+    r.v0 = info.cam.get_v0();
+    for(unsigned int i = 0; i < 3; i++){
+        for(unsigned int j = 0; j < 4; j++){
+            r.cMo[4 * i + j] = info.cMo[i][j];
+        }
+    }
+    size_t dataBytes = (size_t)width * height * channels;
+    std::lock_guard<std::mutex> lk(lock);
+    if(out == NULL){
+        throw std::runtime_error("frame archive is not open");
+    }
+    if(channels != this->channels){
+        throw std::runtime_error(path + " holds images with another number of channels");
+    }
+    if(fwrite(&r, sizeof(r), 1, out) != 1 || fwrite(pixels, 1, dataBytes, out) != dataBytes){
+        throw std::runtime_error("cannot append to " + path);
+    }
+    indexentry e;
+    e.offset = offset;
+    e.number = info.number;
+    e.reserved = 0;
+    index.push_back(e);
+    offset += sizeof(r) + dataBytes;
+    return sizeof(r) + dataBytes;
+}
+
+void framearchive::close()
+{
+    std::lock_guard<std::mutex> lk(lock);
+    if(out == NULL){
+        return;
+    }
+    //frames written by several threads are not always appended in order, the index is
+    std::stable_sort(index.begin(), index.end(),
+                     [](const indexentry& a, const indexentry& b){return a.number < b.number;});
+    footer f;
+    memcpy(f.magic, "VCFI", 4);
+    f.count = (unsigned int)index.size();
+    f.indexOffset = offset;
+    bool written = (index.empty() || fwrite(&index[0], sizeof(indexentry), index.size(), out) == index.size())
+            && fwrite(&f, sizeof(f), 1, out) == 1;
+    if(fclose(out) != 0 || !written){
+        //the frames are there, the reader rebuilds the index
+        fprintf(stderr, "cannot write the index of %s\n", path.c_str());
+    }
+    out = NULL;
+}
+
+framearchivereader::framearchivereader() :
+    data(NULL), size(0), recovered(false)
+{
+}
+
+framearchivereader::~framearchivereader()
+{
+    close();
+}
+
+bool framearchivereader::open(const std::string& path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(framearchive::fileheader)){
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    //the mapping keeps the file open
+    ::close(fd);
+    if(mapped == MAP_FAILED){
+        return false;
+    }
+    data = (const unsigned char*)mapped;
+    size = st.st_size;
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, "VCFA", 4) != 0){
+        close();
+        return false;
+    }
+    recovered = !readIndex();
+    if(recovered){
+        rebuildIndex();
+    }
+    return true;
+}
+
+void framearchivereader::close()
+{
+    if(data != NULL){
+        munmap((void*)data, size);
+        data = NULL;
+    }
+    size = 0;
+    offsets.clear();
+    recovered = false;
+}
+
+/**
+ * @brief framearchivereader::readIndex the footer is the last bytes of a closed archive
+ * @return false if there is no valid index
+ */
+bool framearchivereader::readIndex()
+{
+    if(size < sizeof(header) + sizeof(framearchive::footer)){
+        return false;
+    }
+    framearchive::footer f;
+    memcpy(&f, data + size - sizeof(f), sizeof(f));
+    if(memcmp(f.magic, "VCFI", 4) != 0
+            || f.indexOffset + (unsigned long long)f.count * sizeof(framearchive::indexentry) + sizeof(f) != size){
+        return false;
+    }
+    offsets.resize(f.count);
+    for(unsigned int i = 0; i < f.count; i++){
+        framearchive::indexentry e;
+        memcpy(&e, data + f.indexOffset + (size_t)i * sizeof(e), sizeof(e));
+        if(e.offset + sizeof(framearchive::framerecord) > f.indexOffset){
+            offsets.clear();
+            return false;
+        }
+        offsets[i] = e.offset;
+    }
+    return true;
+}
+
+/**
+ * @brief framearchivereader::rebuildIndex walks the records after the header, up to the first one that is not
+ * complete
+ */
+void framearchivereader::rebuildIndex()
+{
+    offsets.clear();
+    unsigned long long at = sizeof(header);
+    while(at + sizeof(framearchive::framerecord) <= size){
+        framearchive::framerecord r;
+        memcpy(&r, data + at, sizeof(r));
+        unsigned long long bytes = sizeof(r) + (unsigned long long)r.width * r.height * header.channels;
+        if(memcmp(r.magic, "VCFR", 4) != 0 || at + bytes > size){
+            break;
+        }
+        offsets.push_back(at);
+        at += bytes;
+    }
+}
+
+framearchive::framerecord framearchivereader::getRecord(unsigned int index) const
+{
+    framearchive::framerecord r;
+    memcpy(&r, data + offsets[index], sizeof(r));
+    return r;
+}
+
+const unsigned char* framearchivereader::getPixels(unsigned int index) const
+{
+    return data + offsets[index] + sizeof(framearchive::framerecord);
+}
+
+vpCameraParameters framearchivereader::getCameraParameters(unsigned int index) const
+{
+    framearchive::framerecord r = getRecord(index);
+    vpCameraParameters cam;
+    if(header.distortion){
+        cam.initPersProjWithDistortion(r.px, r.py, r.u0, r.v0, header.kud, header.kdu);
+    }
+    else{
+        cam.initPersProjWithoutDistortion(r.px, r.py, r.u0, r.v0);
+    }
+    return cam;
+}
+
+vpHomogeneousMatrix framearchivereader::getPose(unsigned int index) const
+{
+    framearchive::framerecord r = getRecord(index);
+    vpHomogeneousMatrix cMo;
+    for(unsigned int i = 0; i < 3; i++){
+        for(unsigned int j = 0; j < 4; j++){
+            cMo[i][j] = r.cMo[4 * i + j];
+        }
+    }
+    return cMo;
+}
+
+bool framearchivereader::getFrame(unsigned int index, vpImage<unsigned char>& I) const
+{
+    if(header.channels != 1){
+        return false;
+    }
+    framearchive::framerecord r = getRecord(index);
+    I.resize(r.height, r.width);
+    memcpy(I.bitmap, getPixels(index), (size_t)r.width * r.height);
+    return true;
+}
+
+bool framearchivereader::getFrame(unsigned int index, vpImage<vpRGBa>& I) const
+{
+    if(header.channels != 4){
+        return false;
+    }
+    framearchive::framerecord r = getRecord(index);
+    I.resize(r.height, r.width);
+    memcpy((unsigned char*)I.bitmap, getPixels(index), (size_t)r.width * r.height * 4);
+    return true;
+}
@@ -0,0 +1,181 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEARCHIVE_H
+#define FRAMEARCHIVE_H
+
+#include <visp/vpImage.h>
+#include <visp/vpRGBa.h>
+#include <visp/vpCameraParameters.h>
+#include <visp/vpHomogeneousMatrix.h>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Single file holding the frames of one camera for a whole run with the pose tracked in each,
+ * written append only while tracking and read back with framearchivereader.
+ *
+ * Layout, all fields in the byte order of the writing machine:
+ * - fileheader: resolution, channels and camera parameters when the archive was created.
+ * - per frame a framerecord followed by the pixels, rows of width * channels bytes.
+ * - on close the index, one indexentry per frame in frame number order, then the footer pointing at it.
+ *
+ * An archive that was not closed has no index, the reader rebuilds it by walking the records, in the
+ * order they were appended.
+ */
+class framearchive
+{
+public:
+  struct fileheader
+  {
+    char magic[4]; //"VCFA"
+    unsigned int version;
+    unsigned int width, height;
+    unsigned int channels; //1 grey, 4 RGBA
+    unsigned int distortion; //1 if kud and kdu are used
+    double px, py, u0, v0, kud, kdu;
+    double created; //s since the epoch
+  };
+  struct framerecord
+  {
+    char magic[4]; //"VCFR"
+    unsigned int number; //saved frame number
+    unsigned int width, height;
+    unsigned long long captureNumber; //frame number of the camera
+    double timestamp; //capture time, ms on the monotonic clock
+    double positions[3]; //drive positions z, y, x when the frame was tracked
+    double px, py, u0, v0; //camera parameters of the frame, they follow the binning
+    double cMo[12]; //tracked pose of the model, rows of [R t]
+  };
+  struct indexentry
+  {
+    unsigned long long offset; //of the framerecord
+    unsigned int number;
+    unsigned int reserved;
+  };
+  struct footer
+  {
+    char magic[4]; //"VCFI"
+    unsigned int count;
+    unsigned long long indexOffset;
+  };
+  /*!
+  * \brief What is stored with a frame besides its pixels.
+  */
+  struct frameinfo
+  {
+    unsigned int number;
+    unsigned long long captureNumber;
+    double timestamp;
+    double positions[3];
+    vpCameraParameters cam;
+    vpHomogeneousMatrix cMo;
+  };
+  framearchive();
+  /*!
+  * \brief Destructor, closes the archive.
+  */
+  ~framearchive();
+  /*!
+  * \brief Create the file, replacing any existing one. Throws std::runtime_error if it cannot be created.
+  * \param[in] path of the archive.
+  * \param[in] cam camera parameters at the resolution width x height.
+  * \param[in] channels 1 for grey frames, 4 for RGBA.
+  */
+  void create(const std::string& path, const vpCameraParameters& cam, unsigned int width, unsigned int height,
+              unsigned int channels);
+  /*!
+  * \brief Append one frame, from any thread. Throws std::runtime_error if it cannot be written.
+  * \return the number of bytes written.
+  */
+  unsigned long append(const vpImage<unsigned char>& I, const frameinfo& info);
+  unsigned long append(const vpImage<vpRGBa>& I, const frameinfo& info);
+  /*!
+  * \brief Write the index and close the file.
+  */
+  void close();
+  bool isOpen() const {return out != NULL;}
+
+private:
+  unsigned long appendPixels(const unsigned char* pixels, unsigned int width, unsigned int height,
+                             unsigned int channels, const frameinfo& info);
+  std::string path;
+  FILE* out;
+  unsigned int channels;
+  unsigned long long offset;
+  std::vector<indexentry> index;
+  std::mutex lock;
+};
+
+/*!
+ * \brief Random access to the frames of an archive, the file is mapped read only and frames are
+ * found through the index in constant time.
+ */
+class framearchivereader
+{
+public:
+  framearchivereader();
+  ~framearchivereader();
+  /*!
+  * \brief Map an archive.
+  * \return false if the file cannot be mapped or is not an archive.
+  */
+  bool open(const std::string& path);
+  void close();
+  unsigned int getNbFrames() const {return (unsigned int)offsets.size();}
+  const framearchive::fileheader& getHeader() const {return header;}
+  /*!
+  * \brief The archive was not closed and its index was rebuilt from the records.
+  */
+  bool wasRecovered() const {return recovered;}
+  /*!
+  * \brief Record of the frame at position index, 0 to getNbFrames() - 1.
+  */
+  framearchive::framerecord getRecord(unsigned int index) const;
+  /*!
+  * \brief Pixels of the frame at position index, valid until close().
+  */
+  const unsigned char* getPixels(unsigned int index) const;
+  /*!
+  * \brief Camera parameters of the frame at position index, with the distortion of the header.
+  */
+  vpCameraParameters getCameraParameters(unsigned int index) const;
+  /*!
+  * \brief Pose of the model tracked in the frame at position index.
+  */
+  vpHomogeneousMatrix getPose(unsigned int index) const;
+  /*!
+  * \brief Copy a frame into I, resized to the frame size. Grey archives into grey images and
+  * RGBA archives into colour images.
+  * \return false if the image type does not match the archive.
+  */
+  bool getFrame(unsigned int index, vpImage<unsigned char>& I) const;
+  bool getFrame(unsigned int index, vpImage<vpRGBa>& I) const;
+
+private:
+  bool readIndex();
+  void rebuildIndex();
+  const unsigned char* data;
+  size_t size;
+  framearchive::fileheader header;
+  std::vector<unsigned long long> offsets;
+  bool recovered;
+};
+
+#endif // FRAMEARCHIVE_H
@@ -0,0 +1,117 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "framepool.h"
+#include <cstring>
+
+std::atomic<unsigned long> framepool::allocations(0);
+
+frameref::frameref(const frameref& other) : frame(other.frame)
+{
+    if(frame != NULL){
+        frame->refs++;
+    }
+}
+
+frameref& frameref::operator=(const frameref& other)
+{
+    //taken before releasing, other may be this handle
+    pooledframe* f = other.frame;
+    if(f != NULL){
+        f->refs++;
+    }
+    release();
+    frame = f;
+    return *this;
+}
+
+void frameref::release()
+{
+    if(frame != NULL && --frame->refs == 0){
+        frame->pool->recycle(frame);
+    }
+    frame = NULL;
+}
+
+void frameref::setCaptureInfo(double timestamp, unsigned long frameNumber)
+{
+    frame->timestamp = timestamp;
+    frame->frameNumber = frameNumber;
+}
+
+void frameref::copyTo(vpImage<unsigned char>& I) const
+{
+    if(I.getHeight() != frame->I.getHeight() || I.getWidth() != frame->I.getWidth()){
+        I.resize(frame->I.getHeight(), frame->I.getWidth());
+    }
+    memcpy(I.bitmap, frame->I.bitmap, frame->I.getSize());
+}
+
+framepool::framepool()
+{
+}
+
+framepool::~framepool()
+{
+    for(size_t i = 0; i < frames.size(); i++){
+        delete frames[i];
+    }
+}
+
+void framepool::allocate(unsigned int count, unsigned int height, unsigned int width)
+{
+    for(size_t i = 0; i < frames.size(); i++){
+        delete frames[i];
+    }
+    frames.resize(count);
+    freeFrames.reset(count);
+    for(unsigned int i = 0; i < count; i++){
+        frames[i] = new pooledframe();
+        frames[i]->I.resize(height, width);
+        frames[i]->timestamp = 0;
+        frames[i]->frameNumber = 0;
+        frames[i]->refs = 0;
+        frames[i]->pool = this;
+        freeFrames.push(frames[i]);
+        allocations++;
+    }
+}
+
+bool framepool::get(frameref& ref)
+{
+    pooledframe* frame = NULL;
+    if(!freeFrames.pop(frame)){
+        return false;
+    }
+    ref.release();
+    frame->refs = 1;
+    ref.frame = frame;
+    return true;
+}
+
+unsigned int framepool::getFree()
+{
+    return freeFrames.size();
+}
+
+/**
+ * @brief framepool::recycle called when the last reference is released, the free list has room for every frame
+ * so this never fails nor allocates
+ */
+void framepool::recycle(pooledframe* frame)
+{
+    freeFrames.push(frame);
+}
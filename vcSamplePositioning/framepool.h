@@ -0,0 +1,114 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <visp/vpImage.h>
+#include "mpmcring.h"
+#include <atomic>
+#include <vector>
+
+class framepool;
+
+/*!
+ * \brief A frame buffer of a pool with its capture time, owned by the frameref handles pointing to it.
+ */
+struct pooledframe
+{
+  vpImage<unsigned char> I;
+  double timestamp; //ms on the monotonic clock
+  unsigned long frameNumber;
+  std::atomic<int> refs;
+  framepool* pool;
+};
+
+/*!
+ * \brief Reference counted handle on a pooled frame, the buffer goes back to its pool when the last
+ * handle is released or destroyed. Handles can be copied and released from any thread, a frame
+ * must not be written once it has been shared.
+ */
+class frameref
+{
+public:
+  frameref() : frame(NULL){}
+  frameref(const frameref& other);
+  frameref& operator=(const frameref& other);
+  ~frameref(){release();}
+  /*!
+  * \brief Drop this reference.
+  */
+  void release();
+  bool empty() const {return frame == NULL;}
+  vpImage<unsigned char>& image() const {return frame->I;}
+  double timestamp() const {return frame->timestamp;}
+  unsigned long frameNumber() const {return frame->frameNumber;}
+  void setCaptureInfo(double timestamp, unsigned long frameNumber);
+  /*!
+  * \brief Copy the image into I, resized only if its size differs.
+  */
+  void copyTo(vpImage<unsigned char>& I) const;
+
+private:
+  friend class framepool;
+  pooledframe* frame;
+};
+
+/*!
+ * \brief Fixed set of frame buffers allocated once at startup, shared by the grabber filling them and
+ * the tracker, overlay and writer reading them, so that no image is allocated per frame. The free frames
+ * are kept in a lock free ring, taking and returning a frame never waits on another thread.
+ */
+class framepool
+{
+public:
+  framepool();
+  ~framepool();
+  /*!
+  * \brief Allocate the buffers, only while no frame of the pool is referenced.
+  * \param[in] count number of frames.
+  * \param[in] height,width image size.
+  */
+  void allocate(unsigned int count, unsigned int height, unsigned int width);
+  /*!
+  * \brief Take a free frame, never blocks nor allocates.
+  * \param[out] ref the frame, referenced once.
+  * \return false if every frame is in use.
+  */
+  bool get(frameref& ref);
+  unsigned int getSize() const {return (unsigned int)frames.size();}
+  unsigned int getFree();
+  /*!
+  * \brief Image buffers allocated by all the pools since startup, including buffers reallocated by a
+  * grabber because the image size changed. Constant while tracking at a fixed image size.
+  */
+  static unsigned long getAllocations(){return allocations.load();}
+  /*!
+  * \brief Record a buffer allocation made outside the pool, e.g. by a grabber resizing a pooled image.
+  */
+  static void countAllocation(){allocations++;}
+
+private:
+  friend class frameref;
+  void recycle(pooledframe* frame);
+  std::vector<pooledframe*> frames;
+  //room for every frame, so returning one never fails
+  mpmcring<pooledframe*> freeFrames;
+  static std::atomic<unsigned long> allocations;
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,306 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagewriter.h"
+#include <zlib.h>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+//PNG integers are big endian
+void putBigEndian(unsigned char* p, unsigned int v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+//writes one chunk, the crc covers the type and the data
+bool writeChunk(FILE* out, const char* type, const unsigned char* data, unsigned int length)
+{
+    unsigned char head[8];
+    putBigEndian(head, length);
+    memcpy(head + 4, type, 4);
+    uLong crc = crc32(0L, head + 4, 4);
+    if(length > 0){
+        crc = crc32(crc, data, length);
+    }
+    unsigned char tail[4];
+    putBigEndian(tail, (unsigned int)crc);
+    return fwrite(head, 1, 8, out) == 8 && (length == 0 || fwrite(data, 1, length, out) == length)
+            && fwrite(tail, 1, 4, out) == 4;
+}
+}
+
+imagewriter::imagewriter() :
+    f(PNG), pngLevel(Z_DEFAULT_COMPRESSION), blob(NULL), frames(NULL)
+{
+}
+
+imagewriter::~imagewriter()
+{
+    close();
+}
+
+/**
+ * @brief imagewriter::open the blob file is appended to, so a stream reopened in the same run continues it
+ */
+void imagewriter::open(const std::string& base, format f, int pngLevel)
+{
+    close();
+    this->base = base;
+    this->f = f;
+    this->pngLevel = pngLevel < 0 ? 0 : (pngLevel > 9 ? 9 : pngLevel);
+    if(f == ARCHIVE){
+        return;
+    }
+    std::string path = base + "_frames.csv";
+    frames = fopen(path.c_str(), "w");
+    if(frames == NULL){
+        throw std::runtime_error("cannot create " + path);
+    }
+    fprintf(frames, "%s\n", framesHeader());
+    if(f == BLOB){
+        path = base + ".blob";
+        blob = fopen(path.c_str(), "ab");
+        if(blob == NULL){
+            throw std::runtime_error("cannot create " + path);
+        }
+    }
+}
+
+void imagewriter::close()
+{
+    {
+        std::lock_guard<std::mutex> lk(blobLock);
+        if(blob != NULL){
+            fclose(blob);
+            blob = NULL;
+        }
+        if(frames != NULL){
+            fclose(frames);
+            frames = NULL;
+        }
+    }
+    archive.close();
+}
+
+unsigned long imagewriter::write(const vpImage<unsigned char>& I, const framearchive::frameinfo& info,
+                                 encodebuffer& buf)
+{
+    if(f == ARCHIVE){
+        createArchive(I.getWidth(), I.getHeight(), 1, info.cam);
+        return archive.append(I, info);
+    }
+    unsigned long bytes = writeImage(I.bitmap, I.getWidth(), I.getHeight(), 1, info.number, buf);
+    logFrame(info, I.getWidth(), I.getHeight());
+    return bytes;
+}
+
+unsigned long imagewriter::write(const vpImage<vpRGBa>& I, const framearchive::frameinfo& info, encodebuffer& buf)
+{
+    if(f == ARCHIVE){
+        createArchive(I.getWidth(), I.getHeight(), 4, info.cam);
+        return archive.append(I, info);
+    }
+    unsigned long bytes = writeImage((const unsigned char*)I.bitmap, I.getWidth(), I.getHeight(), 4, info.number, buf);
+    logFrame(info, I.getWidth(), I.getHeight());
+    return bytes;
+}
+
+const char* imagewriter::framesHeader()
+{
+    return "number,captureNumber,timestamp_ms,z,y,x,width,height,px,py,u0,v0,"
+           "r00,r01,r02,tx,r10,r11,r12,ty,r20,r21,r22,tz";
+}
+
+/**
+ * @brief imagewriter::logFrame a line of the frames file, after the image has been written
+ */
+void imagewriter::logFrame(const framearchive::frameinfo& info, unsigned int width, unsigned int height)
+{
+    const vpHomogeneousMatrix& M = info.cMo;
+    std::lock_guard<std::mutex> lk(blobLock);
+    if(frames == NULL){
+        return;
+    }
+    fprintf(frames, "%u,%llu,%.3f,%.6f,%.6f,%.6f,%u,%u,%.6f,%.6f,%.6f,%.6f,"
+            "%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f\n",
+            info.number, info.captureNumber, info.timestamp, info.positions[0], info.positions[1], info.positions[2],
+            width, height, info.cam.get_px(), info.cam.get_py(), info.cam.get_u0(), info.cam.get_v0(),
+            M[0][0], M[0][1], M[0][2], M[0][3], M[1][0], M[1][1], M[1][2], M[1][3], M[2][0], M[2][1], M[2][2], M[2][3]);
+}
+
+/**
+ * @brief imagewriter::createArchive on the first write of the stream, the first frame gives the archive header
+ */
+void imagewriter::createArchive(unsigned int width, unsigned int height, unsigned int channels,
+                                const vpCameraParameters& cam)
+{
+    std::lock_guard<std::mutex> lk(archiveLock);
+    if(!archive.isOpen()){
+        archive.create(base + ".vca", cam, width, height, channels);
+    }
+}
+
+bool imagewriter::parseFormat(const std::string& name, format& f)
+{
+    if(name == "png"){
+        f = PNG;
+    }
+    else if(name == "pnm"){
+        f = PNM;
+    }
+    else if(name == "blob"){
+        f = BLOB;
+    }
+    else if(name == "archive"){
+        f = ARCHIVE;
+    }
+    else{
+        return false;
+    }
+    return true;
+}
+
+const char* imagewriter::formatName(format f)
+{
+    switch(f){
+    case PNG: return "png";
+    case PNM: return "pnm";
+    case BLOB: return "blob";
+    default: return "archive";
+    }
+}
+
+unsigned long imagewriter::writeImage(const unsigned char* pixels, unsigned int width, unsigned int height,
+                                      unsigned int channels, unsigned int number, encodebuffer& buf)
+{
+    if(f == BLOB){
+        return appendBlob(pixels, width, height, channels, number);
+    }
+    //built in place so that writing a frame does not allocate
+    char path[FILENAME_MAX];
+    if(f == PNG){
+        snprintf(path, sizeof(path), "%s%u.png", base.c_str(), number);
+        return writePng(pixels, width, height, channels, path, buf);
+    }
+    snprintf(path, sizeof(path), "%s%u%s", base.c_str(), number, channels == 1 ? ".pgm" : ".ppm");
+    return writePnm(pixels, width, height, channels, path, buf);
+}
+
+/**
+ * @brief imagewriter::writePng grey or RGB, the alpha of the overlays is dropped. Every row is stored unfiltered,
+ * which compresses camera frames almost as well as the adaptive filters at a fraction of the time.
+ */
+unsigned long imagewriter::writePng(const unsigned char* pixels, unsigned int width, unsigned int height,
+                                    unsigned int channels, const char* path, encodebuffer& buf)
+{
+    unsigned int outChannels = channels == 1 ? 1 : 3;
+    size_t rowBytes = 1 + (size_t)width * outChannels;
+    buf.rows.resize(rowBytes * height);
+    for(unsigned int r = 0; r < height; r++){
+        unsigned char* row = &buf.rows[r * rowBytes];
+        const unsigned char* src = pixels + (size_t)r * width * channels;
+        row[0] = 0;
+        if(channels == 1){
+            memcpy(row + 1, src, width);
+        }
+        else{
+            for(unsigned int c = 0; c < width; c++){
+                row[1 + 3 * c] = src[4 * c];
+                row[2 + 3 * c] = src[4 * c + 1];
+                row[3 + 3 * c] = src[4 * c + 2];
+            }
+        }
+    }
+    uLongf packedBytes = compressBound(buf.rows.size());
+    buf.packed.resize(packedBytes);
+    if(compress2(&buf.packed[0], &packedBytes, &buf.rows[0], buf.rows.size(), pngLevel) != Z_OK){
+        throw std::runtime_error(std::string("cannot compress ") + path);
+    }
+    static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    unsigned char header[13];
+    putBigEndian(header, width);
+    putBigEndian(header + 4, height);
+    header[8] = 8; //bits per sample
+    header[9] = channels == 1 ? 0 : 2; //grey or RGB
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    FILE* out = fopen(path, "wb");
+    if(out == NULL){
+        throw std::runtime_error(std::string("cannot create ") + path);
+    }
+    bool written = fwrite(signature, 1, 8, out) == 8 && writeChunk(out, "IHDR", header, 13)
+            && writeChunk(out, "IDAT", &buf.packed[0], (unsigned int)packedBytes) && writeChunk(out, "IEND", NULL, 0);
+    if(fclose(out) != 0 || !written){
+        throw std::runtime_error(std::string("cannot write ") + path);
+    }
+    return 8 + 25 + 12 + packedBytes + 12;
+}
+
+unsigned long imagewriter::writePnm(const unsigned char* pixels, unsigned int width, unsigned int height,
+                                    unsigned int channels, const char* path, encodebuffer& buf)
+{
+    const unsigned char* data = pixels;
+    size_t dataBytes = (size_t)width * height * (channels == 1 ? 1 : 3);
+    if(channels != 1){
+        buf.rows.resize(dataBytes);
+        for(size_t p = 0; p < (size_t)width * height; p++){
+            buf.rows[3 * p] = pixels[4 * p];
+            buf.rows[3 * p + 1] = pixels[4 * p + 1];
+            buf.rows[3 * p + 2] = pixels[4 * p + 2];
+        }
+        data = &buf.rows[0];
+    }
+    char header[64];
+    int headerBytes = snprintf(header, sizeof(header), "%s\n%u %u\n255\n", channels == 1 ? "P5" : "P6", width, height);
+    FILE* out = fopen(path, "wb");
+    if(out == NULL){
+        throw std::runtime_error(std::string("cannot create ") + path);
+    }
+    bool written = fwrite(header, 1, headerBytes, out) == (size_t)headerBytes && fwrite(data, 1, dataBytes, out) == dataBytes;
+    if(fclose(out) != 0 || !written){
+        throw std::runtime_error(std::string("cannot write ") + path);
+    }
+    return headerBytes + dataBytes;
+}
+
+/**
+ * @brief imagewriter::appendBlob records are appended whole under the lock, so the blob holds complete images in the
+ * order they were written, which is not always the frame order when several threads write
+ */
+unsigned long imagewriter::appendBlob(const unsigned char* pixels, unsigned int width, unsigned int height,
+                                      unsigned int channels, unsigned int number)
+{
+    blobrecord record;
+    memcpy(record.magic, "VCIM", 4);
+    record.number = number;
+    record.width = width;
+    record.height = height;
+    record.channels = channels;
+    size_t dataBytes = (size_t)width * height * channels;
+    std::lock_guard<std::mutex> lk(blobLock);
+    if(blob == NULL){
+        throw std::runtime_error("blob " + base + " is not open");
+    }
+    if(fwrite(&record, sizeof(record), 1, blob) != 1 || fwrite(pixels, 1, dataBytes, blob) != dataBytes){
+        throw std::runtime_error("cannot append to " + base + ".blob");
+    }
+    return sizeof(record) + dataBytes;
+}
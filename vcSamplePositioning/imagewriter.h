@@ -0,0 +1,123 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <visp/vpImage.h>
+#include <visp/vpRGBa.h>
+#include "framearchive.h"
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Writes the images of one output stream, e.g. the raw frames of one camera, as numbered files
+ * or appended to a single file.
+ *
+ * Any number of threads can write to the same stream at once, each with its own encodebuffer so that
+ * encoding does not allocate once the buffers have grown to the image size. Formats:
+ * - PNG: base<N>.png, zlib compression level 0 (none, fastest) to 9 (smallest), no row filtering.
+ * - PNM: base<N>.pgm for grey frames and base<N>.ppm for overlays, uncompressed.
+ * - BLOB: every image appended to base.blob as a blobrecord followed by the pixels, grey or RGBA.
+ * - ARCHIVE: base.vca, a framearchive holding the capture time, drive positions, camera parameters and
+ *   pose of every frame, created with the size and camera parameters of the first one.
+ *
+ * With the file formats the same data goes to base_frames.csv, a line per image in the order they
+ * were written.
+ */
+class imagewriter
+{
+public:
+  enum format {PNG, PNM, BLOB, ARCHIVE};
+  /*!
+  * \brief Header of an image in a blob file, in the byte order of the writing machine.
+  */
+  struct blobrecord
+  {
+    char magic[4]; //"VCIM"
+    unsigned int number;
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels; //1 grey, 4 RGBA
+  };
+  /*!
+  * \brief Scratch buffers of one writing thread.
+  */
+  struct encodebuffer
+  {
+    std::vector<unsigned char> rows;
+    std::vector<unsigned char> packed;
+  };
+  imagewriter();
+  /*!
+  * \brief Destructor, closes the blob file.
+  */
+  ~imagewriter();
+  /*!
+  * \brief Start a stream, closing the previous one. Throws std::runtime_error if the blob or frames file
+  * cannot be created, the archive is created by the first write.
+  * \param[in] base path and file name prefix of the images.
+  * \param[in] f format of the files.
+  * \param[in] pngLevel zlib level of the PNG files, 0 to 9.
+  */
+  void open(const std::string& base, format f, int pngLevel);
+  void close();
+  /*!
+  * \brief Write one image, throws std::runtime_error if it could not be written.
+  * \param[in] I the image.
+  * \param[in] info saved frame number, in the file name or the record, and what archives store with the frame.
+  * \param[in,out] buf scratch buffers of the calling thread.
+  * \return the number of bytes written.
+  */
+  unsigned long write(const vpImage<unsigned char>& I, const framearchive::frameinfo& info, encodebuffer& buf);
+  unsigned long write(const vpImage<vpRGBa>& I, const framearchive::frameinfo& info, encodebuffer& buf);
+  /*!
+  * \brief Columns of the frames file, the pose as the 12 values of [R t] row by row.
+  */
+  static const char* framesHeader();
+  /*!
+  * \brief Format from its name, png, pnm, blob or archive.
+  * \return false if the name is not known.
+  */
+  static bool parseFormat(const std::string& name, format& f);
+  static const char* formatName(format f);
+
+private:
+  unsigned long writeImage(const unsigned char* pixels, unsigned int width, unsigned int height,
+                           unsigned int channels, unsigned int number, encodebuffer& buf);
+  void createArchive(unsigned int width, unsigned int height, unsigned int channels,
+                     const vpCameraParameters& cam);
+  void logFrame(const framearchive::frameinfo& info, unsigned int width, unsigned int height);
+  unsigned long writePng(const unsigned char* pixels, unsigned int width, unsigned int height,
+                         unsigned int channels, const char* path, encodebuffer& buf);
+  unsigned long writePnm(const unsigned char* pixels, unsigned int width, unsigned int height,
+                         unsigned int channels, const char* path, encodebuffer& buf);
+  unsigned long appendBlob(const unsigned char* pixels, unsigned int width, unsigned int height,
+                           unsigned int channels, unsigned int number);
+  std::string base;
+  format f;
+  int pngLevel;
+  FILE* blob;
+  FILE* frames;
+  std::mutex blobLock;
+  framearchive archive;
+  std::mutex archiveLock;
+};
+
+#endif // IMAGEWRITER_H
@@ -0,0 +1,164 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "latencylog.h"
+#include <fstream>
+#include <iostream>
+
+latencyhistogram::latencyhistogram(std::string name) :
+    name(name)
+{
+    reset();
+}
+
+void latencyhistogram::reset()
+{
+    for(unsigned int b = 0; b < NB_BUCKETS; b++){
+        buckets[b].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sumUs.store(0, std::memory_order_relaxed);
+    maxUs.store(0, std::memory_order_relaxed);
+}
+
+unsigned int latencyhistogram::bucketOf(unsigned long long us)
+{
+    if(us < 64){
+        return (unsigned int)us;
+    }
+    unsigned int e = 63 - __builtin_clzll(us);
+    if(e > 36){
+        return NB_BUCKETS - 1;
+    }
+    return 64 + (e - 6) * 32 + (unsigned int)((us >> (e - 5)) & 31);
+}
+
+double latencyhistogram::bucketUpperUs(unsigned int bucket)
+{
+    if(bucket < 64){
+        return bucket;
+    }
+    unsigned int e = 6 + (bucket - 64) / 32, sub = (bucket - 64) % 32;
+    return (double)(((32ULL + sub + 1) << (e - 5)) - 1);
+}
+
+void latencyhistogram::record(double us)
+{
+    unsigned long long v = us > 0 ? (unsigned long long)(us + 0.5) : 0;
+    buckets[bucketOf(v)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumUs.fetch_add(v, std::memory_order_relaxed);
+    unsigned long long m = maxUs.load(std::memory_order_relaxed);
+    while(v > m && !maxUs.compare_exchange_weak(m, v, std::memory_order_relaxed)){
+    }
+}
+
+double latencyhistogram::getMeanUs() const
+{
+    unsigned long long n = getCount();
+    return n > 0 ? (double)sumUs.load(std::memory_order_relaxed) / n : 0;
+}
+
+double latencyhistogram::getPercentileUs(double p) const
+{
+    //the buckets are read one by one while they may still be counting, their total is the count used
+    unsigned long long counts[NB_BUCKETS];
+    unsigned long long total = 0;
+    for(unsigned int b = 0; b < NB_BUCKETS; b++){
+        counts[b] = getBucketCount(b);
+        total += counts[b];
+    }
+    if(total == 0){
+        return 0;
+    }
+    unsigned long long target = (unsigned long long)(p * total + 0.5);
+    if(target < 1){
+        target = 1;
+    }
+    unsigned long long seen = 0;
+    for(unsigned int b = 0; b < NB_BUCKETS; b++){
+        seen += counts[b];
+        if(seen >= target){
+            double upper = bucketUpperUs(b);
+            return upper < getMaxUs() ? upper : getMaxUs();
+        }
+    }
+    return getMaxUs();
+}
+
+latencylog::latencylog()
+{
+}
+
+latencyhistogram& latencylog::add(const std::string& name)
+{
+    std::lock_guard<std::mutex> lk(lock);
+    histograms.emplace_back(name);
+    return histograms.back();
+}
+
+void latencylog::reset()
+{
+    std::lock_guard<std::mutex> lk(lock);
+    for(size_t h = 0; h < histograms.size(); h++){
+        histograms[h].reset();
+    }
+}
+
+bool latencylog::write(const std::string& path)
+{
+    std::lock_guard<std::mutex> lk(lock);
+    std::string bucketPath = path;
+    size_t dot = bucketPath.find_last_of('.');
+    if(dot == std::string::npos || bucketPath.find('/', dot) != std::string::npos){
+        dot = bucketPath.size();
+    }
+    bucketPath.insert(dot, "_buckets");
+    std::ofstream out(path.c_str());
+    std::ofstream bucketOut(bucketPath.c_str());
+    if(!out || !bucketOut){
+        return false;
+    }
+    out<<"name,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms"<<std::endl;
+    bucketOut<<"name,upper_ms,count"<<std::endl;
+    for(size_t h = 0; h < histograms.size(); h++){
+        const latencyhistogram& l = histograms[h];
+        out<<l.getName()<<","<<l.getCount()<<","<<l.getMeanUs() / 1000<<","<<l.getPercentileUs(0.5) / 1000<<","
+           <<l.getPercentileUs(0.95) / 1000<<","<<l.getPercentileUs(0.99) / 1000<<","<<l.getMaxUs() / 1000<<std::endl;
+        for(unsigned int b = 0; b < latencyhistogram::NB_BUCKETS; b++){
+            unsigned long long n = l.getBucketCount(b);
+            if(n > 0){
+                bucketOut<<l.getName()<<","<<latencyhistogram::bucketUpperUs(b) / 1000<<","<<n<<std::endl;
+            }
+        }
+    }
+    return out.good() && bucketOut.good();
+}
+
+void latencylog::print()
+{
+    std::lock_guard<std::mutex> lk(lock);
+    for(size_t h = 0; h < histograms.size(); h++){
+        const latencyhistogram& l = histograms[h];
+        if(l.getCount() == 0){
+            continue;
+        }
+        std::cout<<l.getName()<<" latency (ms) - p50 "<<l.getPercentileUs(0.5) / 1000<<" p95 "
+                 <<l.getPercentileUs(0.95) / 1000<<" p99 "<<l.getPercentileUs(0.99) / 1000<<" max "
+                 <<l.getMaxUs() / 1000<<" \t("<<l.getCount()<<")"<<std::endl;
+    }
+}
@@ -0,0 +1,117 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LATENCYLOG_H
+#define LATENCYLOG_H
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+
+/*!
+ * \brief Latency histogram of one kind of operation, recorded from any thread without locking.
+ *
+ * Durations are counted in microseconds in log-linear buckets: exact below 64 us, then 32 buckets per
+ * power of two, so percentiles are within 3% from 1 us to hours. Recording is a few relaxed atomic
+ * increments, cheap enough to leave on in every run.
+ */
+class latencyhistogram
+{
+public:
+  explicit latencyhistogram(std::string name);
+  /*!
+  * \brief Record one duration.
+  * \param[in] us duration in microseconds.
+  */
+  void record(double us);
+  /*!
+  * \brief Monotonic clock in microseconds, for the start of a span.
+  */
+  static double now()
+  {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  void reset();
+  unsigned long long getCount() const {return count.load(std::memory_order_relaxed);}
+  double getMeanUs() const;
+  double getMaxUs() const {return (double)maxUs.load(std::memory_order_relaxed);}
+  /*!
+  * \brief Duration below which a fraction p of the recorded ones fall, the upper edge of its bucket.
+  * \param[in] p 0 to 1.
+  */
+  double getPercentileUs(double p) const;
+  const std::string& getName() const {return name;}
+  enum {NB_BUCKETS = 64 + 31 * 32};
+  unsigned long long getBucketCount(unsigned int bucket) const {return buckets[bucket].load(std::memory_order_relaxed);}
+  /*!
+  * \brief Largest duration counted in a bucket, us.
+  */
+  static double bucketUpperUs(unsigned int bucket);
+
+private:
+  static unsigned int bucketOf(unsigned long long us);
+  std::string name;
+  std::atomic<unsigned long long> buckets[NB_BUCKETS];
+  std::atomic<unsigned long long> count, sumUs, maxUs;
+};
+
+/*!
+ * \brief Times the scope it lives in into a histogram.
+ */
+class latencyspan
+{
+public:
+  explicit latencyspan(latencyhistogram& h) : h(h), start(latencyhistogram::now()){}
+  ~latencyspan(){h.record(latencyhistogram::now() - start);}
+
+private:
+  latencyhistogram& h;
+  double start;
+};
+
+/*!
+ * \brief The latency histograms of a run, added before the threads recording them start and written
+ * out at the end of the run or whenever asked, while they are still being recorded.
+ */
+class latencylog
+{
+public:
+  latencylog();
+  /*!
+  * \brief New histogram, its address does not change.
+  */
+  latencyhistogram& add(const std::string& name);
+  void reset();
+  /*!
+  * \brief Write count, mean, p50, p95, p99 and max of every histogram to path, and the non empty buckets
+  * to path with _buckets before the extension.
+  * \return false if a file cannot be written.
+  */
+  bool write(const std::string& path);
+  /*!
+  * \brief Print the percentiles of every histogram.
+  */
+  void print();
+
+private:
+  std::deque<latencyhistogram> histograms;
+  std::mutex lock;
+};
+
+#endif // LATENCYLOG_H
@@ -17,16 +17,126 @@
 
 #include "vcuserinputwindow.h"
 #include <QApplication>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
 
 #include "applicationcontroller.h"
 
+//kill -USR1 <pid> writes the latency report of the running tracking loop
+static void onLatencyReportSignal(int)
+{
+    applicationcontroller::requestLatencyReport();
+}
+
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
     bool stereo = true;
+    //--simulate renders the sample holder model instead of using the cameras
+    //--replay <run directory> plays back a recorded run at its cadence, --replay-fast as fast as possible
+    //--binning <1, 2 or 4> reduces the camera images for faster coarse positioning
+    //--sensor-size <WxH> for cameras whose sensors are not the 1600x1200 the camera parameters were calibrated at
+    //--aoi [margin] reads only the part of the sensors around the tracked sample holder, margin in pixels
+    //--max-skew <ms> is the largest capture time difference between the frames of a stereo pair
+    //--headless runs without the display windows, --display-rate <Hz> sets how often they are redrawn
+    //--image-format <archive, png, pnm or blob>, --png-level <0-9> and --writers <n> set how the saved frames are written
+    //--warmup-threshold <grey levels> and --warmup-timeout <s> set when tracking starts after the drives have centred
+    //--stream-status has the drive controllers push their status instead of being asked for it every poll
+    //--trace writes a timeline of the run to trace.json in the run folder for chrome://tracing or Perfetto
+    applicationcontroller::cameraSource source = applicationcontroller::UEYE_CAMERAS;
+    std::string replayPath;
+    int binning = 1;
+    int sensorWidth = 0;
+    int sensorHeight = 0;
+    bool trackedAOI = false;
+    int aoiMargin = 0;
+    double maxSkew = 20;
+    bool headless = false;
+    double displayRate = 15;
+    imagewriter::format imageFormat = imagewriter::ARCHIVE;
+    int pngLevel = 1;
+    int writers = 2;
+    double warmupThreshold = 2.0;
+    double warmupTimeout = 15;
+    bool tracing = false;
+    bool streamStatus = false;
+    for(int i = 1; i < argc; i++){
+        std::string arg(argv[i]);
+        if(arg == "--simulate"){
+            source = applicationcontroller::SIMULATED_CAMERAS;
+        }
+        else if((arg == "--replay" || arg == "--replay-fast") && i + 1 < argc){
+            source = arg == "--replay" ? applicationcontroller::REPLAY_REALTIME : applicationcontroller::REPLAY_FAST;
+            replayPath = argv[++i];
+        }
+        else if(arg == "--binning" && i + 1 < argc){
+            binning = atoi(argv[++i]);
+        }
+        else if(arg == "--sensor-size" && i + 1 < argc){
+            if(sscanf(argv[++i], "%dx%d", &sensorWidth, &sensorHeight) != 2){
+                std::cout<<"sensor size "<<argv[i]<<" is not WxH"<<std::endl;
+                sensorWidth = 0;
+            }
+        }
+        else if(arg == "--aoi"){
+            trackedAOI = true;
+            if(i + 1 < argc && argv[i + 1][0] != '-'){
+                aoiMargin = atoi(argv[++i]);
+            }
+        }
+        else if(arg == "--max-skew" && i + 1 < argc){
+            maxSkew = atof(argv[++i]);
+        }
+        else if(arg == "--headless"){
+            headless = true;
+        }
+        else if(arg == "--display-rate" && i + 1 < argc){
+            displayRate = atof(argv[++i]);
+        }
+        else if(arg == "--image-format" && i + 1 < argc){
+            if(!imagewriter::parseFormat(argv[++i], imageFormat)){
+                std::cout<<"unknown image format "<<argv[i]<<", saving archives"<<std::endl;
+            }
+        }
+        else if(arg == "--png-level" && i + 1 < argc){
+            pngLevel = atoi(argv[++i]);
+        }
+        else if(arg == "--writers" && i + 1 < argc){
+            writers = atoi(argv[++i]);
+        }
+        else if(arg == "--warmup-threshold" && i + 1 < argc){
+            warmupThreshold = atof(argv[++i]);
+        }
+        else if(arg == "--warmup-timeout" && i + 1 < argc){
+            warmupTimeout = atof(argv[++i]);
+        }
+        else if(arg == "--trace"){
+            tracing = true;
+        }
+        else if(arg == "--stream-status"){
+            streamStatus = true;
+        }
+    }
     VCUserInputWindow vcinput;
     vcinput.show();
-    applicationcontroller ac(stereo);
+    applicationcontroller ac(stereo, source, replayPath, headless);
+    if(sensorWidth > 0){
+        ac.setSensorSize(sensorWidth, sensorHeight);
+    }
+    if(binning != 1){
+        ac.setBinning(binning);
+    }
+    if(trackedAOI){
+        ac.setTrackedAOI(true, aoiMargin);
+    }
+    ac.setDisplayRate(displayRate);
+    ac.setMaxSkew(maxSkew);
+    ac.setImageOutput(imageFormat, pngLevel, writers < 1 ? 1 : writers);
+    ac.setWarmup(warmupThreshold, warmupTimeout);
+    ac.setTracing(tracing);
+    ac.setStatusStreaming(streamStatus);
+    signal(SIGUSR1, onLatencyReportSignal);
     QObject::connect(&ac,SIGNAL(posesChanged(std::vector<double>,std::vector<double>)),&vcinput,SLOT(updateSamplePosition(std::vector<double>,std::vector<double>)));
     QObject::connect(&ac,SIGNAL(driveStatusUpdated(std::vector<double>)), &vcinput,SLOT(updateDrivePositions(std::vector<double>)));
     QObject::connect(&ac,SIGNAL(moveCompleted()), &vcinput,SLOT(enablePosControls()));
@@ -0,0 +1,344 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "modelrenderer.h"
+#include <visp/vpImageConvert.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+modelrenderer::modelrenderer() :
+    background(40)
+{
+}
+
+/**
+ * @brief modelrenderer::loadModel reads the point, line and face sections of a V1 .cao file. Faces given by lines
+ * are turned into point loops by chaining the lines, the rest of the file is not needed for rendering.
+ */
+bool modelrenderer::loadModel(const std::string& filename)
+{
+    std::ifstream in(filename.c_str());
+    if(!in.is_open()){
+        std::cout<<"cannot open model "<<filename<<std::endl;
+        return false;
+    }
+    // strip comments, the remaining tokens are read in order
+    std::stringstream tokens;
+    std::string line;
+    while(std::getline(in, line)){
+        size_t comment = line.find('#');
+        if(comment != std::string::npos){
+            line.erase(comment);
+        }
+        tokens<<line<<"\n";
+    }
+    std::string version;
+    tokens>>version;
+    if(version != "V1"){
+        std::cout<<"unsupported model version "<<version<<" in "<<filename<<std::endl;
+        return false;
+    }
+    points.clear();
+    faces.clear();
+    edges.clear();
+    unsigned int n = 0;
+    tokens>>n;
+    points.resize(n);
+    for(unsigned int i = 0; i < n; i++){
+        tokens>>points[i].X>>points[i].Y>>points[i].Z;
+    }
+    tokens>>n;
+    std::vector<std::pair<unsigned int, unsigned int> > lines(n);
+    for(unsigned int i = 0; i < n; i++){
+        tokens>>lines[i].first>>lines[i].second;
+        edges.push_back(lines[i]);
+    }
+    tokens>>n;
+    for(unsigned int i = 0; i < n; i++){
+        unsigned int nl = 0;
+        tokens>>nl;
+        std::vector<unsigned int> ids(nl);
+        for(unsigned int j = 0; j < nl; j++){
+            tokens>>ids[j];
+        }
+        if(nl < 3){
+            continue;
+        }
+        std::vector<unsigned int> face;
+        unsigned int current = lines[ids[0]].second;
+        face.push_back(lines[ids[0]].first);
+        std::vector<bool> used(nl, false);
+        used[0] = true;
+        for(unsigned int k = 1; k < nl; k++){
+            for(unsigned int j = 1; j < nl; j++){
+                if(used[j]){
+                    continue;
+                }
+                const std::pair<unsigned int, unsigned int>& l = lines[ids[j]];
+                if(l.first == current || l.second == current){
+                    face.push_back(current);
+                    current = l.first == current ? l.second : l.first;
+                    used[j] = true;
+                    break;
+                }
+            }
+        }
+        faces.push_back(face);
+    }
+    tokens>>n;
+    for(unsigned int i = 0; i < n; i++){
+        unsigned int np = 0;
+        tokens>>np;
+        std::vector<unsigned int> face(np);
+        for(unsigned int j = 0; j < np; j++){
+            tokens>>face[j];
+        }
+        if(np >= 3){
+            faces.push_back(face);
+        }
+        for(unsigned int j = 0; j < np; j++){
+            edges.push_back(std::make_pair(face[j], face[(j + 1) % np]));
+        }
+    }
+    if(tokens.fail()){
+        std::cout<<"cannot parse model "<<filename<<std::endl;
+        return false;
+    }
+    for(size_t i = 0; i < faces.size(); i++){
+        for(size_t j = 0; j < faces[i].size(); j++){
+            if(faces[i][j] >= points.size()){
+                std::cout<<"face "<<i<<" uses an undefined point in "<<filename<<std::endl;
+                return false;
+            }
+        }
+    }
+    // an edge shared by two faces is drawn once
+    for(size_t i = 0; i < edges.size(); i++){
+        if(edges[i].first > edges[i].second){
+            std::swap(edges[i].first, edges[i].second);
+        }
+        if(edges[i].second >= points.size()){
+            std::cout<<"edge "<<i<<" uses an undefined point in "<<filename<<std::endl;
+            return false;
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    std::cout<<"model "<<filename<<": "<<points.size()<<" points, "<<faces.size()<<" faces"<<std::endl;
+    return true;
+}
+
+void modelrenderer::toCamera(const vpHomogeneousMatrix& cMo)
+{
+    cpoints.resize(points.size());
+    for(size_t i = 0; i < points.size(); i++){
+        const point3d& p = points[i];
+        cpoints[i].X = cMo[0][0] * p.X + cMo[0][1] * p.Y + cMo[0][2] * p.Z + cMo[0][3];
+        cpoints[i].Y = cMo[1][0] * p.X + cMo[1][1] * p.Y + cMo[1][2] * p.Z + cMo[1][3];
+        cpoints[i].Z = cMo[2][0] * p.X + cMo[2][1] * p.Y + cMo[2][2] * p.Z + cMo[2][3];
+    }
+}
+
+/**
+ * @brief modelrenderer::render faces are shaded by the angle between their normal and the line of sight, the
+ * absolute value is used so the winding order of the model does not matter. Faces are drawn from the furthest
+ * to the nearest, which is correct for the sample holder as none of its faces interpenetrate.
+ */
+void modelrenderer::render(vpImage<unsigned char>& I, const vpHomogeneousMatrix& cMo, const vpCameraParameters& cam)
+{
+    memset(I.bitmap, background, I.getSize());
+    toCamera(cMo);
+    const double px = cam.get_px(), py = cam.get_py(), u0 = cam.get_u0(), v0 = cam.get_v0();
+    projected.resize(faces.size());
+    order.clear();
+    for(size_t f = 0; f < faces.size(); f++){
+        const std::vector<unsigned int>& face = faces[f];
+        projectedface& pf = projected[f];
+        pf.u.resize(face.size());
+        pf.v.resize(face.size());
+        pf.depth = 0;
+        bool behind = false;
+        for(size_t j = 0; j < face.size(); j++){
+            const point3d& p = cpoints[face[j]];
+            if(p.Z < 1e-3){
+                behind = true;
+                break;
+            }
+            pf.u[j] = u0 + px * p.X / p.Z;
+            pf.v[j] = v0 + py * p.Y / p.Z;
+            pf.depth += p.Z;
+        }
+        if(behind){
+            continue;
+        }
+        pf.depth /= face.size();
+        const point3d& a = cpoints[face[0]];
+        const point3d& b = cpoints[face[1]];
+        const point3d& c = cpoints[face[2]];
+        double nx = (b.Y - a.Y) * (c.Z - a.Z) - (b.Z - a.Z) * (c.Y - a.Y);
+        double ny = (b.Z - a.Z) * (c.X - a.X) - (b.X - a.X) * (c.Z - a.Z);
+        double nz = (b.X - a.X) * (c.Y - a.Y) - (b.Y - a.Y) * (c.X - a.X);
+        double nn = sqrt(nx * nx + ny * ny + nz * nz);
+        double an = sqrt(a.X * a.X + a.Y * a.Y + a.Z * a.Z);
+        double lambert = nn > 0 && an > 0 ? fabs(nx * a.X + ny * a.Y + nz * a.Z) / (nn * an) : 0;
+        pf.shade = (unsigned char)(70 + 170 * lambert);
+        order.push_back((unsigned int)f);
+    }
+    std::sort(order.begin(), order.end(), [this](unsigned int l, unsigned int r){
+        return projected[l].depth > projected[r].depth;
+    });
+    for(size_t k = 0; k < order.size(); k++){
+        const projectedface& pf = projected[order[k]];
+        fillPolygon(I, pf.u, pf.v, pf.shade);
+    }
+}
+
+/**
+ * @brief modelrenderer::fillPolygon even-odd scanline fill sampled at the pixel centres, so concave faces and
+ * faces crossing the image border are handled.
+ */
+void modelrenderer::fillPolygon(vpImage<unsigned char>& I, const std::vector<double>& u, const std::vector<double>& v,
+                                unsigned char value)
+{
+    const int height = (int)I.getHeight();
+    const int width = (int)I.getWidth();
+    double vmin = v[0], vmax = v[0];
+    for(size_t j = 1; j < v.size(); j++){
+        vmin = std::min(vmin, v[j]);
+        vmax = std::max(vmax, v[j]);
+    }
+    int rowStart = std::max(0, (int)ceil(vmin - 0.5));
+    int rowEnd = std::min(height - 1, (int)floor(vmax - 0.5));
+    const size_t n = u.size();
+    for(int row = rowStart; row <= rowEnd; row++){
+        double y = row + 0.5;
+        crossings.clear();
+        for(size_t j = 0, k = n - 1; j < n; k = j++){
+            if((v[j] <= y) != (v[k] <= y)){
+                crossings.push_back(u[j] + (y - v[j]) * (u[k] - u[j]) / (v[k] - v[j]));
+            }
+        }
+        std::sort(crossings.begin(), crossings.end());
+        unsigned char* line = I[row];
+        for(size_t j = 0; j + 1 < crossings.size(); j += 2){
+            int colStart = std::max(0, (int)ceil(crossings[j] - 0.5));
+            int colEnd = std::min(width - 1, (int)ceil(crossings[j + 1] - 0.5) - 1);
+            if(colEnd >= colStart){
+                memset(line + colStart, value, colEnd - colStart + 1);
+            }
+        }
+    }
+}
+
+void modelrenderer::drawEdges(vpImage<vpRGBa>& I, const vpHomogeneousMatrix& cMo, const vpCameraParameters& cam,
+                              const vpRGBa& colour, unsigned int thickness)
+{
+    toCamera(cMo);
+    const double px = cam.get_px(), py = cam.get_py(), u0 = cam.get_u0(), v0 = cam.get_v0();
+    for(size_t i = 0; i < edges.size(); i++){
+        const point3d& a = cpoints[edges[i].first];
+        const point3d& b = cpoints[edges[i].second];
+        if(a.Z < 1e-3 || b.Z < 1e-3){
+            continue;
+        }
+        drawLine(I, u0 + px * a.X / a.Z, v0 + py * a.Y / a.Z, u0 + px * b.X / b.Z, v0 + py * b.Y / b.Z, colour,
+                 thickness);
+    }
+}
+
+void modelrenderer::drawOverlay(const vpImage<unsigned char>& frame, const vpHomogeneousMatrix& cMo,
+                                const vpCameraParameters& cam, const vpRGBa& colour, unsigned int thickness,
+                                vpImage<vpRGBa>& overlay)
+{
+    vpImageConvert::convert(frame, overlay);
+    drawEdges(overlay, cMo, cam, colour, thickness);
+    drawFrame(overlay, cMo, cam, 0.05, 2);
+}
+
+void modelrenderer::drawFrame(vpImage<vpRGBa>& I, const vpHomogeneousMatrix& cMo, const vpCameraParameters& cam,
+                              double size, unsigned int thickness)
+{
+    const double px = cam.get_px(), py = cam.get_py(), u0 = cam.get_u0(), v0 = cam.get_v0();
+    // origin then the end of each axis, in the camera frame
+    double u[4], v[4];
+    for(int k = 0; k < 4; k++){
+        double X = cMo[0][3], Y = cMo[1][3], Z = cMo[2][3];
+        if(k > 0){
+            X += size * cMo[0][k - 1];
+            Y += size * cMo[1][k - 1];
+            Z += size * cMo[2][k - 1];
+        }
+        if(Z < 1e-3){
+            return;
+        }
+        u[k] = u0 + px * X / Z;
+        v[k] = v0 + py * Y / Z;
+    }
+    drawLine(I, u[0], v[0], u[1], v[1], vpRGBa(255, 0, 0), thickness);
+    drawLine(I, u[0], v[0], u[2], v[2], vpRGBa(0, 255, 0), thickness);
+    drawLine(I, u[0], v[0], u[3], v[3], vpRGBa(0, 0, 255), thickness);
+}
+
+/**
+ * @brief modelrenderer::drawLine the segment is clipped to the image first (Liang-Barsky) so that edges projected far
+ * outside of it cost nothing, then stepped along its longer axis one pixel at a time.
+ */
+void modelrenderer::drawLine(vpImage<vpRGBa>& I, double u1, double v1, double u2, double v2, const vpRGBa& colour,
+                             unsigned int thickness)
+{
+    const double width = I.getWidth(), height = I.getHeight();
+    double du = u2 - u1, dv = v2 - v1;
+    double t0 = 0, t1 = 1;
+    const double p[4] = {-du, du, -dv, dv};
+    const double q[4] = {u1, width - 1 - u1, v1, height - 1 - v1};
+    for(int k = 0; k < 4; k++){
+        if(p[k] == 0){
+            if(q[k] < 0){
+                return;
+            }
+            continue;
+        }
+        double t = q[k] / p[k];
+        if(p[k] < 0){
+            t0 = std::max(t0, t);
+        }
+        else{
+            t1 = std::min(t1, t);
+        }
+        if(t0 > t1){
+            return;
+        }
+    }
+    double ua = u1 + t0 * du, va = v1 + t0 * dv;
+    double ub = u1 + t1 * du, vb = v1 + t1 * dv;
+    int steps = (int)ceil(std::max(fabs(ub - ua), fabs(vb - va)));
+    const int half = (int)thickness / 2;
+    const int maxCol = (int)I.getWidth() - 1, maxRow = (int)I.getHeight() - 1;
+    for(int s = 0; s <= steps; s++){
+        double t = steps > 0 ? (double)s / steps : 0;
+        int col = (int)floor(ua + t * (ub - ua) + 0.5);
+        int row = (int)floor(va + t * (vb - va) + 0.5);
+        for(int r = std::max(0, row - half); r <= std::min(maxRow, row - half + (int)thickness - 1); r++){
+            for(int c = std::max(0, col - half); c <= std::min(maxCol, col - half + (int)thickness - 1); c++){
+                I[r][c] = colour;
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MODELRENDERER_H
+#define MODELRENDERER_H
+
+#include <string>
+#include <vector>
+#include <visp/vpImage.h>
+#include <visp/vpRGBa.h>
+#include <visp/vpHomogeneousMatrix.h>
+#include <visp/vpCameraParameters.h>
+
+/*!
+ * \brief Software renderer for the polygonal part of a .cao model (points, lines and faces, cylinders and
+ * circles are ignored). Faces are drawn flat shaded with the painter's algorithm, which is enough
+ * for the sample holder model to give the tracker realistic edges without any hardware. The model edges
+ * and frame axes can also be drawn over colour images, for tracking overlays without a display.
+ */
+class modelrenderer
+{
+public:
+  modelrenderer();
+  /*!
+  * \brief Load the model.
+  * \param[in] filename .cao file, version 1.
+  * \return false if the file cannot be read.
+  */
+  bool loadModel(const std::string& filename);
+  /*!
+  * \brief Render the model into a grey level image of the given size.
+  * \param[out] I the image, rendered at its current size.
+  * \param[in] cMo pose of the model in the camera frame.
+  * \param[in] cam camera parameters, distortion is not used.
+  */
+  void render(vpImage<unsigned char>& I, const vpHomogeneousMatrix& cMo, const vpCameraParameters& cam);
+  /*!
+  * \brief Draw every edge of the model over an image, hidden edges included.
+  * \param[in,out] I the image.
+  * \param[in] cMo pose of the model in the camera frame.
+  * \param[in] cam camera parameters, distortion is not used.
+  * \param[in] colour,thickness of the edges.
+  */
+  void drawEdges(vpImage<vpRGBa>& I, const vpHomogeneousMatrix& cMo, const vpCameraParameters& cam,
+                 const vpRGBa& colour, unsigned int thickness = 1);
+  /*!
+  * \brief Tracking overlay of a grey frame, the model edges and the object frame axes (5 cm).
+  * \param[in] frame the tracked frame.
+  * \param[out] overlay colour copy of the frame with the overlay drawn.
+  */
+  void drawOverlay(const vpImage<unsigned char>& frame, const vpHomogeneousMatrix& cMo, const vpCameraParameters& cam,
+                   const vpRGBa& colour, unsigned int thickness, vpImage<vpRGBa>& overlay);
+  /*!
+  * \brief Draw the axes of a frame, x in red, y in green and z in blue as vpDisplay::displayFrame does.
+  * \param[in] size length of the axes in m.
+  */
+  static void drawFrame(vpImage<vpRGBa>& I, const vpHomogeneousMatrix& cMo, const vpCameraParameters& cam,
+                        double size, unsigned int thickness = 1);
+  /*!
+  * \brief Draw a line clipped to the image.
+  */
+  static void drawLine(vpImage<vpRGBa>& I, double u1, double v1, double u2, double v2, const vpRGBa& colour,
+                       unsigned int thickness = 1);
+  void setBackground(unsigned char grey){background = grey;}
+  unsigned int getNbFaces() const {return (unsigned int)faces.size();}
+
+private:
+  struct point3d
+  {
+    double X,Y,Z;
+  };
+  struct projectedface
+  {
+    std::vector<double> u,v;
+    double depth;
+    unsigned char shade;
+  };
+  void fillPolygon(vpImage<unsigned char>& I, const std::vector<double>& u, const std::vector<double>& v,
+                   unsigned char value);
+  void toCamera(const vpHomogeneousMatrix& cMo);
+  std::vector<point3d> points;
+  std::vector<std::vector<unsigned int> > faces;
+  std::vector<std::pair<unsigned int, unsigned int> > edges;
+  //per render scratch buffers, kept to avoid allocating every frame
+  std::vector<point3d> cpoints;
+  std::vector<projectedface> projected;
+  std::vector<unsigned int> order;
+  std::vector<double> crossings;
+  unsigned char background;
+};
+
+#endif // MODELRENDERER_H
@@ -0,0 +1,130 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MPMCRING_H
+#define MPMCRING_H
+
+#include <atomic>
+
+/*!
+ * \brief Fixed size ring of preallocated cells that any number of threads push to and pop from without a lock.
+ *
+ * Every cell carries a sequence number telling whether it is free for the push of the current lap or filled
+ * for its pop. A thread claims a position by advancing the push or pop counter, only then touches the cell and
+ * hands it over by moving its sequence number on, so a value is never read while it is written. A cell claimed
+ * but not yet handed over makes the ring look full to a push or empty to a pop for that instant, nobody waits.
+ */
+template <class T>
+class mpmcring
+{
+public:
+  /*!
+  * \brief Constructor.
+  * \param[in] capacity number of cells, all of them can be filled at once.
+  */
+  explicit mpmcring(unsigned int capacity = 1) : cells(NULL), count(0), pushPos(0), popPos(0){reset(capacity);}
+  ~mpmcring(){delete[] cells;}
+  /*!
+  * \brief Empty the ring and give it capacity cells, only while no other thread uses it.
+  */
+  void reset(unsigned int capacity)
+  {
+    delete[] cells;
+    count = capacity < 1 ? 1 : capacity;
+    cells = new cell[count];
+    for(unsigned int i = 0; i < count; i++){
+      cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    pushPos.store(0, std::memory_order_relaxed);
+    popPos.store(0, std::memory_order_relaxed);
+  }
+  /*!
+  * \brief Add a value after the newest one.
+  * \return false if the ring is full.
+  */
+  bool push(const T& value)
+  {
+    unsigned long pos = pushPos.load(std::memory_order_relaxed);
+    while(true){
+      cell& c = cells[pos % count];
+      long diff = (long)(c.seq.load(std::memory_order_acquire) - pos);
+      if(diff == 0){
+        if(pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+          c.value = value;
+          c.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if(diff < 0){
+        return false;
+      }
+      else{
+        pos = pushPos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  /*!
+  * \brief Take the oldest value, its cell is left holding T().
+  * \return false if the ring is empty.
+  */
+  bool pop(T& value)
+  {
+    unsigned long pos = popPos.load(std::memory_order_relaxed);
+    while(true){
+      cell& c = cells[pos % count];
+      long diff = (long)(c.seq.load(std::memory_order_acquire) - (pos + 1));
+      if(diff == 0){
+        if(popPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+          value = c.value;
+          c.value = T();
+          c.seq.store(pos + count, std::memory_order_release);
+          return true;
+        }
+      }
+      else if(diff < 0){
+        return false;
+      }
+      else{
+        pos = popPos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  /*!
+  * \brief Number of values pushed and not popped, only a hint while other threads use the ring.
+  */
+  unsigned int size() const
+  {
+    unsigned long pushed = pushPos.load(std::memory_order_acquire);
+    unsigned long popped = popPos.load(std::memory_order_acquire);
+    return pushed > popped ? (unsigned int)(pushed - popped) : 0;
+  }
+  unsigned int capacity() const {return count;}
+
+private:
+  mpmcring(const mpmcring&);
+  mpmcring& operator=(const mpmcring&);
+  struct cell
+  {
+    std::atomic<unsigned long> seq;
+    T value;
+  };
+  cell* cells;
+  unsigned int count;
+  std::atomic<unsigned long> pushPos;
+  std::atomic<unsigned long> popPos;
+};
+
+#endif // MPMCRING_H
@@ -0,0 +1,188 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "overlaydisplay.h"
+#include "capturethread.h"
+#include <iostream>
+
+overlaydisplay::overlaydisplay() :
+    views("display", 1, stagequeue<view>::DROP_OLDEST), stats("display"), d2(NULL), d3(NULL),
+    renderLatency(NULL), drawLatency(NULL), trace(NULL), renderSpan(0), drawSpan(0), refreshRate(15),
+    nextDue(0), running(false)
+{
+}
+
+overlaydisplay::~overlaydisplay()
+{
+    stop();
+}
+
+bool overlaydisplay::setModel(const std::string& modelFile)
+{
+    return renderer.loadModel(modelFile);
+}
+
+void overlaydisplay::setRefreshRate(double hz)
+{
+    if(hz > 0){
+        refreshRate = hz;
+    }
+}
+
+void overlaydisplay::setLatency(latencyhistogram* render, latencyhistogram* draw)
+{
+    renderLatency = render;
+    drawLatency = draw;
+}
+
+void overlaydisplay::setTrace(tracelog* log, unsigned int render, unsigned int draw)
+{
+    trace = log;
+    renderSpan = render;
+    drawSpan = draw;
+}
+
+void overlaydisplay::start()
+{
+    if(running){
+        return;
+    }
+    views.reopen();
+    stats.reset();
+    nextDue = 0;
+    running = true;
+    worker = std::thread(&overlaydisplay::displayLoop, this);
+}
+
+void overlaydisplay::stop()
+{
+    if(!running){
+        return;
+    }
+    running = false;
+    views.close();
+    worker.join();
+}
+
+bool overlaydisplay::offer(const frameref& frame2, const frameref& frame3, const vpHomogeneousMatrix& cMo2,
+                           const vpHomogeneousMatrix& cMo3, const vpCameraParameters& cam2,
+                           const vpCameraParameters& cam3, bool stereo)
+{
+    double now = capturethread::now();
+    if(!running || now < nextDue || frame2.empty() || frame3.empty()){
+        return false;
+    }
+    // a late view does not make the next ones come sooner
+    double period = 1000.0 / refreshRate;
+    nextDue = now - nextDue < period ? nextDue + period : now + period;
+    view* v = views.beginPush();
+    if(v == NULL){
+        return false;
+    }
+    v->frame2 = frame2;
+    v->frame3 = frame3;
+    v->cMo2 = cMo2;
+    v->cMo3 = cMo3;
+    v->cam2 = cam2;
+    v->cam3 = cam3;
+    v->stereo = stereo;
+    v->frameNumber = frame2.frameNumber();
+    views.commitPush();
+    return true;
+}
+
+/**
+ * @brief overlaydisplay::displayLoop draws the views as they come, the windows are opened with the first view
+ * and reopened when the frame size changes
+ */
+void overlaydisplay::displayLoop()
+{
+    view* v;
+    if(trace != NULL){
+        trace->nameThread("display");
+    }
+    while((v = views.beginPop()) != NULL){
+        stats.begin();
+        double start = latencyhistogram::now();
+        //same colours as the tracker display
+        vpRGBa colour = v->stereo ? vpRGBa(255, 165, 0) : vpRGBa(255, 255, 0);
+        unsigned int thickness = v->stereo ? 2 : 1;
+        renderer.drawOverlay(v->frame2.image(), v->cMo2, v->cam2, colour, thickness, image2);
+        renderer.drawOverlay(v->frame3.image(), v->cMo3, v->cam3, colour, thickness, image3);
+        //back to the capture pools
+        v->frame2.release();
+        v->frame3.release();
+        unsigned long frameNumber = v->frameNumber;
+        views.endPop();
+        double rendered = latencyhistogram::now();
+        if(renderLatency != NULL){
+            renderLatency->record(rendered - start);
+        }
+        if(trace != NULL){
+            trace->record(renderSpan, start, rendered, frameNumber);
+        }
+        try{
+            if(d2 == NULL || d2->getWidth() != image2.getWidth() || d2->getHeight() != image2.getHeight()){
+                if(d2 != NULL){
+                    d2->close(image2);
+                    delete d2;
+                }
+                d2 = new vpDisplayOpenCV;
+                d2->init(image2, 0, 0, "Camera2 - sample tracking");
+            }
+            if(d3 == NULL || d3->getWidth() != image3.getWidth() || d3->getHeight() != image3.getHeight()){
+                if(d3 != NULL){
+                    d3->close(image3);
+                    delete d3;
+                }
+                d3 = new vpDisplayOpenCV;
+                d3->init(image3, 10, 10, "Camera3 - sample tracking");
+            }
+            vpDisplay::display(image2);
+            vpDisplay::display(image3);
+            vpDisplay::flush(image2);
+            vpDisplay::flush(image3);
+        }
+        catch(...){
+            std::cout<<"display - cannot draw the view"<<std::endl;
+        }
+        double drawn = latencyhistogram::now();
+        if(drawLatency != NULL){
+            drawLatency->record(drawn - rendered);
+        }
+        if(trace != NULL){
+            trace->record(drawSpan, rendered, drawn, frameNumber);
+        }
+        stats.end();
+    }
+    if(d2 != NULL){
+        d2->close(image2);
+        delete d2;
+        d2 = NULL;
+    }
+    if(d3 != NULL){
+        d3->close(image3);
+        delete d3;
+        d3 = NULL;
+    }
+}
+
+void overlaydisplay::printStats()
+{
+    std::cout<<"display refresh rate (Hz) \t"<<refreshRate<<std::endl;
+    stats.print();
+    views.printStats();
+}
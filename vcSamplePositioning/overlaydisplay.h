@@ -0,0 +1,117 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OVERLAYDISPLAY_H
+#define OVERLAYDISPLAY_H
+
+#include <visp/vpDisplayOpenCV.h>
+#include <visp/vpCameraParameters.h>
+#include <visp/vpHomogeneousMatrix.h>
+#include <visp/vpImage.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "framepool.h"
+#include "modelrenderer.h"
+#include "stagequeue.h"
+#include "stagestats.h"
+#include "latencylog.h"
+#include "tracelog.h"
+
+/*!
+ * \brief Live view of both cameras with the tracked model drawn over them, on its own thread and at its own
+ * refresh rate.
+ *
+ * The tracking thread offers the frames it tracked with their poses, a view is only taken once per refresh
+ * period and a view the display has not yet drawn is replaced by the newer one, so the tracker never waits
+ * on the windows or the X server. The windows are created, drawn and closed by the display thread.
+ */
+class overlaydisplay
+{
+public:
+  overlaydisplay();
+  /*!
+  * \brief Destructor, closes the windows.
+  */
+  ~overlaydisplay();
+  /*!
+  * \brief Model drawn over the frames, must be called before start.
+  */
+  bool setModel(const std::string& modelFile);
+  /*!
+  * \brief Views shown per second, the default is 15.
+  */
+  void setRefreshRate(double hz);
+  /*!
+  * \brief Histograms of the time taken to render the overlays and to draw them in the windows, before start.
+  */
+  void setLatency(latencyhistogram* render, latencyhistogram* draw);
+  /*!
+  * \brief Trace the rendering and drawing of every view as spans, before start.
+  */
+  void setTrace(tracelog* log, unsigned int render, unsigned int draw);
+  void start();
+  /*!
+  * \brief Stop the display thread and close the windows.
+  */
+  void stop();
+  /*!
+  * \brief Tracking thread, offer the latest tracked frames. Returns at once, the frames are only referenced
+  * when a refresh is due.
+  * \param[in] stereo draw as the stereo tracker display does.
+  * \return true if the view was taken.
+  */
+  bool offer(const frameref& frame2, const frameref& frame3, const vpHomogeneousMatrix& cMo2,
+             const vpHomogeneousMatrix& cMo3, const vpCameraParameters& cam2, const vpCameraParameters& cam3,
+             bool stereo);
+  /*!
+  * \brief Frames the display may keep out of the capture pools at once.
+  */
+  unsigned int getHeldFrames() {return (unsigned int)views.getSlots().size();}
+  bool isRunning() const {return running.load();}
+  /*!
+  * \brief Print the display counters.
+  */
+  void printStats();
+
+private:
+  struct view
+  {
+    frameref frame2,frame3;
+    vpHomogeneousMatrix cMo2,cMo3;
+    vpCameraParameters cam2,cam3;
+    bool stereo;
+    unsigned long frameNumber;// of camera 2, for the trace
+  };
+  void displayLoop();
+  stagequeue<view> views;
+  stagestats stats;
+  modelrenderer renderer;
+  //display thread only
+  vpImage<vpRGBa> image2,image3;
+  vpDisplayOpenCV *d2,*d3;
+  latencyhistogram *renderLatency,*drawLatency;
+  tracelog* trace;
+  unsigned int renderSpan,drawSpan;
+  //tracking thread only
+  double refreshRate;
+  double nextDue;
+  std::thread worker;
+  std::atomic<bool> running;
+};
+
+#endif // OVERLAYDISPLAY_H
@@ -0,0 +1,204 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "framearchive.h"
+#include "imagewriter.h"
+#include "modelrenderer.h"
+#include <visp/vpImageIo.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+//the saved frames listed in a frames file written by imagewriter
+bool readFramesFile(const std::string& path, std::vector<framearchive::frameinfo>& frames)
+{
+    FILE* in = fopen(path.c_str(), "r");
+    if(in == NULL){
+        return false;
+    }
+    char line[1024];
+    //column names
+    if(fgets(line, sizeof(line), in) == NULL){
+        fclose(in);
+        return false;
+    }
+    while(fgets(line, sizeof(line), in) != NULL){
+        framearchive::frameinfo f;
+        unsigned int width, height;
+        double px, py, u0, v0, m[12];
+        int n = sscanf(line, "%u,%llu,%lf,%lf,%lf,%lf,%u,%u,%lf,%lf,%lf,%lf,"
+                       "%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf",
+                       &f.number, &f.captureNumber, &f.timestamp, &f.positions[0],
+                       &f.positions[1], &f.positions[2], &width, &height, &px, &py, &u0, &v0,
+                       &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &m[6], &m[7], &m[8], &m[9], &m[10], &m[11]);
+        if(n != 24){
+            continue;
+        }
+        f.cam.initPersProjWithoutDistortion(px, py, u0, v0);
+        for(unsigned int i = 0; i < 3; i++){
+            for(unsigned int j = 0; j < 4; j++){
+                f.cMo[i][j] = m[4 * i + j];
+            }
+        }
+        frames.push_back(f);
+    }
+    fclose(in);
+    return true;
+}
+
+bool fileExists(const std::string& path)
+{
+    FILE* f = fopen(path.c_str(), "r");
+    if(f == NULL){
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+}
+
+/**
+ * Regenerates the tracking overlays of a run, the model edges and object frame drawn over each saved frame at the
+ * pose tracked in it, as track_out<N>.png. The frames are spread over all the cores.
+ * usage: vcOverlayRender <model.cao> <frames> <output folder> [--stereo] [--threads n] [--png-level 0-9]
+ * <frames> is a frame archive (.vca) or the base of numbered frames with their frames file, e.g.
+ * image_out/cam2/data/img for img<N>.png and img_frames.csv.
+ */
+int main(int argc, char *argv[])
+{
+    if(argc < 4){
+        std::cout<<"usage: "<<argv[0]<<" <model.cao> <frames> <output folder> [--stereo] [--threads n] [--png-level 0-9]"
+                 <<std::endl;
+        return 1;
+    }
+    std::string framesPath(argv[2]);
+    std::string outDir(argv[3]);
+    if(!outDir.empty() && outDir[outDir.size() - 1] != '/'){
+        outDir += "/";
+    }
+    bool stereo = false;
+    unsigned int threads = std::thread::hardware_concurrency();
+    int pngLevel = 6;
+    for(int i = 4; i < argc; i++){
+        std::string arg(argv[i]);
+        if(arg == "--stereo"){
+            stereo = true;
+        }
+        else if(arg == "--threads" && i + 1 < argc){
+            threads = atoi(argv[++i]);
+        }
+        else if(arg == "--png-level" && i + 1 < argc){
+            pngLevel = atoi(argv[++i]);
+        }
+    }
+    if(threads < 1){
+        threads = 1;
+    }
+    modelrenderer model;
+    if(!model.loadModel(argv[1])){
+        std::cout<<"cannot read the model "<<argv[1]<<std::endl;
+        return 1;
+    }
+    //frames either from an archive or numbered files listed in the frames file
+    framearchivereader archive;
+    std::vector<framearchive::frameinfo> listed;
+    std::string ext;
+    bool fromArchive = framesPath.size() > 4 && framesPath.compare(framesPath.size() - 4, 4, ".vca") == 0;
+    unsigned int nbFrames;
+    if(fromArchive){
+        if(!archive.open(framesPath)){
+            std::cout<<"cannot read the frame archive "<<framesPath<<std::endl;
+            return 1;
+        }
+        if(archive.getHeader().channels != 1){
+            std::cout<<framesPath<<" does not hold camera frames"<<std::endl;
+            return 1;
+        }
+        nbFrames = archive.getNbFrames();
+    }
+    else{
+        if(!readFramesFile(framesPath + "_frames.csv", listed) || listed.empty()){
+            std::cout<<"no frames listed in "<<framesPath<<"_frames.csv"<<std::endl;
+            return 1;
+        }
+        ext = fileExists(framesPath + "0.png") ? ".png" : ".pgm";
+        nbFrames = (unsigned int)listed.size();
+    }
+    imagewriter writer;
+    try{
+        writer.open(outDir + "track_out", imagewriter::PNG, pngLevel);
+    }
+    catch(const std::exception& e){
+        std::cout<<e.what()<<std::endl;
+        return 1;
+    }
+    //same colours as the tracker display
+    const vpRGBa colour = stereo ? vpRGBa(255, 165, 0) : vpRGBa(255, 255, 0);
+    const unsigned int thickness = stereo ? 2 : 1;
+    std::atomic<unsigned int> next(0), failed(0);
+    std::vector<std::thread> pool;
+    for(unsigned int t = 0; t < threads; t++){
+        pool.push_back(std::thread([&]{
+            //the renderer keeps per frame buffers, every thread draws with its own copy
+            modelrenderer renderer(model);
+            imagewriter::encodebuffer buf;
+            vpImage<unsigned char> frame;
+            vpImage<vpRGBa> overlay;
+            unsigned int i;
+            while((i = next++) < nbFrames){
+                framearchive::frameinfo info;
+                try{
+                    if(fromArchive){
+                        framearchive::framerecord r = archive.getRecord(i);
+                        archive.getFrame(i, frame);
+                        info.number = r.number;
+                        info.captureNumber = r.captureNumber;
+                        info.timestamp = r.timestamp;
+                        for(int a = 0; a < 3; a++){
+                            info.positions[a] = r.positions[a];
+                        }
+                        info.cam = archive.getCameraParameters(i);
+                        info.cMo = archive.getPose(i);
+                    }
+                    else{
+                        info = listed[i];
+                        char path[FILENAME_MAX];
+                        snprintf(path, sizeof(path), "%s%u%s", framesPath.c_str(), info.number, ext.c_str());
+                        vpImageIo::read(frame, path);
+                    }
+                    renderer.drawOverlay(frame, info.cMo, info.cam, colour, thickness, overlay);
+                    writer.write(overlay, info, buf);
+                }
+                catch(...){
+                    if(failed++ == 0){
+                        std::cout<<"cannot render frame "<<info.number<<std::endl;
+                    }
+                }
+            }
+        }));
+    }
+    for(unsigned int t = 0; t < threads; t++){
+        pool[t].join();
+    }
+    writer.close();
+    std::cout<<nbFrames - failed<<" overlays written to "<<outDir<<" with "<<threads<<" threads"<<std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "replaysequence.h"
+#include <visp/vpImageIo.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+double nowSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+replaysequence::replaysequence() :
+    nbFrames(0), firstHeight(0), firstWidth(0), realtime(false), nextToDecode(0), released(0),
+    playbackStart(-1), lastRelease(0), stopping(false), waitsForDecode(0), decodeTimeMs(0), decodedFrames(0)
+{
+}
+
+replaysequence::~replaysequence()
+{
+    close();
+}
+
+std::string replaysequence::framePath(unsigned int camera, unsigned int frame) const
+{
+    std::stringstream ss;
+    if(!archives.empty()){
+        ss<<dirs[camera]<<"img.vca frame "<<frame;
+    }
+    else{
+        ss<<dirs[camera]<<"img"<<frame<<".png";
+    }
+    return ss.str();
+}
+
+/**
+ * @brief replaysequence::findArchiveFrames the sequence is the saved frame numbers present in the archive of
+ * every camera, frames persisted for only one camera of a pair are skipped
+ */
+bool replaysequence::findArchiveFrames()
+{
+    std::map<unsigned int, std::vector<unsigned int> > common;
+    for(unsigned int c = 0; c < dirs.size(); c++){
+        framearchivereader* reader = new framearchivereader();
+        archives.push_back(reader);
+        if(!reader->open(dirs[c] + "img.vca")){
+            std::cout<<"cannot read "<<dirs[c]<<"img.vca"<<std::endl;
+            return false;
+        }
+        for(unsigned int i = 0; i < reader->getNbFrames(); i++){
+            std::vector<unsigned int>& positions = common[reader->getRecord(i).number];
+            if(positions.size() == c){
+                positions.push_back(i);
+            }
+        }
+    }
+    archiveFrames.assign(dirs.size(), std::vector<unsigned int>());
+    for(std::map<unsigned int, std::vector<unsigned int> >::iterator it = common.begin(); it != common.end(); ++it){
+        if(it->second.size() != dirs.size()){
+            continue;
+        }
+        for(unsigned int c = 0; c < dirs.size(); c++){
+            archiveFrames[c].push_back(it->second[c]);
+        }
+        recordedTimes.push_back(archives[0]->getRecord(it->second[0]).timestamp / 1000.0);
+    }
+    nbFrames = (unsigned int)recordedTimes.size();
+    return true;
+}
+
+/**
+ * @brief replaysequence::findPngFrames the sequence is the run of frames numbered from 0 present for every camera
+ */
+bool replaysequence::findPngFrames()
+{
+    while(!dirs.empty()){
+        struct stat st;
+        bool found = true;
+        for(unsigned int c = 0; c < dirs.size() && found; c++){
+            found = stat(framePath(c, nbFrames).c_str(), &st) == 0;
+            if(found && c == 0){
+                recordedTimes.push_back(st.st_mtim.tv_sec + st.st_mtim.tv_nsec * 1e-9);
+            }
+        }
+        if(!found){
+            recordedTimes.resize(nbFrames);
+            break;
+        }
+        nbFrames++;
+    }
+    return true;
+}
+
+bool replaysequence::readFrame(unsigned int camera, unsigned int frame, vpImage<unsigned char>& I) const
+{
+    if(!archives.empty()){
+        return archives[camera]->getFrame(archiveFrames[camera][frame], I);
+    }
+    try{
+        vpImageIo::read(I, framePath(camera, frame));
+    }
+    catch(...){
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief replaysequence::open the first decoded frame gives the image size
+ */
+bool replaysequence::open(const std::vector<std::string>& frameDirs, bool realtime, unsigned int workers,
+                          unsigned int depth)
+{
+    close();
+    dirs = frameDirs;
+    for(size_t c = 0; c < dirs.size(); c++){
+        if(!dirs[c].empty() && dirs[c][dirs[c].size() - 1] != '/'){
+            dirs[c] += "/";
+        }
+    }
+    this->realtime = realtime;
+    recordedTimes.clear();
+    nbFrames = 0;
+    struct stat st;
+    bool found = !dirs.empty() && stat((dirs[0] + "img.vca").c_str(), &st) == 0 ? findArchiveFrames()
+                                                                                 : findPngFrames();
+    if(!found){
+        return false;
+    }
+    if(nbFrames == 0){
+        std::cout<<"no recorded frames to replay"<<std::endl;
+        return false;
+    }
+    vpImage<unsigned char> first;
+    if(!readFrame(0, 0, first)){
+        std::cout<<"cannot read "<<framePath(0, 0)<<std::endl;
+        return false;
+    }
+    firstHeight = first.getHeight();
+    firstWidth = first.getWidth();
+    window.assign(std::max(depth, 1u), slot());
+    for(size_t i = 0; i < window.size(); i++){
+        window[i].images.resize(dirs.size());
+        for(size_t c = 0; c < dirs.size(); c++){
+            window[i].images[c].resize(firstHeight, firstWidth);
+        }
+        window[i].frame = nbFrames;
+        window[i].ready = false;
+        window[i].failed = false;
+        window[i].taken = 0;
+    }
+    cursor.assign(dirs.size(), 0);
+    nextToDecode = 0;
+    released = 0;
+    playbackStart = -1;
+    lastRelease = 0;
+    stopping = false;
+    if(workers == 0){
+        workers = std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+    }
+    for(unsigned int i = 0; i < workers; i++){
+        this->workers.push_back(std::thread(&replaysequence::decodeLoop, this));
+    }
+    std::cout<<"replaying "<<nbFrames<<(archives.empty() ? " png" : " archived")<<" frames of "<<dirs.size()<<" cameras, "<<firstWidth<<"x"<<firstHeight
+             <<(realtime ? " at the recorded cadence" : " as fast as possible")<<std::endl;
+    return true;
+}
+
+void replaysequence::close()
+{
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        stopping = true;
+    }
+    decodedCond.notify_all();
+    releasedCond.notify_all();
+    for(size_t i = 0; i < workers.size(); i++){
+        workers[i].join();
+    }
+    workers.clear();
+    for(size_t c = 0; c < archives.size(); c++){
+        delete archives[c];
+    }
+    archives.clear();
+    archiveFrames.clear();
+}
+
+/**
+ * @brief replaysequence::decodeLoop decoding thread - takes the next frame as soon as its slot of the window has
+ * been released by every camera, the file reads and decoding run without the lock
+ */
+void replaysequence::decodeLoop()
+{
+    std::unique_lock<std::mutex> lk(lock);
+    while(true){
+        releasedCond.wait(lk, [this]{
+            return stopping || nextToDecode >= nbFrames || nextToDecode < released + window.size();
+        });
+        if(stopping || nextToDecode >= nbFrames){
+            return;
+        }
+        unsigned int frame = nextToDecode++;
+        slot& s = window[frame % window.size()];
+        s.frame = frame;
+        s.ready = false;
+        s.failed = false;
+        s.taken = 0;
+        lk.unlock();
+        double start = nowSeconds();
+        bool failed = false;
+        for(unsigned int c = 0; c < dirs.size(); c++){
+            if(!readFrame(c, frame, s.images[c])){
+                failed = true;
+            }
+        }
+        double elapsedMs = (nowSeconds() - start) * 1000.0;
+        lk.lock();
+        s.failed = failed;
+        s.ready = true;
+        decodedFrames++;
+        decodeTimeMs += elapsedMs;
+        decodedCond.notify_all();
+    }
+}
+
+unsigned int replaysequence::getFrame(unsigned int camera, vpImage<unsigned char>& I)
+{
+    std::unique_lock<std::mutex> lk(lock);
+    unsigned int frame = cursor[camera];
+    if(frame >= nbFrames){
+        throw std::runtime_error("end of the replayed sequence");
+    }
+    slot& s = window[frame % window.size()];
+    if(!(s.frame == frame && s.ready)){
+        waitsForDecode++;
+    }
+    // lockstep, every other camera must have taken the previous frame
+    decodedCond.wait(lk, [this, frame, &s]{
+        if(stopping){
+            return true;
+        }
+        for(size_t c = 0; c < cursor.size(); c++){
+            if(cursor[c] < frame){
+                return false;
+            }
+        }
+        return s.frame == frame && s.ready;
+    });
+    if(stopping){
+        throw std::runtime_error("replay closed");
+    }
+    if(s.failed){
+        throw std::runtime_error("cannot decode " + framePath(camera, frame));
+    }
+    double now = nowSeconds();
+    if(playbackStart < 0){
+        playbackStart = now;
+    }
+    if(realtime){
+        double due = playbackStart + recordedTimes[frame] - recordedTimes[0];
+        if(due > now){
+            lk.unlock();
+            std::this_thread::sleep_for(std::chrono::duration<double>(due - now));
+            lk.lock();
+        }
+    }
+    // the slot cannot be reused before this camera has taken it
+    lk.unlock();
+    const vpImage<unsigned char>& src = s.images[camera];
+    if(I.getHeight() != src.getHeight() || I.getWidth() != src.getWidth()){
+        I.resize(src.getHeight(), src.getWidth());
+    }
+    memcpy(I.bitmap, src.bitmap, src.getSize());
+    lk.lock();
+    cursor[camera] = frame + 1;
+    if(++s.taken == dirs.size()){
+        released = frame + 1;
+        lastRelease = nowSeconds();
+        releasedCond.notify_all();
+    }
+    decodedCond.notify_all();
+    return frame;
+}
+
+void replaysequence::printStats()
+{
+    std::lock_guard<std::mutex> lk(lock);
+    std::cout<<"replayed frames \t"<<released<<" of "<<nbFrames<<std::endl;
+    std::cout<<"decoding threads \t"<<workers.size()<<std::endl;
+    if(decodedFrames > 0){
+        std::cout<<"mean decode time per frame set (ms) \t"<<decodeTimeMs / decodedFrames<<std::endl;
+    }
+    std::cout<<"waits for decoding \t"<<waitsForDecode<<std::endl;
+    if(released > 1 && lastRelease > playbackStart){
+        std::cout<<"playback frames/s \t"<<released / (lastRelease - playbackStart)<<std::endl;
+    }
+}
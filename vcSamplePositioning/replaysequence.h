@@ -0,0 +1,116 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REPLAYSEQUENCE_H
+#define REPLAYSEQUENCE_H
+
+#include <visp/vpImage.h>
+#include "framearchive.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+ * \brief A recorded run, the img.vca frame archive or the img<N>.png frames of one or more cameras, decoded
+ * ahead of playback by a pool of worker threads.
+ *
+ * Cameras are played in lockstep: a camera is only given frame N once every other camera has taken
+ * frame N-1. Frames are released either as soon as they are decoded or at the cadence they were
+ * recorded at, taken from the capture times stored in the archive or from the png file modification times.
+ */
+class replaysequence
+{
+public:
+  replaysequence();
+  /*!
+  * \brief Destructor, stops the decoding threads.
+  */
+  ~replaysequence();
+  /*!
+  * \brief Find the frames and start decoding.
+  * \param[in] frameDirs one directory per camera holding img.vca, or img0.png, img1.png... The archives
+  * are played if the first directory has one, the frames saved for every camera in saved frame number order.
+  * \param[in] realtime play at the recorded cadence instead of as fast as possible.
+  * \param[in] workers number of decoding threads, 0 for one per core (at most 4).
+  * \param[in] depth number of frames decoded ahead.
+  * \return false if there is no frame common to all the directories.
+  */
+  bool open(const std::vector<std::string>& frameDirs, bool realtime, unsigned int workers = 0,
+            unsigned int depth = 8);
+  /*!
+  * \brief Stop decoding, wakes up any waiting camera.
+  */
+  void close();
+  /*!
+  * \brief Copy the next frame of a camera into I, waiting for it to be decoded and for its turn.
+  * Throws std::runtime_error at the end of the sequence or once closed.
+  * \param[in] camera index of the camera in frameDirs.
+  * \param[out] I the image.
+  * \return the frame number.
+  */
+  unsigned int getFrame(unsigned int camera, vpImage<unsigned char>& I);
+  unsigned int getNbFrames() const {return nbFrames;}
+  unsigned int getNbCameras() const {return (unsigned int)dirs.size();}
+  /*!
+  * \brief Size of the first frame of the first camera, to open the grabbers with.
+  */
+  void getFrameSize(unsigned int& height, unsigned int& width) const {height = firstHeight; width = firstWidth;}
+  /*!
+  * \brief Print the playback counters.
+  */
+  void printStats();
+
+private:
+  struct slot
+  {
+    std::vector<vpImage<unsigned char> > images;
+    unsigned int frame;
+    bool ready;
+    bool failed;
+    unsigned int taken;
+  };
+  void decodeLoop();
+  std::string framePath(unsigned int camera, unsigned int frame) const;
+  bool findArchiveFrames();
+  bool findPngFrames();
+  bool readFrame(unsigned int camera, unsigned int frame, vpImage<unsigned char>& I) const;
+  std::vector<std::string> dirs;
+  std::vector<double> recordedTimes; //s, capture or modification time of the frames of the first camera
+  //with archives, one per camera and the position in it of each frame of the sequence
+  std::vector<framearchivereader*> archives;
+  std::vector<std::vector<unsigned int> > archiveFrames;
+  unsigned int nbFrames;
+  unsigned int firstHeight, firstWidth;
+  bool realtime;
+  std::vector<slot> window;
+  std::vector<unsigned int> cursor; //next frame of each camera
+  unsigned int nextToDecode;
+  unsigned int released; //every frame before this one has been taken by all cameras
+  double playbackStart, lastRelease;
+  bool stopping;
+  std::mutex lock;
+  std::condition_variable decodedCond, releasedCond;
+  std::vector<std::thread> workers;
+  //playback counters
+  unsigned long waitsForDecode;
+  double decodeTimeMs;
+  unsigned long decodedFrames;
+};
+
+#endif // REPLAYSEQUENCE_H
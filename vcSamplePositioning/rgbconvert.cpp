@@ -0,0 +1,312 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "rgbconvert.h"
+#include <visp/vpRGBa.h>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RGBCONVERT_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+// name of the grey level kernel picked by selectGreyKernel
+std::string greyKernelName = "scalar";
+
+#ifdef RGBCONVERT_X86
+// byte shuffles gathering one colour component of 4 packed rgb pixels into 4 int32 lanes
+__attribute__((target("sse4.1")))
+inline __m128i shuffleComponent(__m128i px, int c)
+{
+  const __m128i mask = _mm_setr_epi8(c, -1, -1, -1, c + 3, -1, -1, -1,
+                                     c + 6, -1, -1, -1, c + 9, -1, -1, -1);
+  return _mm_shuffle_epi8(px, mask);
+}
+
+/**
+ * Luminance of the 4 rgb pixels in the low 12 bytes of px, as 4 int32. The weighted sum is done in
+ * double and in the same order as the scalar code, (wr * r + wg * g) + wb * b, then truncated.
+ */
+__attribute__((target("sse4.1")))
+inline __m128i lumaSSE41(__m128i px)
+{
+  const __m128d wr = _mm_set1_pd(0.2126);
+  const __m128d wg = _mm_set1_pd(0.7152);
+  const __m128d wb = _mm_set1_pd(0.0722);
+  __m128i r = shuffleComponent(px, 0);
+  __m128i g = shuffleComponent(px, 1);
+  __m128i b = shuffleComponent(px, 2);
+  __m128d y0 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(wr, _mm_cvtepi32_pd(r)), _mm_mul_pd(wg, _mm_cvtepi32_pd(g))),
+                          _mm_mul_pd(wb, _mm_cvtepi32_pd(b)));
+  r = _mm_srli_si128(r, 8);
+  g = _mm_srli_si128(g, 8);
+  b = _mm_srli_si128(b, 8);
+  __m128d y1 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(wr, _mm_cvtepi32_pd(r)), _mm_mul_pd(wg, _mm_cvtepi32_pd(g))),
+                          _mm_mul_pd(wb, _mm_cvtepi32_pd(b)));
+  return _mm_unpacklo_epi64(_mm_cvttpd_epi32(y0), _mm_cvttpd_epi32(y1));
+}
+
+__attribute__((target("avx2")))
+inline __m128i lumaAVX2(__m128i px)
+{
+  const __m256d wr = _mm256_set1_pd(0.2126);
+  const __m256d wg = _mm256_set1_pd(0.7152);
+  const __m256d wb = _mm256_set1_pd(0.0722);
+  __m256d r = _mm256_cvtepi32_pd(shuffleComponent(px, 0));
+  __m256d g = _mm256_cvtepi32_pd(shuffleComponent(px, 1));
+  __m256d b = _mm256_cvtepi32_pd(shuffleComponent(px, 2));
+  __m256d y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(wr, r), _mm256_mul_pd(wg, g)), _mm256_mul_pd(wb, b));
+  return _mm256_cvttpd_epi32(y);
+}
+#endif
+}
+
+void rgbconvert::toGrey(const unsigned char* rgb, unsigned char* grey, unsigned int size)
+{
+  static const greyKernel kernel = selectGreyKernel();
+  kernel(rgb, grey, size);
+}
+
+void rgbconvert::toRGBa(const unsigned char* rgb, unsigned char* rgba, unsigned int size)
+{
+  static const rgbaKernel kernel = selectRGBaKernel();
+  kernel(rgb, rgba, size);
+}
+
+/**
+ * Binning converts each of the factor rows with the selected kernel and sums the grey levels of every block,
+ * subsampling converts only the top left pixel of each block.
+ */
+void rgbconvert::toGreyReduced(const unsigned char* rgb, unsigned char* grey, unsigned int width, unsigned int factor,
+                               bool average, unsigned char* scratch, unsigned short* sums)
+{
+  const unsigned int outWidth = width / factor;
+  if(!average){
+    for(unsigned int x = 0; x < outWidth; x++){
+      toGreyScalar(rgb + 3 * x * factor, grey + x, 1);
+    }
+    return;
+  }
+  memset(sums, 0, outWidth * sizeof(unsigned short));
+  for(unsigned int r = 0; r < factor; r++){
+    toGrey(rgb + 3 * r * width, scratch, outWidth * factor);
+    const unsigned char* g = scratch;
+    for(unsigned int x = 0; x < outWidth; x++){
+      unsigned short s = 0;
+      for(unsigned int k = 0; k < factor; k++){
+        s += *g++;
+      }
+      sums[x] += s;
+    }
+  }
+  const unsigned int n = factor * factor;
+  for(unsigned int x = 0; x < outWidth; x++){
+    grey[x] = (unsigned char)((sums[x] + n / 2) / n);
+  }
+}
+
+void rgbconvert::toRGBaReduced(const unsigned char* rgb, unsigned char* rgba, unsigned int width, unsigned int factor,
+                               bool average)
+{
+  const unsigned int outWidth = width / factor;
+  if(!average){
+    for(unsigned int x = 0; x < outWidth; x++){
+      toRGBaScalar(rgb + 3 * x * factor, rgba + 4 * x, 1);
+    }
+    return;
+  }
+  const unsigned int n = factor * factor;
+  for(unsigned int x = 0; x < outWidth; x++){
+    unsigned int s[3] = {0, 0, 0};
+    for(unsigned int r = 0; r < factor; r++){
+      const unsigned char* p = rgb + 3 * (r * width + x * factor);
+      for(unsigned int k = 0; k < factor; k++, p += 3){
+        s[0] += p[0];
+        s[1] += p[1];
+        s[2] += p[2];
+      }
+    }
+    unsigned char* o = rgba + 4 * x;
+    o[0] = (unsigned char)((s[0] + n / 2) / n);
+    o[1] = (unsigned char)((s[1] + n / 2) / n);
+    o[2] = (unsigned char)((s[2] + n / 2) / n);
+    o[3] = vpRGBa::alpha_default;
+  }
+}
+
+std::string rgbconvert::getKernelName()
+{
+  // make sure the selection has been done
+  toGrey(0, 0, 0);
+  return greyKernelName;
+}
+
+/**
+ * Reference conversion, identical to vpImageConvert::RGBToGrey
+ */
+void rgbconvert::toGreyScalar(const unsigned char* rgb, unsigned char* grey, unsigned int size)
+{
+  const unsigned char* pt_end = rgb + 3 * size;
+  while(rgb != pt_end){
+    *grey++ = (unsigned char)(0.2126 * rgb[0] + 0.7152 * rgb[1] + 0.0722 * rgb[2]);
+    rgb += 3;
+  }
+}
+
+void rgbconvert::toRGBaScalar(const unsigned char* rgb, unsigned char* rgba, unsigned int size)
+{
+  const unsigned char* pt_end = rgb + 3 * size;
+  while(rgb != pt_end){
+    *rgba++ = *rgb++;
+    *rgba++ = *rgb++;
+    *rgba++ = *rgb++;
+    *rgba++ = vpRGBa::alpha_default;
+  }
+}
+
+#ifdef RGBCONVERT_X86
+/**
+ * 8 pixels per iteration, the second 16 byte load starts 12 bytes in and reads 4 bytes past the
+ * 8 pixels so the vector loop stops while at least 10 pixels remain. The rest is done by the scalar code.
+ */
+__attribute__((target("sse4.1")))
+void rgbconvert::toGreySSE41(const unsigned char* rgb, unsigned char* grey, unsigned int size)
+{
+  unsigned int i = 0;
+  for(; i + 10 <= size; i += 8){
+    const unsigned char* p = rgb + 3 * i;
+    __m128i lo = lumaSSE41(_mm_loadu_si128((const __m128i*)p));
+    __m128i hi = lumaSSE41(_mm_loadu_si128((const __m128i*)(p + 12)));
+    __m128i w = _mm_packus_epi32(lo, hi);
+    _mm_storel_epi64((__m128i*)(grey + i), _mm_packus_epi16(w, w));
+  }
+  toGreyScalar(rgb + 3 * i, grey + i, size - i);
+}
+
+__attribute__((target("avx2")))
+void rgbconvert::toGreyAVX2(const unsigned char* rgb, unsigned char* grey, unsigned int size)
+{
+  unsigned int i = 0;
+  for(; i + 10 <= size; i += 8){
+    const unsigned char* p = rgb + 3 * i;
+    __m128i lo = lumaAVX2(_mm_loadu_si128((const __m128i*)p));
+    __m128i hi = lumaAVX2(_mm_loadu_si128((const __m128i*)(p + 12)));
+    __m128i w = _mm_packus_epi32(lo, hi);
+    _mm_storel_epi64((__m128i*)(grey + i), _mm_packus_epi16(w, w));
+  }
+  toGreyScalar(rgb + 3 * i, grey + i, size - i);
+}
+
+__attribute__((target("ssse3")))
+void rgbconvert::toRGBaSSSE3(const unsigned char* rgb, unsigned char* rgba, unsigned int size)
+{
+  const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i alpha = _mm_set1_epi32((int)((unsigned int)vpRGBa::alpha_default << 24));
+  unsigned int i = 0;
+  for(; i + 10 <= size; i += 8){
+    const unsigned char* p = rgb + 3 * i;
+    __m128i lo = _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), spread), alpha);
+    __m128i hi = _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 12)), spread), alpha);
+    _mm_storeu_si128((__m128i*)(rgba + 4 * i), lo);
+    _mm_storeu_si128((__m128i*)(rgba + 4 * i + 16), hi);
+  }
+  toRGBaScalar(rgb + 3 * i, rgba + 4 * i, size - i);
+}
+#else
+void rgbconvert::toGreySSE41(const unsigned char* rgb, unsigned char* grey, unsigned int size)
+{
+  toGreyScalar(rgb, grey, size);
+}
+
+void rgbconvert::toGreyAVX2(const unsigned char* rgb, unsigned char* grey, unsigned int size)
+{
+  toGreyScalar(rgb, grey, size);
+}
+
+void rgbconvert::toRGBaSSSE3(const unsigned char* rgb, unsigned char* rgba, unsigned int size)
+{
+  toRGBaScalar(rgb, rgba, size);
+}
+#endif
+
+bool rgbconvert::isSupported(kernel k)
+{
+  if(k == SCALAR){
+    return true;
+  }
+#ifdef RGBCONVERT_X86
+  __builtin_cpu_init();
+  if(k == SSE41){
+    return __builtin_cpu_supports("sse4.1");
+  }
+  if(k == AVX2){
+    return __builtin_cpu_supports("avx2");
+  }
+  if(k == SSSE3){
+    return __builtin_cpu_supports("ssse3");
+  }
+#endif
+  return false;
+}
+
+void rgbconvert::toGrey(kernel k, const unsigned char* rgb, unsigned char* grey, unsigned int size)
+{
+  if(k == SSE41){
+    toGreySSE41(rgb, grey, size);
+  }
+  else if(k == AVX2){
+    toGreyAVX2(rgb, grey, size);
+  }
+  else{
+    toGreyScalar(rgb, grey, size);
+  }
+}
+
+void rgbconvert::toRGBa(kernel k, const unsigned char* rgb, unsigned char* rgba, unsigned int size)
+{
+  if(k == SSSE3){
+    toRGBaSSSE3(rgb, rgba, size);
+  }
+  else{
+    toRGBaScalar(rgb, rgba, size);
+  }
+}
+
+/**
+ * Picks the fastest grey level kernel the cpu supports
+ */
+rgbconvert::greyKernel rgbconvert::selectGreyKernel()
+{
+  if(isSupported(AVX2)){
+    greyKernelName = "avx2";
+    return &rgbconvert::toGreyAVX2;
+  }
+  if(isSupported(SSE41)){
+    greyKernelName = "sse4.1";
+    return &rgbconvert::toGreySSE41;
+  }
+  greyKernelName = "scalar";
+  return &rgbconvert::toGreyScalar;
+}
+
+rgbconvert::rgbaKernel rgbconvert::selectRGBaKernel()
+{
+  if(isSupported(SSSE3)){
+    return &rgbconvert::toRGBaSSSE3;
+  }
+  return &rgbconvert::toRGBaScalar;
+}
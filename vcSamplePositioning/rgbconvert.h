@@ -0,0 +1,103 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RGBCONVERT_H
+#define RGBCONVERT_H
+
+#include <string>
+
+/*!
+ * \brief Conversion kernels from the packed rgb buffer delivered by imalib (row major,
+ * 3 bytes per pixel) to the visp image formats.
+ *
+ * The grey level conversion uses the same weights and the same double precision evaluation
+ * order as vpImageConvert::RGBToGrey so the result is bit exact with it, which testRgbConvert
+ * checks. SSE4.1 and AVX2 versions are selected at runtime from the cpu features, with a scalar
+ * fallback.
+ */
+class rgbconvert
+{
+public:
+  /*!
+  * \brief Convert size rgb pixels to grey level.
+  * \param[in] rgb packed rgb input buffer.
+  * \param[out] grey output buffer of size bytes.
+  * \param[in] size number of pixels.
+  */
+  static void toGrey(const unsigned char* rgb, unsigned char* grey, unsigned int size);
+  /*!
+  * \brief Convert size rgb pixels to rgba, alpha set to vpRGBa::alpha_default.
+  * \param[in] rgb packed rgb input buffer.
+  * \param[out] rgba output buffer of 4 * size bytes.
+  * \param[in] size number of pixels.
+  */
+  static void toRGBa(const unsigned char* rgb, unsigned char* rgba, unsigned int size);
+  /*!
+  * \brief Convert factor rgb rows to one grey level row of width / factor pixels, for software binning.
+  * \param[in] rgb first of the factor packed rgb rows, rows follow each other.
+  * \param[out] grey output row.
+  * \param[in] width number of pixels of an input row.
+  * \param[in] factor reduction factor, at most 16.
+  * \param[in] average true to average each factor x factor block (binning), false to keep its top left
+  * pixel (subsampling).
+  * \param[in] scratch width bytes, only used when binning.
+  * \param[in] sums width / factor values, only used when binning.
+  */
+  static void toGreyReduced(const unsigned char* rgb, unsigned char* grey, unsigned int width, unsigned int factor,
+                            bool average, unsigned char* scratch, unsigned short* sums);
+  /*!
+  * \brief Same as toGreyReduced to rgba.
+  */
+  static void toRGBaReduced(const unsigned char* rgb, unsigned char* rgba, unsigned int width, unsigned int factor,
+                            bool average);
+  /*!
+  * \brief Name of the grey level kernel selected for this cpu.
+  */
+  static std::string getKernelName();
+  /*!
+  * \brief The conversion kernels, named to compare and time them against each other. SSE41 and AVX2 are grey level
+  * kernels, SSSE3 an rgba kernel, the scalar kernel does both.
+  */
+  enum kernel {SCALAR, SSE41, AVX2, SSSE3};
+  /*!
+  * \brief True if the cpu can run the kernel.
+  */
+  static bool isSupported(kernel k);
+  /*!
+  * \brief Same as toGrey with the given kernel rather than the selected one, the scalar kernel when k is not a grey
+  * level kernel.
+  */
+  static void toGrey(kernel k, const unsigned char* rgb, unsigned char* grey, unsigned int size);
+  /*!
+  * \brief Same as toRGBa with the given kernel rather than the selected one, the scalar kernel when k is not an rgba
+  * kernel.
+  */
+  static void toRGBa(kernel k, const unsigned char* rgb, unsigned char* rgba, unsigned int size);
+
+private:
+  typedef void (*greyKernel)(const unsigned char*, unsigned char*, unsigned int);
+  typedef void (*rgbaKernel)(const unsigned char*, unsigned char*, unsigned int);
+  static void toGreyScalar(const unsigned char* rgb, unsigned char* grey, unsigned int size);
+  static void toGreySSE41(const unsigned char* rgb, unsigned char* grey, unsigned int size);
+  static void toGreyAVX2(const unsigned char* rgb, unsigned char* grey, unsigned int size);
+  static void toRGBaScalar(const unsigned char* rgb, unsigned char* rgba, unsigned int size);
+  static void toRGBaSSSE3(const unsigned char* rgb, unsigned char* rgba, unsigned int size);
+  static greyKernel selectGreyKernel();
+  static rgbaKernel selectRGBaKernel();
+};
+
+#endif // RGBCONVERT_H
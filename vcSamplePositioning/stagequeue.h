@@ -0,0 +1,246 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STAGEQUEUE_H
+#define STAGEQUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Bounded queue between two stages of the tracking pipeline, one producer and one consumer.
+ *
+ * Items are filled and read in place in preallocated slots, so large items such as images keep their
+ * buffers from one frame to the next. When the queue is full the producer either overwrites the oldest
+ * queued item (DROP_OLDEST, for stages that only need recent data) or waits for the consumer (BLOCK,
+ * for stages that must see every item).
+ * A stage run by several threads pops with beginPop() and hands each item back with endPop(item).
+ */
+template <class T>
+class stagequeue
+{
+public:
+  enum policy {DROP_OLDEST, BLOCK};
+  /*!
+  * \brief Constructor.
+  * \param[in] name used in the statistics output.
+  * \param[in] capacity number of items that can be queued.
+  * \param[in] p what the producer does when the queue is full.
+  */
+  stagequeue(std::string name, unsigned int capacity, policy p) :
+    name(name), p(p), buffer((capacity < 1 ? 1 : capacity) + 2), fifo(capacity < 1 ? 1 : capacity), head(0), count(0),
+    filling(-1), held(-1), closed(false)
+  {
+    // one slot may be filled by the producer and one held by the consumer besides the queued ones
+    for(unsigned int i = 0; i < buffer.size(); i++){
+      freeSlots.push_back(i);
+    }
+    resetStats();
+  }
+  /*!
+  * \brief Number of consumer threads, each holds one slot while working on it. Only while no stage
+  * uses the queue, followed by reopen().
+  */
+  void setConsumers(unsigned int consumers)
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    buffer.resize(fifo.size() + 1 + (consumers < 1 ? 1 : consumers));
+  }
+  /*!
+  * \brief Producer side, slot to fill next or NULL once closed. The slot is queued by commitPush().
+  */
+  T* beginPush()
+  {
+    std::unique_lock<std::mutex> lk(lock);
+    if(count == fifo.size()){
+      if(p == BLOCK){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        poppedCond.wait(lk, [this]{return closed || count < fifo.size();});
+        blockedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      }
+      else{
+        freeSlots.push_back(fifo[head]);
+        head = (head + 1) % fifo.size();
+        count--;
+        dropped++;
+      }
+    }
+    if(closed){
+      return NULL;
+    }
+    filling = freeSlots.back();
+    freeSlots.pop_back();
+    return &buffer[filling];
+  }
+  /*!
+  * \brief Producer side, queue the slot returned by beginPush().
+  */
+  void commitPush()
+  {
+    {
+      std::lock_guard<std::mutex> lk(lock);
+      fifo[(head + count) % fifo.size()] = filling;
+      count++;
+      filling = -1;
+      pushed++;
+      if(count > maxDepth){
+        maxDepth = count;
+      }
+    }
+    pushedCond.notify_one();
+  }
+  /*!
+  * \brief Consumer side, oldest queued item, waiting for one. NULL once closed and drained.
+  * The item is handed back with endPop().
+  */
+  T* beginPop()
+  {
+    std::unique_lock<std::mutex> lk(lock);
+    pushedCond.wait(lk, [this]{return closed || count > 0;});
+    return takeFront();
+  }
+  /*!
+  * \brief Consumer side, oldest queued item or NULL if there is none, without waiting.
+  */
+  T* tryPop()
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    return takeFront();
+  }
+  /*!
+  * \brief Consumer side, hand back the item returned by beginPop() or tryPop(), single consumer only.
+  */
+  void endPop()
+  {
+    {
+      std::lock_guard<std::mutex> lk(lock);
+      freeSlots.push_back(held);
+      held = -1;
+    }
+    poppedCond.notify_one();
+  }
+  /*!
+  * \brief Consumer side, hand back an item returned by beginPop() or tryPop(), for any number of consumers.
+  */
+  void endPop(T* item)
+  {
+    {
+      std::lock_guard<std::mutex> lk(lock);
+      freeSlots.push_back((unsigned int)(item - &buffer[0]));
+    }
+    poppedCond.notify_one();
+  }
+  /*!
+  * \brief Wake both sides, the consumer still gets the queued items.
+  */
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lk(lock);
+      closed = true;
+    }
+    pushedCond.notify_all();
+    poppedCond.notify_all();
+  }
+  /*!
+  * \brief Reopen after close() with an empty queue and fresh counters.
+  */
+  void reopen()
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    freeSlots.clear();
+    for(unsigned int i = 0; i < buffer.size(); i++){
+      freeSlots.push_back(i);
+    }
+    head = 0;
+    count = 0;
+    filling = -1;
+    held = -1;
+    closed = false;
+    resetStats();
+  }
+  /*!
+  * \brief All the buffer, for preallocation before the stages start.
+  */
+  std::vector<T>& getSlots(){return buffer;}
+  unsigned int getDepth()
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    return count;
+  }
+  /*!
+  * \brief Items the producer overwrote before they were taken, DROP_OLDEST only.
+  */
+  unsigned long getDropped()
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    return dropped;
+  }
+  /*!
+  * \brief Print the queue counters.
+  */
+  void printStats()
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    std::cout<<name<<" queue - items \t"<<pushed<<std::endl;
+    std::cout<<name<<" queue - largest depth \t"<<maxDepth<<" of "<<fifo.size()<<std::endl;
+    if(p == DROP_OLDEST){
+      std::cout<<name<<" queue - dropped oldest \t"<<dropped<<std::endl;
+    }
+    else{
+      std::cout<<name<<" queue - producer blocked (ms) \t"<<blockedMs<<std::endl;
+    }
+  }
+
+private:
+  T* takeFront()
+  {
+    if(count == 0){
+      return NULL;
+    }
+    held = fifo[head];
+    head = (head + 1) % fifo.size();
+    count--;
+    return &buffer[held];
+  }
+  void resetStats()
+  {
+    pushed = 0;
+    dropped = 0;
+    maxDepth = 0;
+    blockedMs = 0;
+  }
+  std::string name;
+  policy p;
+  std::vector<T> buffer;
+  std::vector<unsigned int> fifo; //queued slot indices, oldest at head
+  std::vector<unsigned int> freeSlots;
+  unsigned int head, count;
+  int filling, held;
+  bool closed;
+  std::mutex lock;
+  std::condition_variable pushedCond, poppedCond;
+  unsigned long pushed, dropped;
+  unsigned int maxDepth;
+  double blockedMs;
+};
+
+#endif // STAGEQUEUE_H
@@ -0,0 +1,75 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "stagestats.h"
+#include <chrono>
+#include <iostream>
+
+stagestats::stagestats(std::string name) :
+    name(name)
+{
+    reset();
+}
+
+void stagestats::reset()
+{
+    items = 0;
+    busyMs = 0;
+    maxMs = 0;
+    lastMs = 0;
+    itemStart = 0;
+    firstStart = -1;
+    lastEnd = 0;
+}
+
+double stagestats::now()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void stagestats::begin()
+{
+    itemStart = now();
+    if(firstStart < 0){
+        firstStart = itemStart;
+    }
+}
+
+void stagestats::end()
+{
+    lastEnd = now();
+    lastMs = lastEnd - itemStart;
+    busyMs += lastMs;
+    if(lastMs > maxMs){
+        maxMs = lastMs;
+    }
+    items++;
+}
+
+void stagestats::print() const
+{
+    std::cout<<name<<" - items \t"<<items<<std::endl;
+    if(items == 0){
+        return;
+    }
+    double wallMs = lastEnd - firstStart;
+    if(wallMs > 0){
+        std::cout<<name<<" - items/s \t"<<items * 1000.0 / wallMs<<std::endl;
+        std::cout<<name<<" - busy (%) \t"<<100.0 * busyMs / wallMs<<std::endl;
+    }
+    std::cout<<name<<" - mean item time (ms) \t"<<getMeanMs()<<std::endl;
+    std::cout<<name<<" - longest item time (ms) \t"<<maxMs<<std::endl;
+}
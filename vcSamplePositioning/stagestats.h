@@ -0,0 +1,66 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STAGESTATS_H
+#define STAGESTATS_H
+
+#include <string>
+
+/*!
+ * \brief Throughput counters of one stage of the tracking pipeline, only used from the stage's thread
+ * until it is joined.
+ *
+ * The time between begin() and end() is the work done on one item, the rest of the time the stage
+ * waited for input. The stage with the longest mean item time bounds the rate of the whole pipeline.
+ */
+class stagestats
+{
+public:
+  explicit stagestats(std::string name);
+  void reset();
+  /*!
+  * \brief Start of the work on one item.
+  */
+  void begin();
+  /*!
+  * \brief End of the work on the item started by begin().
+  */
+  void end();
+  unsigned long getItems() const {return items;}
+  /*!
+  * \brief Mean work time per item in ms.
+  */
+  double getMeanMs() const {return items > 0 ? busyMs / items : 0;}
+  /*!
+  * \brief Work time of the last item in ms.
+  */
+  double getLastMs() const {return lastMs;}
+  const std::string& getName() const {return name;}
+  /*!
+  * \brief Print items/s, mean and longest item time and the share of the time spent working.
+  */
+  void print() const;
+
+private:
+  static double now();
+  std::string name;
+  unsigned long items;
+  double busyMs, maxMs, lastMs;
+  double itemStart, firstStart, lastEnd;
+};
+
+#endif // STAGESTATS_H
@@ -0,0 +1,169 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "stereopairer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+stereopairer::stereopairer(capturethread& left, capturethread& right, double maxSkewMs) :
+    left(left), right(right), maxSkewMs(maxSkewMs), maxRejections(10), rejectedInRow(0), overSkew(false),
+    pairs(0), rejected(0), overSkewPairs(0), skewSum(0), skewSumSq(0), skewMax(0)
+{
+}
+
+stereopairer::~stereopairer()
+{
+    if(skewlog.is_open()){
+        skewlog.close();
+    }
+}
+
+void stereopairer::openSkewLog(std::string filename)
+{
+    skewlog.open(filename.c_str(), std::ios_base::app);
+    skewlog<<"left_frame,right_frame,left_ms,right_ms,skew_ms"<<std::endl;
+}
+
+double stereopairer::getPair(vpImage<unsigned char>& Ileft, vpImage<unsigned char>& Iright)
+{
+    frameref fleft, fright;
+    double skew = getPair(fleft, fright);
+    fleft.copyTo(Ileft);
+    fright.copyTo(Iright);
+    return skew;
+}
+
+double stereopairer::getPair(frameref& fleft, frameref& fright)
+{
+    double skew = 0;
+    while(true){
+        unsigned int nl = left.getQueueDepth();
+        unsigned int nr = right.getQueueDepth();
+        if(nl > 0 && nr > 0){
+            // the camera whose newest frame is older is the reference, its counterpart is somewhere
+            // in the other queue
+            if(left.peekTimestamp(nl - 1) <= right.peekTimestamp(nr - 1)){
+                if(tryMatch(left, right, true, fleft, fright, skew)){
+                    return skew;
+                }
+            }
+            else if(tryMatch(right, left, false, fleft, fright, skew)){
+                return skew;
+            }
+            continue;
+        }
+        left.checkRunning();
+        right.checkRunning();
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+/**
+ * @brief stereopairer::tryMatch looks for the frame of other closest in time to the newest frame of ref.
+ * If none is within the maximum skew the newest frame of ref cannot be paired any more, every frame of
+ * other after it is newer still, so it is discarded along with the older frames of other. After
+ * maxRejections in a row the cameras are taken to be out of phase and the closest frames are paired until
+ * a pair is within the maximum skew again, both changes are reported.
+ */
+bool stereopairer::tryMatch(capturethread& ref, capturethread& other, bool refIsLeft,
+                            frameref& frameLeft, frameref& frameRight, double& skew)
+{
+    unsigned int nref = ref.getQueueDepth();
+    unsigned int nother = other.getQueueDepth();
+    double tref = ref.peekTimestamp(nref - 1);
+    unsigned int best = 0;
+    double bestSkew = other.peekTimestamp(0) - tref;
+    for(unsigned int i = 1; i < nother; i++){
+        double s = other.peekTimestamp(i) - tref;
+        if(fabs(s) < fabs(bestSkew)){
+            best = i;
+            bestSkew = s;
+        }
+    }
+    if(fabs(bestSkew) > maxSkewMs && !overSkew && ++rejectedInRow >= maxRejections){
+        overSkew = true;
+        std::cout<<"stereo pairing: "<<rejectedInRow<<" pairs in a row over "<<maxSkewMs<<" ms ("<<rejected
+                 <<" rejected in all), pairing the closest frames, skew "<<fabs(bestSkew)<<" ms"<<std::endl;
+    }
+    else if(fabs(bestSkew) <= maxSkewMs && overSkew){
+        overSkew = false;
+        std::cout<<"stereo pairing: skew back within "<<maxSkewMs<<" ms after "<<overSkewPairs
+                 <<" pairs over it in all"<<std::endl;
+    }
+    if(fabs(bestSkew) > maxSkewMs && !overSkew){
+        rejected++;
+        ref.discardFrames(nref);
+        // frames of other older than the reference frame can only get further from the next one
+        unsigned int older = 0;
+        while(older < nother && other.peekTimestamp(older) < tref){
+            older++;
+        }
+        other.discardFrames(older);
+        return false;
+    }
+    unsigned long fleft,fright;
+    if(refIsLeft){
+        fleft = ref.takeFrame(nref - 1, frameLeft);
+        fright = other.takeFrame(best, frameRight);
+    }
+    else{
+        fright = ref.takeFrame(nref - 1, frameRight);
+        fleft = other.takeFrame(best, frameLeft);
+    }
+    double tleft = frameLeft.timestamp();
+    double tright = frameRight.timestamp();
+    skew = tright - tleft;
+    double abskew = fabs(skew);
+    pairs++;
+    if(abskew > maxSkewMs){
+        overSkewPairs++;
+    }
+    else{
+        rejectedInRow = 0;
+    }
+    skewSum += abskew;
+    skewSumSq += abskew * abskew;
+    if(abskew > skewMax){
+        skewMax = abskew;
+    }
+    if(skewlog.is_open()){
+        skewlog<<fleft<<","<<fright<<","<<tleft<<","<<tright<<","<<skew<<"\n";
+    }
+    return true;
+}
+
+void stereopairer::printStats()
+{
+    double mean = pairs > 0 ? skewSum / pairs : 0;
+    double sd = pairs > 0 ? sqrt(std::max(0.0, skewSumSq / pairs - mean * mean)) : 0;
+    std::stringstream ss;
+    ss<<"stereo pairs \t"<<pairs<<"\n";
+    ss<<"rejected (skew > "<<maxSkewMs<<" ms) \t"<<rejected<<"\n";
+    ss<<"paired over the skew (after "<<maxRejections<<" rejected in a row) \t"<<overSkewPairs<<"\n";
+    ss<<"skew mean / sd / max (ms) \t"<<mean<<" / "<<sd<<" / "<<skewMax<<"\n";
+    std::cout<<ss.str();
+    if(skewlog.is_open()){
+        std::string line;
+        while(std::getline(ss, line)){
+            skewlog<<"# "<<line<<"\n";
+        }
+        skewlog.flush();
+    }
+}
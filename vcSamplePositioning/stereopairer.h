@@ -0,0 +1,88 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STEREOPAIRER_H
+#define STEREOPAIRER_H
+
+#include <fstream>
+#include <string>
+#include "capturethread.h"
+
+/*!
+ * \brief Pairs the frames of two capture threads by capture time for the stereo tracker.
+ *
+ * The newest frame of the camera that is behind is matched with the closest frame of the other
+ * camera. Pairs further apart than the maximum skew are not returned, the older frame is
+ * discarded and the next one is tried. The cameras are free running, when their phase keeps every
+ * pair above the maximum skew the closest pairs are returned anyway after a number of rejections in a
+ * row, until a pair is within the maximum skew again.
+ */
+class stereopairer
+{
+public:
+  /*!
+  * \brief Constructor.
+  * \param[in] left capture thread of the first camera of the tracker.
+  * \param[in] right capture thread of the second camera of the tracker.
+  * \param[in] maxSkewMs largest accepted difference between the two capture times.
+  */
+  stereopairer(capturethread& left, capturethread& right, double maxSkewMs = 20);
+  ~stereopairer();
+  void setMaxSkew(double ms){maxSkewMs = ms;}
+  double getMaxSkew() const {return maxSkewMs;}
+  /*!
+  * \brief Consecutive rejected pairs after which the closest pairs are returned whatever their skew.
+  */
+  void setMaxRejections(unsigned int n){maxRejections = n < 1 ? 1 : n;}
+  /*!
+  * \brief Write the skew of every returned pair to the given csv file.
+  */
+  void openSkewLog(std::string filename);
+  /*!
+  * \brief Wait for the closest matching pair within the maximum skew, or the closest pair once too many
+  * were rejected in a row, and copy it out. Throws if one of the capture threads stops.
+  * \param[out] Ileft image of the first camera.
+  * \param[out] Iright image of the second camera.
+  * \return the skew of the pair in ms, right minus left.
+  */
+  double getPair(vpImage<unsigned char>& Ileft, vpImage<unsigned char>& Iright);
+  /*!
+  * \brief Same as getPair without copying, the frames stay out of their pools while referenced.
+  */
+  double getPair(frameref& left, frameref& right);
+  /*!
+  * \brief Print the skew statistics of the run, also appended to the skew log if one is open.
+  */
+  void printStats();
+
+private:
+  bool tryMatch(capturethread& ref, capturethread& other, bool refIsLeft,
+                frameref& frameLeft, frameref& frameRight, double& skew);
+  capturethread& left;
+  capturethread& right;
+  double maxSkewMs;
+  unsigned int maxRejections;
+  //pairs rejected since the last one returned, and the closest pairs are returned whatever their skew
+  unsigned int rejectedInRow;
+  bool overSkew;
+  std::ofstream skewlog;
+  // statistics on the absolute skew of the returned pairs
+  unsigned long pairs, rejected, overSkewPairs;
+  double skewSum, skewSumSq, skewMax;
+};
+
+#endif // STEREOPAIRER_H
@@ -0,0 +1,116 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "thordrive.h"
+#include <pty.h>
+#include <poll.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//polls the status of the BSC203 bays through a pseudo terminal answered by a fake controller and checks that the
+//resident memory does not grow with the number of messages, receiving must not allocate per reply
+//arguments: the number of polls, 1000000 by default
+
+static long rssKb()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)){
+        if(line.compare(0, 6, "VmRSS:") == 0){
+            return atol(line.c_str() + 6);
+        }
+    }
+    return -1;
+}
+
+//answers every 6 byte request with a MOT_GET_STATUSUPDATE of the bay it was sent to, the position moving on
+//each time
+static void fakeController(int fd, std::atomic<bool>& stop)
+{
+    unsigned char in[256];
+    std::vector<unsigned char> pending;
+    int32_t position = 0;
+    while(!stop){
+        pollfd p;
+        p.fd = fd;
+        p.events = POLLIN;
+        if(poll(&p, 1, 100) <= 0){
+            continue;
+        }
+        ssize_t n = read(fd, in, sizeof(in));
+        if(n <= 0){
+            continue;
+        }
+        pending.insert(pending.end(), in, in + n);
+        while(pending.size() >= 6){
+            unsigned char reply[20] = {0x81, 0x04, 14, 0x00, 0x81, pending[4], 0x01, 0x00};
+            position -= 100;
+            memcpy(reply + 8, &position, 4);
+            reply[16] = 0x10;
+            pending.erase(pending.begin(), pending.begin() + 6);
+            if(write(fd, reply, sizeof(reply)) != (ssize_t)sizeof(reply)){
+                std::cout<<"fake controller could not reply"<<std::endl;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    long polls = argc > 1 ? atol(argv[1]) : 1000000;
+    int master, slave;
+    char name[256];
+    termios raw;
+    cfmakeraw(&raw);
+    if(openpty(&master, &slave, name, &raw, NULL) != 0){
+        perror("openpty");
+        return 1;
+    }
+    std::atomic<bool> stop(false);
+    std::thread controller(fakeController, master, std::ref(stop));
+    long warm, end;
+    {
+        thordrive drive;
+        drive.setIsTDC(false);
+        drive.openConnector(name);
+        //the first replies size the port and the allocator, growth is counted from here
+        long warmup = polls < 10000 ? polls / 10 : 10000;
+        long i = 0;
+        for(; i < warmup; i++){
+            drive.getStatusUpdates(i % 2 ? 0x21 : 0x22, 0x01);
+        }
+        warm = rssKb();
+        for(; i < polls; i++){
+            drive.getStatusUpdates(i % 2 ? 0x21 : 0x22, 0x01);
+        }
+        end = rssKb();
+        drive.printPortStats();
+    }
+    stop = true;
+    controller.join();
+    close(slave);
+    close(master);
+    std::cout<<polls<<" polls, resident kB after warm up "<<warm<<", at the end "<<end<<std::endl;
+    //a few pages of slack for the output streams
+    return end - warm <= 256 ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "capturethread.h"
+#include "stagequeue.h"
+#include "vpSimulatedFrameGrabber.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+
+//captures frames rendered by the simulated grabber and passes them through the stages the way the tracking loop
+//does: taken by reference, copied out and handed to a writer thread through a stage queue. Every heap allocation of
+//the process is counted, except the ones of the renderer standing in for the camera, and once warmed up none may be
+//made while the frames cycle.
+//arguments: the config directory of the repository and the number of frames, 500 by default
+
+static std::atomic<unsigned long> heapAllocations(0);
+//set while the simulated camera renders, its matrix temporaries are not part of the pipeline
+static thread_local bool rendering = false;
+
+void* operator new(std::size_t size)
+{
+    if(!rendering){
+        heapAllocations++;
+    }
+    void* p = malloc(size == 0 ? 1 : size);
+    if(p == NULL){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    free(p);
+}
+
+class renderinggrabber : public vpFrameGrabber
+{
+public:
+  explicit renderinggrabber(vpSimulatedFrameGrabber& camera) : camera(camera){}
+  void open(vpImage<unsigned char>& I){camera.open(I);}
+  void open(vpImage<vpRGBa>& I){camera.open(I);}
+  void acquire(vpImage<unsigned char>& I)
+  {
+      rendering = true;
+      camera.acquire(I);
+      rendering = false;
+  }
+  void acquire(vpImage<vpRGBa>& I)
+  {
+      rendering = true;
+      camera.acquire(I);
+      rendering = false;
+  }
+  void close(){camera.close();}
+
+private:
+  vpSimulatedFrameGrabber& camera;
+};
+
+//what the writer stage is given, as the persist jobs of the tracking loop
+struct writejob
+{
+    frameref frame;
+    unsigned long frameNumber;
+};
+
+int main(int argc, char** argv)
+{
+    std::string config = argc > 1 ? argv[1] : "config";
+    unsigned int frames = argc > 2 ? (unsigned int)atoi(argv[2]) : 500;
+    vpSimulatedFrameGrabber camera;
+    if(!camera.setScene(config + "/model/sampleholder-march17.cao", config + "/cam_settings/2016-03/camera2160.xml",
+                        config + "/init_files/cam2_i7HM.txt")){
+        return 1;
+    }
+    renderinggrabber grabber(camera);
+    vpImage<unsigned char> I;
+    grabber.open(I);
+    capturethread capture(grabber, "simulated");
+    capture.start(I.getHeight(), I.getWidth());
+    stagequeue<writejob> writeQueue("write", 4, stagequeue<writejob>::DROP_OLDEST);
+    //the writer reads each frame it is handed and releases it
+    std::atomic<unsigned long> written(0);
+    std::thread writer([&](){
+        unsigned long sum = 0;
+        while(writejob* job = writeQueue.beginPop()){
+            const vpImage<unsigned char>& frame = job->frame.image();
+            sum += frame.bitmap[frame.getSize() / 2];
+            job->frame.release();
+            writeQueue.endPop();
+            written++;
+        }
+        std::cout<<"written frames checksum "<<sum<<std::endl;
+    });
+    double timestamp;
+    frameref frame;
+    unsigned long allocations = 0;
+    //the first frames size the consumer side copy and warm up the queues
+    for(unsigned int i = 0; i < frames + 10; i++){
+        if(i == 10){
+            allocations = heapAllocations.load();
+        }
+        unsigned long number = capture.getLatest(frame);
+        frame.copyTo(I);
+        if(writejob* job = writeQueue.beginPush()){
+            job->frame = frame;
+            job->frameNumber = number;
+            writeQueue.commitPush();
+        }
+        frame.release();
+        if(i % 2 == 1){
+            capture.getLatest(I, timestamp);
+        }
+    }
+    unsigned long grown = heapAllocations.load() - allocations;
+    writeQueue.close();
+    writer.join();
+    capture.stop();
+    std::cout<<frames<<" frames, "<<capture.getCapturedFrames()<<" captured, "<<written<<" written, "<<grown
+             <<" heap allocations, "<<framepool::getAllocations()<<" pooled buffers"<<std::endl;
+    grabber.close();
+    return grown == 0 ? 0 : 1;
+}
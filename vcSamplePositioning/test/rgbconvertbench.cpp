@@ -0,0 +1,118 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "rgbconvert.h"
+#include <visp/vpImage.h>
+#include <visp/vpImageConvert.h>
+#include <visp/vpRGBa.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+//time per 1600x1200 frame of each conversion kernel the cpu runs, the best of the repeats, and of the conversion
+//the grabber did before the kernels as the baseline: a vpRGBa image made for the frame, filled pixel by pixel and
+//converted with vpImageConvert
+
+static void oldConversion(const std::vector<unsigned char>& rgb, unsigned int height, unsigned int width,
+                          vpImage<unsigned char>& grey)
+{
+    vpImage<vpRGBa> temp(height, width);
+    for(unsigned int y = 0; y < height; y++){
+        for(unsigned int x = 0; x < width; x++){
+            const unsigned char* p = &rgb[3 * (y * width + x)];
+            temp[y][x].R = p[0];
+            temp[y][x].G = p[1];
+            temp[y][x].B = p[2];
+        }
+    }
+    const vpImage<vpRGBa>& t = temp;
+    vpImageConvert::convert(t, grey);
+}
+
+static double oldBestMs(const std::vector<unsigned char>& rgb, unsigned int height, unsigned int width, int repeats)
+{
+    vpImage<unsigned char> grey(height, width);
+    double best = 1e9;
+    for(int r = 0; r < repeats; r++){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        oldConversion(rgb, height, width, grey);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(ms < best){
+            best = ms;
+        }
+    }
+    return best;
+}
+
+static double bestMs(rgbconvert::kernel k, bool grey, const std::vector<unsigned char>& rgb, std::vector<unsigned char>& out,
+                     unsigned int size, int repeats)
+{
+    double best = 1e9;
+    for(int r = 0; r < repeats; r++){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if(grey){
+            rgbconvert::toGrey(k, &rgb[0], &out[0], size);
+        }
+        else{
+            rgbconvert::toRGBa(k, &rgb[0], &out[0], size);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(ms < best){
+            best = ms;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int width = 1600, height = 1200, size = width * height;
+    int repeats = argc > 1 ? atoi(argv[1]) : 50;
+    std::vector<unsigned char> rgb(3 * size), out(4 * size);
+    for(unsigned int i = 0; i < 3 * size; i++){
+        rgb[i] = (unsigned char)(i * 2654435761u >> 24);
+    }
+    const rgbconvert::kernel kernels[] = {rgbconvert::SCALAR, rgbconvert::SSE41, rgbconvert::AVX2, rgbconvert::SSSE3};
+    const char* names[] = {"scalar", "sse4.1", "avx2", "ssse3"};
+    const bool grey[] = {true, true, true, false};
+    std::cout<<width<<"x"<<height<<" frame, best of "<<repeats<<std::endl;
+    double before = oldBestMs(rgb, height, width, repeats);
+    std::cout<<"vpRGBa + vpImageConvert to grey (before) \t"<<before<<" ms"<<std::endl;
+    for(unsigned int i = 0; i < 4; i++){
+        if(!rgbconvert::isSupported(kernels[i])){
+            continue;
+        }
+        if(grey[i]){
+            std::cout<<names[i]<<" to grey \t"<<bestMs(kernels[i], true, rgb, out, size, repeats)<<" ms"<<std::endl;
+        }
+        if(!grey[i] || kernels[i] == rgbconvert::SCALAR){
+            std::cout<<names[i]<<" to rgba \t"<<bestMs(kernels[i], false, rgb, out, size, repeats)<<" ms"<<std::endl;
+        }
+    }
+    double after = 1e9;
+    for(int r = 0; r < repeats; r++){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        rgbconvert::toGrey(&rgb[0], &out[0], size);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(ms < after){
+            after = ms;
+        }
+    }
+    std::cout<<"frames/s before \t"<<1000.0 / before<<std::endl;
+    std::cout<<"frames/s after, "<<rgbconvert::getKernelName()<<" kernel \t"<<1000.0 / after<<std::endl;
+    return 0;
+}
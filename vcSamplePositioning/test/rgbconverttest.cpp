@@ -0,0 +1,143 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "rgbconvert.h"
+#include <visp/vpImage.h>
+#include <visp/vpImageConvert.h>
+#include <visp/vpRGBa.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//checks the scalar and the selected kernels against the conversion the grabber did before them: each pixel
+//copied into a vpRGBa image, then vpImageConvert to grey levels. Every vector kernel the cpu runs is also
+//compared with the scalar one, for every value of each component, at every length up to 64 pixels so the
+//scalar tail is covered, and from unaligned starts
+
+static void fillPattern(std::vector<unsigned char>& rgb, unsigned int size)
+{
+    rgb.resize(3 * size + 64);
+    for(unsigned int i = 0; i < size; i++){
+        rgb[3 * i] = (unsigned char)i;
+        rgb[3 * i + 1] = (unsigned char)(i * 7 + i / 256);
+        rgb[3 * i + 2] = (unsigned char)(i * 13 + 2 * (i / 256));
+    }
+}
+
+static bool checkGrey(rgbconvert::kernel k, const char* name, const std::vector<unsigned char>& rgb, unsigned int size)
+{
+    for(unsigned int offset = 0; offset < 4; offset++){
+        for(unsigned int n = 0; n + offset <= size; n = n < 64 ? n + 1 : size - offset){
+            std::vector<unsigned char> expected(n + 1, 0xA5), actual(n + 1, 0xA5);
+            rgbconvert::toGrey(rgbconvert::SCALAR, &rgb[3 * offset], &expected[0], n);
+            rgbconvert::toGrey(k, &rgb[3 * offset], &actual[0], n);
+            if(expected != actual){
+                std::cout<<name<<" grey conversion of "<<n<<" pixels from pixel "<<offset<<" differs"<<std::endl;
+                return false;
+            }
+            if(n == size - offset){
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+static bool checkRGBa(rgbconvert::kernel k, const char* name, const std::vector<unsigned char>& rgb, unsigned int size)
+{
+    for(unsigned int offset = 0; offset < 4; offset++){
+        for(unsigned int n = 0; n + offset <= size; n = n < 64 ? n + 1 : size - offset){
+            std::vector<unsigned char> expected(4 * n + 4, 0xA5), actual(4 * n + 4, 0xA5);
+            rgbconvert::toRGBa(rgbconvert::SCALAR, &rgb[3 * offset], &expected[0], n);
+            rgbconvert::toRGBa(k, &rgb[3 * offset], &actual[0], n);
+            if(expected != actual){
+                std::cout<<name<<" rgba conversion of "<<n<<" pixels from pixel "<<offset<<" differs"<<std::endl;
+                return false;
+            }
+            if(n == size - offset){
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+//the conversion of the grabber before the kernels, a vpRGBa image filled pixel by pixel
+static void oldConversion(const std::vector<unsigned char>& rgb, unsigned int size, vpImage<vpRGBa>& rgba,
+                          vpImage<unsigned char>& grey)
+{
+    rgba.resize(1, size);
+    for(unsigned int i = 0; i < size; i++){
+        rgba[0][i].R = rgb[3 * i];
+        rgba[0][i].G = rgb[3 * i + 1];
+        rgba[0][i].B = rgb[3 * i + 2];
+    }
+    const vpImage<vpRGBa>& t = rgba;
+    vpImageConvert::convert(t, grey);
+}
+
+static bool checkOld(const char* name, const std::vector<unsigned char>& grey, const std::vector<unsigned char>& rgba,
+                     const vpImage<unsigned char>& oldGrey, const vpImage<vpRGBa>& oldRGBa, unsigned int size)
+{
+    bool same = true;
+    if(memcmp(&grey[0], oldGrey.bitmap, size) != 0){
+        std::cout<<name<<" grey conversion differs from vpImageConvert"<<std::endl;
+        same = false;
+    }
+    if(memcmp(&rgba[0], oldRGBa.bitmap, 4 * size) != 0){
+        std::cout<<name<<" rgba conversion differs from the vpRGBa image"<<std::endl;
+        same = false;
+    }
+    return same;
+}
+
+int main()
+{
+    const unsigned int size = 256 * 256 + 3;
+    std::vector<unsigned char> rgb;
+    fillPattern(rgb, size);
+    bool passed = true;
+    const rgbconvert::kernel grey[] = {rgbconvert::SSE41, rgbconvert::AVX2};
+    const char* greyNames[] = {"sse4.1", "avx2"};
+    for(unsigned int i = 0; i < 2; i++){
+        if(!rgbconvert::isSupported(grey[i])){
+            std::cout<<greyNames[i]<<" not supported, not checked"<<std::endl;
+            continue;
+        }
+        passed = checkGrey(grey[i], greyNames[i], rgb, size) && passed;
+    }
+    if(rgbconvert::isSupported(rgbconvert::SSSE3)){
+        passed = checkRGBa(rgbconvert::SSSE3, "ssse3", rgb, size) && passed;
+    }
+    else{
+        std::cout<<"ssse3 not supported, not checked"<<std::endl;
+    }
+    //the scalar kernel and the kernels the grabbers use against the conversion before them
+    vpImage<vpRGBa> oldRGBa;
+    vpImage<unsigned char> oldGrey;
+    oldConversion(rgb, size, oldRGBa, oldGrey);
+    std::vector<unsigned char> greyOut(size), rgbaOut(4 * size);
+    rgbconvert::toGrey(rgbconvert::SCALAR, &rgb[0], &greyOut[0], size);
+    rgbconvert::toRGBa(rgbconvert::SCALAR, &rgb[0], &rgbaOut[0], size);
+    passed = checkOld("scalar", greyOut, rgbaOut, oldGrey, oldRGBa, size) && passed;
+    rgbconvert::toGrey(&rgb[0], &greyOut[0], size);
+    rgbconvert::toRGBa(&rgb[0], &rgbaOut[0], size);
+    std::string selected = "selected kernel " + rgbconvert::getKernelName();
+    passed = checkOld(selected.c_str(), greyOut, rgbaOut, oldGrey, oldRGBa, size) && passed;
+    std::cout<<(passed ? "rgb conversion kernels bit exact" : "rgb conversion kernels FAILED")<<std::endl;
+    return passed ? 0 : 1;
+}
@@ -20,6 +20,7 @@
 #include <boost/concept_check.hpp>
 #include <math.h>
 
+#include <algorithm>
 #include <iomanip>
 /*&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&
 
@@ -32,9 +33,11 @@
 /******************************************************************************************************************************************
  ********************************************************GENERAL FUNCTIONS*****************************************************************
  ****************************************************************************************************************************************/
-thordrive::thordrive(bool is_tdc)
+thordrive::thordrive(bool is_tdc) :
+  lastSent(0), lastMove(0), bufLength(0), streaming(false), trace(NULL), traceSpan(0)
 {
   tdc = is_tdc;
+  clearPushedStatus();
   const char* usbportstring;
   if(is_tdc){
     usbportstring = "/dev/serial/by-id/usb-Thorlabs_APT_DC_Motor_Controller_83861422-if00-port0";
@@ -69,15 +72,6 @@ void thordrive::setActiveDrive(unsigned char drive)
 }
 
 
-void thordrive::releaseBufferMemory()
-{
-  delete buf;
-}
-void thordrive::releasesignedBufferMemory()
-{
-  delete signed_buf;
-}
-
 /******************************************************************************************************************************************
  ********************************************************COMMS FUNCTIONS*****************************************************************
  ****************************************************************************************************************************************/
@@ -86,8 +80,6 @@ void thordrive::releasesignedBufferMemory()
  */
 void thordrive::openConnector(const char* usbport)
 {
-    FD_ZERO(&readSet);
-
     //open the port
     USB = open( usbport, O_RDWR | O_SYNC/*, S_IRUSR | S_IWUSR*/ /*O_RDWR| O_NOCTTY*/ );
 
@@ -104,218 +96,81 @@ void thordrive::openConnector(const char* usbport)
       perror("openConnector()");
       exit(1);
     }
-
-    FD_SET(USB,&readSet);
+    //error reports the controller sends on its own are shown when they come, not left for a poll to find
+    port.setHandler(0x0080, [](const aptmessage& m){
+      std::cout<<"APT controller 0x"<<std::hex<<(int)m.source()<<std::dec<<" reports an error"<<std::endl;
+    });
+    port.setHandler(0x0081, [](const aptmessage& m){
+      if(m.length < 74){
+        return;
+      }
+      uint16_t code = m.data[8] | (m.data[9] << 8);
+      const char* text = reinterpret_cast<const char*>(m.data + 10);
+      std::string notes(text, strnlen(text, 64));
+      std::cout<<"APT controller 0x"<<std::hex<<(int)m.source()<<" message 0x"<<(m.data[6] | (m.data[7] << 8))
+               <<std::dec<<" code "<<code<<": "<<notes<<std::endl;
+    });
+    //status updates, asked for or pushed, and the status a finished move carries are kept as the latest of
+    //their channel
+    aptport::handler keep = [this](const aptmessage& m){keepPushedStatus(m);};
+    port.setHandler(0x0481, keep);//MOT_GET_STATUSUPDATE
+    port.setHandler(0x0491, keep);//MOT_GET_DCSTATUSUPDATE
+    port.setHandler(0x0464, keep);//MOT_MOVE_COMPLETED
+    port.setHandler(0x0466, keep);//MOT_MOVE_STOPPED
+    //from here on everything the controller sends is read and framed by the port reader thread
+    port.open(USB, tdc ? "tdc" : "bsc");
 }
 
 /**
  * writes to the serial port
  */
 void thordrive::sendByteCommand(unsigned char* cmd,int len){
-  //tcflush( USB, TCOFLUSH );
-  //tcflush( USB, TCIFLUSH ); //flush anything not read by us
-  //std::cout<<"SEND BYTE COMMAND: SENDING  " << std::dec << len <<" BYTES" <<std::endl;
-  int n_written = 0;
-  if(USB > 0){
-      n_written = write( USB, cmd, len);
-      if (n_written == -1){
-        perror("sendByteCommand() (write())");
-      }
-      else if (n_written != len){
-        std::cout << "Only written " << std::dec << n_written << " when " << len << " was exptected\n";
-        std::cout<<"   number of written bytes is " << std::dec << n_written<<std::endl;
-      }
-
+  double sent = port.send(cmd, len);
+  if(sent < 0){
+    std::cout << "sendByteCommand() could not write " << std::dec << len << " bytes\n";
+  }
+  else{
+    lastSent = sent;
   }
-
 }
 
 /**
  * writes signed data to the serial port
  */
 void thordrive::sendSignedByteCommand(signed char* cmd,int len){
-  //tcflush( USB, TCOFLUSH );
-  //tcflush( USB, TCIFLUSH ); //flush anything not read by us
   std::cout<<"SEND BYTE COMMAND: SENDING  " << std::dec << len <<" BYTES" <<std::endl;
-  int n_written = 0;
-  if(USB > 0){
-      n_written = write( USB, cmd, len);
-      if (n_written == -1){
-        perror("sendByteCommand() (write())");
-      }
-      else if (n_written != len){
-        std::cout << "Only written " << std::dec << n_written << " when " << len << " was exptected\n";
-        std::cout<<"   number of written bytes is " << std::dec << n_written<<std::endl;
-      }
+  double sent = port.send(reinterpret_cast<unsigned char*>(cmd), len);
+  if(sent < 0){
+    std::cout << "sendSignedByteCommand() could not write " << std::dec << len << " bytes\n";
+  }
+  else{
+    lastSent = sent;
   }
-
 }
-/*
- * reads data from the port for status messages when moving - position values will be negative
+/* reads the reply to the last command sent from the port
+ *
  */
-void thordrive::receiveSignedData(time_t timeout){
-
-    tcflush( USB, TCIOFLUSH );
-    //tcflush( USB, TCIFLUSH );
-    //std::cout<<" In Receive signed data and buff size is "<< buffSize <<std::endl;
-    int n = 0;//number of bytes read from read()
-    // b = the number of bytes to read in one go from the stream
-    int b = buffSize, bytesRead = 0;
-    //char datbuf = '\0';
-    int b2read = buffSize;//header has 6 bytes
-    //allocate some memory for buffer based on previously set command and thus buffer size
-    //not sure if this is necessary
-    signed_buf = new signed char[buffSize];
-    struct timeval tv;
-
-    /* Whole response*/
-    memset(signed_buf, 0, buffSize);
-    //read one byte at a time, could also read full buffer in one go? ask fred which is better
-    // check if data is available to read
-     // timeout struct
-    tv.tv_sec = timeout;
-    tv.tv_usec = 0;
-    //std::cout <<" about to use select method and bytes to read are "<<b2read<<std::endl;
-    while(b2read >0){
-      int result = select(USB + 1, &readSet,NULL,NULL,&tv);
-      //std::cout <<" select returned "<<result<<std::endl;
-      if(result == -1){
-               perror("receiveData() (select())");
-           exit(1);
-      }
-      else if(result > 0 && FD_ISSET(USB,&readSet)){
-    n = read( USB, &(signed_buf[bytesRead]), b2read );
-    if (n == -1) {
-      perror("receiveData() (read())");
-    }
-    bytesRead +=n;
-    b2read = buffSize - bytesRead;
-      }
-      else{
-    // in this case the select has timmed output
-    std::cout<<"READ OPERATION COULD NOT BE PERFORMED BECAUSE THE OPERATION TIMED OUT "<<std::endl;
-    break;
-      }
-    }
-    //std::cout << "Raw data: ";
-    /*for (int i= 0 ;i<buffSize; i++){
-      std::cout << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(signed_buf[i]);
+void thordrive::receiveData(unsigned char expected_command[],time_t timeout){
+    uint16_t id = expected_command[0] | (expected_command[1] << 8);
+    if(!takeMessage(id, 0, lastSent, timeout * 1000.0)){
+      std::cout<<"READ OPERATION COULD NOT BE PERFORMED BECAUSE THE OPERATION TIMED OUT "<<std::endl;
     }
-    std::cout<<std::endl;*/
-
 }
 
-/* reads data from the port
- *
+/*
+ * copies a message framed by the port reader into the response buffer, received since the given time and
+ * from the given source (0 any), the buffer is left zeroed when it does not come in time
  */
-void thordrive::receiveData(unsigned char expected_command[],time_t timeout){
-    tcflush( USB, TCIOFLUSH );
-    //tcflush( USB, TCIFLUSH );
-    //std::cout<<" In Receive data and buff size is "<< buffSize <<std::endl;
-    int n = 0;//number of bytes read from read()
-    //index = 0;
-    // b = the number of bytes to read in one go from the stream
-    int bytesRead = 0;
-    //char datbuf = '\0';
-    int b2read = buffSize;//header has 6 bytes
-    //allocate some memory for buffer based on previously set command and thus buffer size
-    //not sure if this is necessary
-    buf = new unsigned char[buffSize];
-    struct timeval tv;
-    bool cont = false;
-    /* Whole response*/
-    memset(buf, 0, buffSize);
-    //read one byte at a time, could also read full buffer in one go? ask fred which is better
-    // check if data is available to read
-     // timeout struct
-    tv.tv_sec = timeout;
-    tv.tv_usec = 0;
-    //std::cout <<" about to use select method and bytes to read are "<<b2read<<std::endl;
-    while(b2read >0){
-      int result = select(USB + 1, &readSet,NULL,NULL,&tv);
-      //std::cout <<" select returned "<<result<<std::endl;
-      if(result == -1){
-               perror("receiveData() (select())");
-           exit(1);
-      }
-      else if(result > 0 && FD_ISSET(USB,&readSet)){
-    n = read( USB, &(buf[bytesRead]), b2read );
-    //std::cout<<"The read got this amoutn of bytes : "<<n<<"\n";
-    if (n == -1) {
-      perror("receiveData() (read())");
-    }
-    else if((n >= 2) & (!cont)){
-      if((buf[0]== expected_command[0] ) & (buf[1] == expected_command[1])){
-        cont = true;
-        bytesRead +=n;
-        b2read = buffSize - bytesRead;
-       // std::cout <<" 1 bytes to read are now  "<<b2read<<std::endl;
-      }
-      else{
-        /*for (int i= 0 ;i<buffSize; i++){
-          std::cout << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(buf[i]);
-        }
-        std::cout<<std::endl;*/
-        //how many bytes have been read
-        int size = bytesRead + n; //this should be the size of the
-        if(size == 2){
-          //simple case - not the first two bytes of expected command so just reset the bytesRead variable back to 0
-          //this will overwrite the first two values with new data
-          bytesRead = 0;
-          b2read = buffSize;
-        }
-        else{
-          int start_pos, num_toshift;
-          bool matched = false;
-          //this is more complicated because any of the following bytes could be the start of the command so need to identify which are and
-          //how far in or how much to shift by.
-          //start at 1 because we have already checked that the first two bytes are not the expected command
-          for(int i = 0; i < size; i++){
-        //std::cout <<"in loop "<<i<<std::endl;
-        //std::cout <<"buf element is "<<static_cast<int>(buf[i])<<std::endl;
-        //std::cout <<"command element is "<<static_cast<int>(expected_command[0])<<static_cast<int>(expected_command[1])<<std::endl;
-        if(buf[i] == expected_command[0]){
-          if((i +1)< size ){ //check not out of bounds
-            if(buf[i+1] == expected_command[1]){
-              //both match the expected command
-              start_pos = i;
-              num_toshift = buffSize - start_pos;
-              matched = true;
-              break;
-            }// array in bounds but no match just continue
-          }// out of bounds of array - only the first element of a possible match exists just continue -
-          //read once more and return to evaluation
-        }// i does not match first byte, just continue onto next element
-          }
-          if(matched){ //shift the read bytes to front od array;
-        for(int i = 0; i < num_toshift; i++){
-          buf[i] = buf[start_pos+i];
-          bytesRead = i+1;
-        }
-
-        b2read = buffSize - bytesRead;
-        cont = true;
-          }
-        }
-      }
-    }
-    else{
-      bytesRead +=n;
-      b2read = buffSize - bytesRead;
-    }
-      }
-      else{
-    // in this case the select has timmed output
-    std::cout<<"READ OPERATION COULD NOT BE PERFORMED BECAUSE THE OPERATION TIMED OUT "<<std::endl;
-    break;
-      }
-    }
-    /**std::cout << "Raw data: ";
-    for (int i= 0 ;i<buffSize; i++){
-      std::cout << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(buf[i]);
+bool thordrive::takeMessage(uint16_t id, unsigned char source, double since, double timeoutMs){
+    memset(buf, 0, sizeof(buf));
+    bufLength = 0;
+    aptmessage m;
+    if(!port.receive(id, source, since, timeoutMs, m)){
+      return false;
     }
-    std::cout<<std::endl;*/
-
+    memcpy(buf, m.data, m.length);
+    bufLength = m.length;
+    return true;
 }
 
 /*************************************************************************************************************************************
@@ -973,20 +828,21 @@ void thordrive::getStatusUpdates()
   int chan;
   double scaled_position;
   int32_t signed_pos;
-  chan = (int)buf[6];
+  aptspan reply(buf, bufLength);
+  chan = (int)reply.u8(6);
   if(!homing){
     //std::cout<<"not homing\t"<<std::endl;
-    signed_pos = static_cast<int32_t>(buf[8])+ static_cast<int32_t>(buf[9]<<8) + static_cast<int32_t>(buf[10]<<16)+ static_cast<int32_t>(buf[11]<<24);
+    signed_pos = reply.i32(8);
     scaled_position = double(signed_pos) / 409600.0;
     position = signed_pos;
   }
   else{
-    unsigned_pos = static_cast<uint32_t>(buf[8])+ static_cast<uint32_t>(buf[9]<<8) + static_cast<uint32_t>(buf[10]<<16)+ static_cast<uint32_t>(buf[11]<<24);
+    unsigned_pos = reply.u32(8);
     scaled_position = double(unsigned_pos) / 409600.0;
     position = unsigned_pos;
   }
-  encnt = static_cast<uint32_t>(buf[12])+ static_cast<uint32_t>(buf[13]<<8) + static_cast<uint32_t>(buf[14]<<16)+ static_cast<uint32_t>(buf[15]<<24);
-  statusBits = static_cast<uint32_t>(buf[16])+ static_cast<uint32_t>(buf[17]<<8) + static_cast<uint32_t>(buf[18]<<16)+ static_cast<uint32_t>(buf[19]<<24);
+  encnt = reply.u32(12);
+  statusBits = reply.u32(16);
 
 
   homed = statusBits & 0x00000400;
@@ -1022,11 +878,11 @@ void thordrive::getDCStatusUpdates()
   uint16_t velocity;
   int32_t signed_pos;
   int chan;
-  chan = (int)buf[6];
-  signed_pos = static_cast<int32_t>(buf[8])+ static_cast<int32_t>(buf[9]<<8) + static_cast<int32_t>(buf[10]<<16)+ static_cast<int32_t>(buf[11]<<24);
-  //position = static_cast<uint32_t>(buf[8])+ static_cast<uint32_t>(buf[9]<<8) + static_cast<uint32_t>(buf[10]<<16)+ static_cast<uint32_t>(buf[11]<<24);
-  velocity = static_cast<uint16_t>(buf[12])+ static_cast<uint16_t>(buf[13]<<8);
-  statusBits = static_cast<uint32_t>(buf[16])+ static_cast<uint32_t>(buf[17]<<8) + static_cast<uint32_t>(buf[18]<<16)+ static_cast<uint32_t>(buf[19]<<24);
+  aptspan reply(buf, bufLength);
+  chan = (int)reply.u8(6);
+  signed_pos = reply.i32(8);
+  velocity = reply.u16(12);
+  statusBits = reply.u32(16);
   /**std::cout<<"Channel: \t"<<chan<<std::endl;
   std::cout<<"position \t"<<position<<std::endl;
   std::cout<<"velocity \t"<<velocity<<std::endl;*/
@@ -1167,15 +1023,6 @@ void thordrive::getPMDStageAxisParams(){
 /**************************************************************************************************************************************
 **************************************************** PROCESS COMMAND FUNCTIONS ********************************************************
 ***************************************************************************************************************************************/
-/*
- * Processes the signed data recived from statusupdate when moving motors
- * */
-
-void thordrive::processSignedData(){
-  //delete the buffer to free up the memory
-  getStatusUpdates();
-  releasesignedBufferMemory();
-}
 /*
  * reads the header from the buffer and determines what the response command is
  */
@@ -1367,8 +1214,6 @@ void thordrive::processRespose(command_t c)
       std::cout<<" unknown command"<<std::endl;
 
   }
-  //delete the buffer to free up the memory
-  releaseBufferMemory();
 }
 
 /**************************************************************************************************************************************
@@ -1445,6 +1290,29 @@ void thordrive::getByteCommand(command_t c,unsigned char hexcomm[],unsigned char
       setActiveDrive(destination);
       break;
     }
+    case HW_START_UPDATEMSGS:
+    {
+      //the channel pushes its status update about ten times a second from here on
+      hexcomm[0] = 0x11;
+      hexcomm[1] = 0x00;
+      hexcomm[2] = 0x00;
+      hexcomm[3] = 0x00;
+      hexcomm[4] = destination;
+      hexcomm[5] = 0x01;
+      buffSize = 0;
+      break;
+    }
+    case HW_STOP_UPDATEMSGS:
+    {
+      hexcomm[0] = 0x12;
+      hexcomm[1] = 0x00;
+      hexcomm[2] = 0x00;
+      hexcomm[3] = 0x00;
+      hexcomm[4] = destination;
+      hexcomm[5] = 0x01;
+      buffSize = 0;
+      break;
+    }
     case HW_DISCONNECT:
     {
       hexcomm[0] = 0x02;
@@ -1595,6 +1463,18 @@ void thordrive::getByteCommand(command_t c,unsigned char hexcomm[],unsigned char
       buffSize = 20;
       break;
     }
+    case MOT_ACK_DCSTATUSUPDATE:
+    {
+      //server alive - without it at least once a second a usb controller stops pushing its status
+      hexcomm[0] = 0x92;
+      hexcomm[1] = 0x04;
+      hexcomm[2] = 0x00;
+      hexcomm[3] = 0x00;
+      hexcomm[4] = destination;
+      hexcomm[5] = 0x01;
+      buffSize = 0;
+      break;
+    }
     case MOT_MOVE_RELATIVE:
     {
       //here the long version of command is used, data packet must be appended to header; it encodes the new desired relative
@@ -2049,7 +1929,12 @@ void thordrive::setMoveRelParams(unsigned char chan, double distmm, unsigned cha
      command[i] = static_cast<signed char>(comarray[i]);
    }
    encodeMoveParams(command,chan,distmm);
+   double start = tracelog::now();
    sendSignedByteCommand(command,12);
+   lastMove = lastSent;
+   if(trace != NULL){
+     trace->record(traceSpan, start, tracelog::now(), comarray[0] | (comarray[1] << 8), destination);
+   }
 }
 void thordrive::setGenMoveParams(unsigned char chan, unsigned char destination)
 {
@@ -2159,23 +2044,58 @@ void thordrive::setIsTDC(bool isTDC)
 **************************************************** GENERAL GETSTATUS AND INFO FUNCTIONS ****************************************************
 *********************************************************************************************************************************************/
 void thordrive::getStatusUpdates(unsigned char destination, unsigned char chan){
-  unsigned char expected_comm[2];
-  if(tdc){
+    double requested = requestStatusUpdate(destination, chan);
+    if(!waitStatusUpdate(destination, requested, 10000)){
+      std::cout<<"READ OPERATION COULD NOT BE PERFORMED BECAUSE THE OPERATION TIMED OUT "<<std::endl;
+    }
+}
+double thordrive::requestStatusUpdate(unsigned char destination, unsigned char chan){
+    if(tdc){
       control_comm = thordrive::MOT_REQ_DCSTATUSUPDATE;
-      expected_comm[0]= 0x91;
-      expected_comm[1]= 0x04;
     }
     else{
       control_comm = thordrive::MOT_REQ_STATUSUPDATE;
-      expected_comm[0]= 0x81;
-      expected_comm[1]= 0x04;
     }
     unsigned char comarray[6];
     getByteCommand(control_comm, comarray,chan,0x00,destination);
     sendByteCommand(comarray,6);
-    receiveData(expected_comm);
+    return lastSent;
+}
+bool thordrive::waitStatusUpdate(unsigned char destination, double requested, double timeoutMs){
+    //MOT_GET_DCSTATUSUPDATE or MOT_GET_STATUSUPDATE, sent by the channel addressed
+    uint16_t id = tdc ? 0x0491 : 0x0481;
+    if(!takeMessage(id, destination, requested, timeoutMs)){
+      return false;
+    }
+    if(trace != NULL){
+      //request to reply, traced with the id of the request
+      trace->record(traceSpan, requested, tracelog::now(), tdc ? 0x0490 : 0x0480, destination);
+    }
     control_comm = lookupCommand();
     processRespose(control_comm);
+    return true;
+}
+bool thordrive::getStatusUpdates(const unsigned char destinations[], unsigned int count, double timeoutMs){
+    if(count > STATUS_BATCH){
+      count = STATUS_BATCH;
+    }
+    //every request is on the line before the first reply is read
+    double requested[STATUS_BATCH];
+    for(unsigned int i = 0; i < count; i++){
+      requested[i] = requestStatusUpdate(destinations[i], 0x01);
+    }
+    double deadline = aptport::now() + timeoutMs * 1000;
+    bool replied = true;
+    for(unsigned int i = 0; i < count; i++){
+      //the bsc status is decoded into the position of the active drive
+      setActiveDrive(destinations[i]);
+      double left = std::max(0.0, (deadline - aptport::now()) / 1000);
+      if(!waitStatusUpdate(destinations[i], requested[i], left)){
+        std::cout<<"no status from channel 0x"<<std::hex<<(int)destinations[i]<<std::dec<<" in time"<<std::endl;
+        replied = false;
+      }
+    }
+    return replied;
 }
 void thordrive::getInfo(unsigned char destination){
    control_comm = thordrive::HW_REQ_INFO;
@@ -2340,7 +2260,12 @@ void thordrive::moveRelative(unsigned char chan,double distmm,unsigned char dest
     //distmm = convertToAbsolutePosition(distmm,destination);
    }
    encodeMoveParams(command,chan,distmm);
+   double start = tracelog::now();
    sendSignedByteCommand(command,12);
+   lastMove = lastSent;
+   if(trace != NULL){
+     trace->record(traceSpan, start, tracelog::now(), comarray[0] | (comarray[1] << 8), destination);
+   }
 }
 void thordrive::moveAtVelocity(unsigned char chan, double distmm, unsigned char destination, unsigned char direction)
 {
@@ -2384,6 +2309,7 @@ void thordrive::moveAbsolute(signed char chan,double distmm,signed char destinat
    }*/
    encodeMoveParams(command,chan,distmm);
    sendSignedByteCommand(command,12);
+   lastMove = lastSent;
    //ensureMoveCompleted(chan,destination,distmm);
 }
 void thordrive::moveHome(unsigned char chan,unsigned char destination){
@@ -2678,15 +2604,20 @@ bool thordrive::isApproximatelyCompleted(double currentvalue, double desiredvalu
  */
 
 bool thordrive::isDriveMoving(){
+    unsigned char destination = 0;
     if(tdc){
-        getStatusUpdates(0x50,0x01);//desination, channel
+        destination = 0x50;
     }
-    else{
-        if(getActiveDrive() == "x"){
-            getStatusUpdates(0x21,0x01);//desination, channel
-        }
-        else if(getActiveDrive() == "y"){
-            getStatusUpdates(0x22,0x01);//desination, channel
+    else if(getActiveDrive() == "x"){
+        destination = 0x21;
+    }
+    else if(getActiveDrive() == "y"){
+        destination = 0x22;
+    }
+    //a drive that has reported the end of its move is not asked again
+    if(destination != 0 && !takeFinishedMove(destination)){
+        if(!streaming || !waitPushedStatus(destination)){
+            getStatusUpdates(destination,0x01);//desination, channel
         }
     }
 
@@ -2701,42 +2632,201 @@ bool thordrive::isDriveMoving(){
  * @return none
  */
 
-void thordrive::updateDrivePositions(){
-   bool xactive = false, yactive = false;
-   if(tdc){
-       getStatusUpdates(0x50,0x01);//desination, channel
-   }
-   else{
-       // one may be active while the other is not, updates active drive only
-       if(getActiveDrive() == "x"){
-           xactive == true;
+/*
+ * reads the move completed or move stopped message a channel sent since the last move, it carries the status
+ * the drive stopped with so the positions are updated from it
+ */
+bool thordrive::takeFinishedMove(unsigned char destination){
+    bool finished = takeMessage(0x0464, destination, lastMove, 0);//MOT_MOVE_COMPLETED
+    if(!finished){
+        finished = takeMessage(0x0466, destination, lastMove, 0);//MOT_MOVE_STOPPED
+    }
+    if(finished){
+        if(tdc){
+            getDCStatusUpdates();
+        }
+        else{
+            getStatusUpdates();
+        }
+    }
+    return finished;
+}
+/******************************************************************************************************************************************
+ ********************************************************PUSHED STATUS FUNCTIONS***********************************************************
+ ****************************************************************************************************************************************/
+//a pushed status older than two and a half update periods means the channel has stopped pushing
+static const double pushedStaleUs = 250000;
 
-       }
-       else if(getActiveDrive() == "y"){
-           yactive == true;
-       }
-       if(xactive){
-           //get status update, then set y active get update unset y active active
-            getStatusUpdates(0x21,0x01);//desination, channel - x axis
-            setActiveDrive(0x22);
-            getStatusUpdates(0x22,0x01);//desination, channel
-            setActiveDrive(0x21);
-       }
-       if(yactive){
-           //set x active get status update, then set y active get update
-            setActiveDrive(0x21);
-            getStatusUpdates(0x21,0x01);//desination, channel - x axis
-            setActiveDrive(0x22);
-            getStatusUpdates(0x22,0x01);//desination, channel
+/*
+ * the channels the controllers have, a bay of the BSC203 or the TDC001, -1 for any other address
+ */
+static int pushedChannel(unsigned char source){
+  if(source == 0x21){
+    return 0;
+  }
+  else if(source == 0x22){
+    return 1;
+  }
+  else if(source == 0x50){
+    return 2;
+  }
+  return -1;
+}
+
+void thordrive::clearPushedStatus(){
+  std::lock_guard<std::mutex> lk(pushedLock);
+  for(int c = 0; c < STATUS_CHANNELS; c++){
+    pushed[c].message.length = 0;
+    pushed[c].message.time = 0;
+    pushed[c].acked = 0;
+    pushed[c].ackDue = false;
+  }
+}
+
+/*
+ * port reader thread - keeps a status message as the latest of its channel, while the status is pushed the
+ * channel is due to be told the host is still reading every half second. The reader never writes, a full output
+ * buffer would hold up the reading of every message behind it
+ */
+void thordrive::keepPushedStatus(const aptmessage& m){
+  int c = pushedChannel(m.source());
+  if(c < 0){
+    return;
+  }
+  std::lock_guard<std::mutex> lk(pushedLock);
+  pushed[c].message = m;
+  if(streaming && m.time - pushed[c].acked >= 500000){
+    pushed[c].acked = m.time;
+    pushed[c].ackDue = true;
+  }
+}
 
+/*
+ * decodes the latest status of a channel into the positions and motion, false if none has come since the
+ * given time. An ack the channel is due is written here, on the thread driving the controller
+ */
+bool thordrive::readPushedStatus(unsigned char destination, double since){
+  int c = pushedChannel(destination);
+  if(c < 0){
+    return false;
+  }
+  bool ack, fresh;
+  {
+    std::lock_guard<std::mutex> lk(pushedLock);
+    ack = pushed[c].ackDue;
+    pushed[c].ackDue = false;
+    const aptmessage& m = pushed[c].message;
+    fresh = m.length > 0 && m.time >= since;
+    if(fresh){
+      memcpy(buf, m.data, m.length);
+      bufLength = m.length;
+    }
+  }
+  if(ack){
+    unsigned char comarray[6];
+    getByteCommand(MOT_ACK_DCSTATUSUPDATE, comarray, 0x00, 0x00, destination);
+    sendByteCommand(comarray,6);
+  }
+  if(!fresh){
+    return false;
+  }
+  if(tdc){
+    getDCStatusUpdates();
+  }
+  else{
+    getStatusUpdates();
+  }
+  return true;
+}
+
+/*
+ * the motion of a channel is only known from a status it sent after the last move, the next one pushed is
+ * waited for when the latest is older
+ */
+bool thordrive::waitPushedStatus(unsigned char destination){
+  double since = std::max(lastMove, aptport::now() - pushedStaleUs);
+  if(readPushedStatus(destination, since)){
+    return true;
+  }
+  aptmessage m;
+  port.receive(tdc ? 0x0491 : 0x0481, destination, since, 250, m);
+  return readPushedStatus(destination, since);
+}
+
+/*
+ * reads the status a channel pushed since the given time, a channel that has stopped pushing is asked for its
+ * status and told to start again
+ */
+void thordrive::readStatus(unsigned char destination, double since){
+  if(readPushedStatus(destination, since)){
+    return;
+  }
+  getStatusUpdates(destination,0x01);//desination, channel
+  requestStatusStream(destination);
+}
+
+void thordrive::requestStatusStream(unsigned char destination){
+  unsigned char comarray[6];
+  getByteCommand(HW_START_UPDATEMSGS, comarray, 0x00, 0x00, destination);
+  sendByteCommand(comarray,6);
+  getByteCommand(MOT_ACK_DCSTATUSUPDATE, comarray, 0x00, 0x00, destination);
+  sendByteCommand(comarray,6);
+}
+
+void thordrive::startStatusStream(){
+  streaming = true;
+  if(tdc){
+    requestStatusStream(0x50);
+  }
+  else{
+    requestStatusStream(0x21);
+    requestStatusStream(0x22);
+  }
+}
+
+void thordrive::stopStatusStream(){
+  if(!streaming){
+    return;
+  }
+  streaming = false;
+  unsigned char comarray[6];
+  if(tdc){
+    getByteCommand(HW_STOP_UPDATEMSGS, comarray, 0x00, 0x00, 0x50);
+    sendByteCommand(comarray,6);
+  }
+  else{
+    getByteCommand(HW_STOP_UPDATEMSGS, comarray, 0x00, 0x00, 0x21);
+    sendByteCommand(comarray,6);
+    getByteCommand(HW_STOP_UPDATEMSGS, comarray, 0x00, 0x00, 0x22);
+    sendByteCommand(comarray,6);
+  }
+}
+
+void thordrive::updateDrivePositions(){
+   if(streaming){
+       //the channels push their status, the latest one is read unless it has stopped coming
+       double fresh = aptport::now() - pushedStaleUs;
+       if(tdc){
+           readStatus(0x50, fresh);
        }
-       if(!xactive && !yactive){
-           //set x active get status update, then set y active get update, set z active because it must be the active drive
+       else{
            setActiveDrive(0x21);
-           getStatusUpdates(0x21,0x01);//desination, channel - x axis
+           readStatus(0x21, fresh);
            setActiveDrive(0x22);
-           getStatusUpdates(0x22,0x01);//desination, channel
+           readStatus(0x22, fresh);
+           //set z active because it must be the active drive
            setActiveDrive(0x50);
        }
+       return;
+   }
+   if(tdc){
+       getStatusUpdates(0x50,0x01);//desination, channel
+   }
+   else{
+       //both bays are asked at once and their replies read as they come, one round trip for the pair
+       static const unsigned char bays[] = {0x21, 0x22};
+       getStatusUpdates(bays, 2, 10000);
+       //set z active because it must be the active drive
+       setActiveDrive(0x50);
    }
 }
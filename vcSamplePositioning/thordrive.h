@@ -27,10 +27,14 @@
 #include <errno.h> // Error number definitions
 #include <termios.h> // POSIX terminal control definitionss
 #include <time.h>
+#include <atomic>
+#include <mutex>
 #include <stdint.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <boost/concept_check.hpp>
+#include "tracelog.h"
+#include "aptport.h"
 
 class thordrive{
 
@@ -48,11 +52,13 @@ public:
     HW_GET_INFO,
     HW_DISCONNECT,
     HW_START_UPDATEMSGS,
+    HW_STOP_UPDATEMSGS,
     HW_NO_FLASH_PROGRAMMING,
     MOT_GET_STATUSUPDATE,
     MOT_GET_DCSTATUSUPDATE,
     MOT_REQ_STATUSUPDATE,
     MOT_REQ_DCSTATUSUPDATE,
+    MOT_ACK_DCSTATUSUPDATE,
     MOT_SET_LIMSWITCHPARAMS,
     MOT_GET_LIMSWITCHPARAMS,
     MOT_REQ_LIMSWITCHPARAMS,
@@ -111,11 +117,11 @@ public:
   * \brief Constructor.
   * for testing purposes.
   */
-  thordrive(){}
+  thordrive() : lastSent(0), lastMove(0), bufLength(0), streaming(false), trace(NULL), traceSpan(0){clearPushedStatus();}
   /*!
   * \brief Destructor.
   */
-  ~thordrive(){close(USB);}
+  ~thordrive(){port.close(); close(USB);}
   /*!
    * \brief Opens connection.
   */
@@ -133,6 +139,27 @@ public:
   void getLimitswitchParams(unsigned char chan,unsigned char destination);
   void stopMotor(unsigned char chan,unsigned char destination);
   void getStatusUpdates(unsigned char destination, unsigned char chan);
+  /*!
+  * \brief Ask a channel for its status and return at once, the reply is read with waitStatusUpdate.
+  * \return time the request was sent.
+  */
+  double requestStatusUpdate(unsigned char destination, unsigned char chan);
+  /*!
+  * \brief Read the status a channel sent in reply to requestStatusUpdate into the drive positions.
+  * \param[in] requested time returned by requestStatusUpdate.
+  * \param[in] timeoutMs longest wait for the reply, 0 to only look.
+  * \return false if the reply has not come.
+  */
+  bool waitStatusUpdate(unsigned char destination, double requested, double timeoutMs);
+  /*!
+  * \brief Ask several channels of the controller for their status back to back and read the replies as they come,
+  * matched by the address they are sent from, so all of them cost about one round trip.
+  * \param[in] destinations addresses of the channels, at most STATUS_BATCH.
+  * \param[in] timeoutMs longest wait for all the replies.
+  * \return false if a channel did not reply in time.
+  */
+  bool getStatusUpdates(const unsigned char destinations[], unsigned int count, double timeoutMs);
+  enum {STATUS_BATCH = 10};
   void getInfo(unsigned char destination);
   void identifyChannel(unsigned char destination);
   void getEnabledState( int chan,unsigned char destination);
@@ -164,17 +191,51 @@ public:
   double getScaledZ(){return scaled_z;}
   double getScaledY(){return scaled_y;}
   double getscaledX(){return scaled_x;}
+  /*!
+  * \brief Trace the status round trips and moves sent to the controller as spans with the APT message id and
+  * destination.
+  */
+  void setTrace(tracelog* log, unsigned int span){trace = log; traceSpan = span;}
+  /*!
+  * \brief Print the message counters of the port.
+  */
+  void printPortStats(){port.printStats();}
+  /*!
+  * \brief Have the channels push their status about ten times a second instead of being asked for it. The
+  * positions and motion are then read from the latest status each channel sent, a channel whose status stops
+  * coming is asked again.
+  */
+  void startStatusStream();
+  /*!
+  * \brief Stop the pushed status, the positions and motion are asked for again.
+  */
+  void stopStatusStream();
+  bool isStreaming(){return streaming;}
 
 private:
   bool moveCompleted;
   //holds terminal connection attributes
   struct termios tty;
   struct termios tty_old;
-  fd_set readSet;
-  //port handle
+  //port handle, read by the port reader thread once open
   int USB,buffSize;
-  unsigned char *buf; //recieve unsigned
-  signed char *signed_buf;
+  aptport port;
+  double lastSent;// when the last message was written, replies are taken from then on
+  double lastMove;// when the last move was sent, its completion is taken from then on
+  //the message being decoded, kept for the life of the connection so that receiving never allocates
+  unsigned char buf[aptmessage::MAX_LENGTH];
+  unsigned int bufLength;
+  //latest status each channel pushed, kept by the port reader thread
+  struct pushedstatus
+  {
+    aptmessage message;
+    double acked;// when the channel was last due to be told the host is reading
+    bool ackDue;// set by the reader thread, the ack is written by the thread driving the controller
+  };
+  enum {STATUS_CHANNELS = 3};
+  pushedstatus pushed[STATUS_CHANNELS];
+  std::mutex pushedLock;
+  std::atomic<bool> streaming;
   std::string activeDrive;
   double x,y,z;  //positions of actuators x and y are translations, z will be a rotation
   double scaled_x,scaled_y, scaled_z;
@@ -182,6 +243,8 @@ private:
   //identifies which of the two expected types of controller the port is connected to (BSC203)
   bool tdc,isActive;
   bool moving;
+  tracelog* trace;
+  unsigned int traceSpan;
   void getInfo();
   void getVelocityParams();
   void getMoveRelParams();
@@ -197,8 +260,6 @@ private:
   void getPMDStageAxisParams();
   void getBSCPowerParams();
   void getGenMoveParams();
-  void releaseBufferMemory();
-  void releasesignedBufferMemory();
   void waitWhileHoming(unsigned char chan, unsigned char destination);
   void waitWhileMoving();
   void checkWithinLimit(unsigned char chan, unsigned char destination);
@@ -210,7 +271,14 @@ private:
   //low level functions
   void receiveResponse();
   void receiveData(unsigned char expected_command[], time_t timeout=10);
-  void receiveSignedData(time_t timeout=10);
+  bool takeMessage(uint16_t id, unsigned char source, double since, double timeoutMs);
+  bool takeFinishedMove(unsigned char destination);
+  void clearPushedStatus();
+  void keepPushedStatus(const aptmessage& m);
+  bool readPushedStatus(unsigned char destination, double since);
+  bool waitPushedStatus(unsigned char destination);
+  void readStatus(unsigned char destination, double since);
+  void requestStatusStream(unsigned char destination);
   void processRespose(command_t c);
   void sendByteCommand(unsigned char* cmd,int len);
   void sendSignedByteCommand(signed char* cmd,int len);
@@ -236,7 +304,6 @@ private:
   double getZactuatorPosition(){return z;}
 
   enum command_t lookupCommand();
-  void processSignedData();
   bool getMoveCompleted(){return moveCompleted;}
   void setMoveCompleted(bool completed){moveCompleted = completed;}
   void init();
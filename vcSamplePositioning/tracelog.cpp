@@ -0,0 +1,213 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "tracelog.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+tracelog::tracelog(unsigned int capacity) :
+    capacity(capacity < 2 ? 2 : capacity), ring(NULL), head(0), enabled(false), flushing(false),
+    readIndex(0), written(0), dropped(0), origin(0), firstEvent(true)
+{
+}
+
+tracelog::~tracelog()
+{
+    stop();
+    delete[] ring;
+}
+
+unsigned int tracelog::addSpan(const std::string& name, const std::string& category, const std::string& arg1,
+                               const std::string& arg2, bool hex)
+{
+    spankind k;
+    k.name = name;
+    k.category = category;
+    k.arg1 = arg1;
+    k.arg2 = arg2;
+    k.hex = hex;
+    kinds.push_back(k);
+    return (unsigned int)kinds.size() - 1;
+}
+
+unsigned int tracelog::threadId()
+{
+    static std::atomic<unsigned int> nextId(1);
+    thread_local unsigned int id = nextId.fetch_add(1);
+    return id;
+}
+
+void tracelog::nameThread(const std::string& name)
+{
+    unsigned int id = threadId();
+    std::lock_guard<std::mutex> lk(threadLock);
+    for(size_t t = 0; t < threadNames.size(); t++){
+        if(threadNames[t].first == id){
+            threadNames[t].second = name;
+            return;
+        }
+    }
+    threadNames.push_back(std::make_pair(id, name));
+}
+
+bool tracelog::start(const std::string& path)
+{
+    stop();
+    out.open(path.c_str(), std::ios_base::out | std::ios_base::trunc);
+    if(!out){
+        std::cout<<"cannot write the trace "<<path<<std::endl;
+        return false;
+    }
+    if(ring == NULL){
+        //kept until destruction, a span from the last run may still be landing in it
+        ring = new slot[capacity]();
+    }
+    out<<std::fixed;
+    out.precision(3);
+    out<<"[";
+    firstEvent = true;
+    written = dropped = 0;
+    origin = now();
+    readIndex = head.load(std::memory_order_acquire);
+    flushing = true;
+    enabled.store(true, std::memory_order_release);
+    flusher = std::thread(&tracelog::flushLoop, this);
+    return true;
+}
+
+void tracelog::stop()
+{
+    if(!flusher.joinable()){
+        return;
+    }
+    enabled.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lk(flushLock);
+        flushing = false;
+    }
+    flushWake.notify_one();
+    flusher.join();
+    //thread names last, the viewers apply them to the whole file
+    std::lock_guard<std::mutex> lk(threadLock);
+    for(size_t t = 0; t < threadNames.size(); t++){
+        out<<(firstEvent ? "\n" : ",\n");
+        firstEvent = false;
+        out<<"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"<<threadNames[t].first
+           <<",\"args\":{\"name\":\""<<threadNames[t].second<<"\"}}";
+    }
+    out<<"\n]\n";
+    out.close();
+    std::cout<<"trace - spans written \t"<<written<<"\t lost \t"<<dropped<<std::endl;
+}
+
+void tracelog::record(unsigned int span, double startUs, double endUs, long long arg1, long long arg2)
+{
+    if(!enabled.load(std::memory_order_relaxed)){
+        return;
+    }
+    unsigned long long i = head.fetch_add(1, std::memory_order_relaxed);
+    slot& s = ring[i % capacity];
+    s.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.span.store(span, std::memory_order_relaxed);
+    s.thread.store(threadId(), std::memory_order_relaxed);
+    s.start.store(startUs, std::memory_order_relaxed);
+    s.duration.store(endUs - startUs, std::memory_order_relaxed);
+    s.arg1.store(arg1, std::memory_order_relaxed);
+    s.arg2.store(arg2, std::memory_order_relaxed);
+    s.seq.store(i + 1, std::memory_order_release);
+}
+
+/**
+ * @brief tracelog::flushLoop writes the recorded spans out every 100 ms, and the remaining ones once stopped
+ */
+void tracelog::flushLoop()
+{
+    std::unique_lock<std::mutex> lk(flushLock);
+    while(flushing){
+        flushWake.wait_for(lk, std::chrono::milliseconds(100));
+        lk.unlock();
+        drain(false);
+        lk.lock();
+    }
+    lk.unlock();
+    drain(true);
+}
+
+void tracelog::writeArg(const std::string& name, long long value, bool hex, bool& first)
+{
+    if(name.empty() || value < 0){
+        return;
+    }
+    out<<(first ? "" : ",")<<"\""<<name<<"\":";
+    first = false;
+    if(hex){
+        char text[24];
+        snprintf(text, sizeof(text), "\"0x%04llx\"", value);
+        out<<text;
+    }
+    else{
+        out<<value;
+    }
+}
+
+/**
+ * @brief tracelog::drain writes the spans recorded since the last drain in the order they were started to be
+ * recorded. A span still being written is waited for until the next drain, unless this is the last one.
+ */
+void tracelog::drain(bool last)
+{
+    unsigned long long h = head.load(std::memory_order_acquire);
+    if(h - readIndex > capacity){
+        //overwritten before they were written out
+        dropped += h - capacity - readIndex;
+        readIndex = h - capacity;
+    }
+    for(; readIndex < h; readIndex++){
+        slot& s = ring[readIndex % capacity];
+        unsigned long long seq = s.seq.load(std::memory_order_acquire);
+        if(seq < readIndex + 1){
+            if(!last){
+                break;
+            }
+            dropped++;
+            continue;
+        }
+        unsigned int span = s.span.load(std::memory_order_relaxed);
+        unsigned int thread = s.thread.load(std::memory_order_relaxed);
+        double start = s.start.load(std::memory_order_relaxed);
+        double duration = s.duration.load(std::memory_order_relaxed);
+        long long arg1 = s.arg1.load(std::memory_order_relaxed);
+        long long arg2 = s.arg2.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(seq != readIndex + 1 || s.seq.load(std::memory_order_relaxed) != seq || span >= kinds.size()){
+            dropped++;
+            continue;
+        }
+        const spankind& k = kinds[span];
+        out<<(firstEvent ? "\n" : ",\n");
+        firstEvent = false;
+        out<<"{\"name\":\""<<k.name<<"\",\"cat\":\""<<k.category<<"\",\"ph\":\"X\",\"pid\":1,\"tid\":"<<thread
+           <<",\"ts\":"<<(start - origin)<<",\"dur\":"<<duration<<",\"args\":{";
+        bool first = true;
+        writeArg(k.arg1, arg1, k.hex, first);
+        writeArg(k.arg2, arg2, k.hex, first);
+        out<<"}}";
+        written++;
+    }
+    out.flush();
+}
@@ -0,0 +1,151 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACELOG_H
+#define TRACELOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latencylog.h"
+
+/*!
+ * \brief Timeline of a run in the Chrome trace event format, opened in chrome://tracing or Perfetto.
+ *
+ * Every traced operation is a span with its start, duration, thread and up to two numeric arguments, recorded
+ * from any thread into a preallocated ring without locking or allocating. A flush thread writes the spans
+ * out while the run goes on, when it falls behind by more than the ring the oldest spans are lost and counted.
+ * Recording costs one relaxed load while tracing is off.
+ *
+ * The file is a JSON array of events, which the viewers still open when the run ended without closing it.
+ */
+class tracelog
+{
+public:
+  /*!
+  * \brief Constructor.
+  * \param[in] capacity spans held between two flushes.
+  */
+  explicit tracelog(unsigned int capacity = 65536);
+  /*!
+  * \brief Destructor, stops tracing.
+  */
+  ~tracelog();
+  /*!
+  * \brief Kind of span, added before the threads recording it start.
+  * \param[in] name shown on the span.
+  * \param[in] category group of the span in the viewer.
+  * \param[in] arg1,arg2 names of the span arguments, empty if not used.
+  * \param[in] hex the arguments are shown in hexadecimal (message ids, addresses).
+  * \return id of the span kind to record with.
+  */
+  unsigned int addSpan(const std::string& name, const std::string& category, const std::string& arg1 = "frame",
+                       const std::string& arg2 = "", bool hex = false);
+  /*!
+  * \brief Name the calling thread in the viewer, kept from one run to the next.
+  */
+  void nameThread(const std::string& name);
+  /*!
+  * \brief Start writing the spans recorded from now on to path.
+  * \return false if the file cannot be written.
+  */
+  bool start(const std::string& path);
+  /*!
+  * \brief Write the spans still in the ring and close the file.
+  */
+  void stop();
+  bool isEnabled() const {return enabled.load(std::memory_order_relaxed);}
+  /*!
+  * \brief Record one span, any thread.
+  * \param[in] span id returned by addSpan.
+  * \param[in] startUs,endUs times from now().
+  * \param[in] arg1,arg2 span arguments, negative when not known.
+  */
+  void record(unsigned int span, double startUs, double endUs, long long arg1 = -1, long long arg2 = -1);
+  /*!
+  * \brief Same monotonic clock as the latency histograms, microseconds.
+  */
+  static double now() {return latencyhistogram::now();}
+  unsigned long long getWritten() const {return written;}
+  unsigned long long getDropped() const {return dropped;}
+
+private:
+  //one recorded span, the fields are atomic so that a slot being overwritten can be read, the sequence
+  //number tells whether what was read is the span expected there
+  struct slot
+  {
+    std::atomic<unsigned long long> seq;// index + 1 of the span once written, 0 while being written
+    std::atomic<unsigned int> span,thread;
+    std::atomic<double> start,duration;
+    std::atomic<long long> arg1,arg2;
+  };
+  struct spankind
+  {
+    std::string name,category,arg1,arg2;
+    bool hex;
+  };
+  static unsigned int threadId();
+  void flushLoop();
+  void drain(bool last);
+  void writeArg(const std::string& name, long long value, bool hex, bool& first);
+  unsigned int capacity;
+  slot* ring;
+  std::atomic<unsigned long long> head;
+  std::atomic<bool> enabled;
+  //set up before recording starts
+  std::vector<spankind> kinds;
+  std::mutex threadLock;
+  std::vector<std::pair<unsigned int, std::string> > threadNames;
+  //flush thread
+  std::thread flusher;
+  std::mutex flushLock;
+  std::condition_variable flushWake;
+  bool flushing;
+  unsigned long long readIndex,written,dropped;
+  double origin;
+  std::ofstream out;
+  bool firstEvent;
+};
+
+/*!
+ * \brief Traces the scope it lives in as one span, nothing is timed while tracing is off.
+ */
+class tracespan
+{
+public:
+  tracespan(tracelog& log, unsigned int span, long long arg1 = -1, long long arg2 = -1) :
+    log(log), span(span), arg1(arg1), arg2(arg2), active(log.isEnabled()), start(active ? tracelog::now() : 0){}
+  ~tracespan()
+  {
+    if(active){
+      log.record(span, start, tracelog::now(), arg1, arg2);
+    }
+  }
+
+private:
+  tracelog& log;
+  unsigned int span;
+  long long arg1,arg2;
+  bool active;
+  double start;
+};
+
+#endif // TRACELOG_H
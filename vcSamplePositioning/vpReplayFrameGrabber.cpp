@@ -0,0 +1,65 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "vpReplayFrameGrabber.h"
+#include <visp/vpImageConvert.h>
+#include <stdexcept>
+
+vpReplayFrameGrabber::vpReplayFrameGrabber(replaysequence& sequence, unsigned int camera) :
+    isConnected(false), sequence(sequence), camera(camera), lastFrame(0)
+{
+}
+
+vpReplayFrameGrabber::~vpReplayFrameGrabber()
+{
+}
+
+void vpReplayFrameGrabber::open(vpImage<unsigned char>& I)
+{
+    if(camera >= sequence.getNbCameras()){
+        throw std::runtime_error("replay grabber opened on a camera the sequence does not have");
+    }
+    sequence.getFrameSize(height, width);
+    I.resize(height, width);
+    isConnected = true;
+    init = true;
+}
+
+void vpReplayFrameGrabber::open(vpImage<vpRGBa>& I)
+{
+    open(grey);
+    I.resize(height, width);
+}
+
+void vpReplayFrameGrabber::acquire(vpImage<unsigned char>& I)
+{
+    if(!isConnected){
+        throw std::runtime_error("replay grabber is not open");
+    }
+    lastFrame = sequence.getFrame(camera, I);
+}
+
+void vpReplayFrameGrabber::acquire(vpImage<vpRGBa>& I)
+{
+    acquire(grey);
+    vpImageConvert::convert(grey, I);
+}
+
+void vpReplayFrameGrabber::close()
+{
+    isConnected = false;
+    init = false;
+}
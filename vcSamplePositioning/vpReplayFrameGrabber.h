@@ -0,0 +1,59 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VPREPLAYFRAMEGRABBER_H
+#define VPREPLAYFRAMEGRABBER_H
+
+#include <visp/vpFrameGrabber.h>
+#include "replaysequence.h"
+
+/*!
+ * \brief Frame grabber playing back one camera of a recorded run. The grabbers of a stereo pair share the
+ * same replaysequence, which keeps them in lockstep.
+ */
+class vpReplayFrameGrabber : public vpFrameGrabber
+{
+public:
+  /*!
+  * \brief Constructor.
+  * \param[in] sequence opened sequence, shared with the other cameras.
+  * \param[in] camera index of this camera in the sequence.
+  */
+  vpReplayFrameGrabber(replaysequence& sequence, unsigned int camera);
+  virtual ~vpReplayFrameGrabber();
+  virtual void open(vpImage< unsigned char >& I);
+  virtual void open(vpImage< vpRGBa >& I);
+  /*!
+  * \brief Next frame of the recording, throws at the end of the sequence.
+  */
+  virtual void acquire(vpImage< unsigned char >& I);
+  virtual void acquire(vpImage< vpRGBa >& I);
+  virtual void close();
+  /*!
+  * \brief Number in the recording of the last frame returned.
+  */
+  unsigned int getFrameNumber() const {return lastFrame;}
+  bool isConnected;
+
+private:
+  replaysequence& sequence;
+  unsigned int camera;
+  unsigned int lastFrame;
+  vpImage<unsigned char> grey;
+};
+
+#endif // VPREPLAYFRAMEGRABBER_H
@@ -0,0 +1,245 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "vpSimulatedFrameGrabber.h"
+#include <visp/vpImageConvert.h>
+#include <visp/vpPoseVector.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+/**
+ * @brief xmlValue returns the number held by the first <tag> after the given position, the camera settings
+ * files are simple enough that a full xml parser is not needed.
+ */
+bool xmlValue(const std::string& xml, const std::string& tag, size_t from, double& value)
+{
+    size_t start = xml.find("<" + tag + ">", from);
+    if(start == std::string::npos){
+        return false;
+    }
+    value = atof(xml.c_str() + start + tag.size() + 2);
+    return true;
+}
+}
+
+vpSimulatedFrameGrabber::vpSimulatedFrameGrabber() :
+    isConnected(false), frameRate(0), nextFrameTime(0), renderedFrames(0), renderTimeMs(0)
+{
+}
+
+vpSimulatedFrameGrabber::~vpSimulatedFrameGrabber()
+{
+    close();
+}
+
+bool vpSimulatedFrameGrabber::setScene(const std::string& modelFile, const std::string& cameraFile,
+                                       const std::string& poseFile)
+{
+    if(!renderer.loadModel(modelFile)){
+        return false;
+    }
+    std::ifstream camin(cameraFile.c_str());
+    if(!camin.is_open()){
+        std::cout<<"cannot open camera settings "<<cameraFile<<std::endl;
+        return false;
+    }
+    std::stringstream content;
+    content<<camin.rdbuf();
+    std::string xml = content.str();
+    size_t camtag = xml.find("<camera>");
+    double w,h,u0,v0,px,py;
+    if(camtag == std::string::npos || !xmlValue(xml, "width", camtag, w) || !xmlValue(xml, "height", camtag, h)
+            || !xmlValue(xml, "u0", camtag, u0) || !xmlValue(xml, "v0", camtag, v0)
+            || !xmlValue(xml, "px", camtag, px) || !xmlValue(xml, "py", camtag, py)){
+        std::cout<<"no camera parameters in "<<cameraFile<<std::endl;
+        return false;
+    }
+    cam.initPersProjWithoutDistortion(px, py, u0, v0);
+    width = (unsigned int)w;
+    height = (unsigned int)h;
+    std::ifstream posein(poseFile.c_str());
+    if(!posein.is_open()){
+        std::cout<<"cannot open initial pose "<<poseFile<<std::endl;
+        return false;
+    }
+    cMo0.load(posein);
+    renderedPose = cMo0;
+    return true;
+}
+
+bool vpSimulatedFrameGrabber::loadTrajectory(const std::string& filename)
+{
+    std::ifstream in(filename.c_str());
+    if(!in.is_open()){
+        std::cout<<"cannot open trajectory "<<filename<<std::endl;
+        return false;
+    }
+    std::vector<waypoint> script;
+    std::string line;
+    while(std::getline(in, line)){
+        if(line.empty() || line[0] == '#'){
+            continue;
+        }
+        std::istringstream fields(line);
+        waypoint wp;
+        fields>>wp.t>>wp.pose[0]>>wp.pose[1]>>wp.pose[2]>>wp.pose[3]>>wp.pose[4]>>wp.pose[5];
+        if(fields.fail()){
+            continue;
+        }
+        for(int k = 3; k < 6; k++){
+            wp.pose[k] *= M_PI / 180.0;
+        }
+        if(script.empty() || wp.t > script.back().t){
+            script.push_back(wp);
+        }
+    }
+    if(script.size() < 2){
+        std::cout<<"trajectory "<<filename<<" needs at least two waypoints"<<std::endl;
+        return false;
+    }
+    trajectory = script;
+    return true;
+}
+
+/**
+ * @brief vpSimulatedFrameGrabber::trajectoryTime seconds since the first simulated camera asked for it,
+ * shared by all instances
+ */
+double vpSimulatedFrameGrabber::trajectoryTime()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief vpSimulatedFrameGrabber::objectMotion without a script the stage swings the holder about its long
+ * (z) axis by +-15 degrees and moves it +-2 mm along x, slow enough to be tracked at the camera frame rate.
+ */
+vpHomogeneousMatrix vpSimulatedFrameGrabber::objectMotion(double t)
+{
+    double pose[6] = {0, 0, 0, 0, 0, 0};
+    if(trajectory.empty()){
+        pose[0] = 0.002 * sin(2 * M_PI * t / 13.0);
+        pose[5] = 15 * M_PI / 180.0 * sin(2 * M_PI * t / 20.0);
+    }
+    else{
+        double duration = trajectory.back().t - trajectory.front().t;
+        double tl = trajectory.front().t + fmod(t, duration);
+        size_t k = 1;
+        while(k < trajectory.size() - 1 && trajectory[k].t < tl){
+            k++;
+        }
+        const waypoint& a = trajectory[k - 1];
+        const waypoint& b = trajectory[k];
+        double s = (tl - a.t) / (b.t - a.t);
+        for(int j = 0; j < 6; j++){
+            pose[j] = a.pose[j] + s * (b.pose[j] - a.pose[j]);
+        }
+    }
+    return vpHomogeneousMatrix(vpPoseVector(pose[0], pose[1], pose[2], pose[3], pose[4], pose[5]));
+}
+
+void vpSimulatedFrameGrabber::open(vpImage<unsigned char>& I)
+{
+    if(width == 0 || height == 0){
+        throw std::runtime_error("simulated camera opened before setScene");
+    }
+    grey.resize(height, width);
+    I.resize(height, width);
+    trajectoryTime();
+    nextFrameTime = 0;
+    isConnected = true;
+    init = true;
+}
+
+void vpSimulatedFrameGrabber::open(vpImage<vpRGBa>& I)
+{
+    vpImage<unsigned char> Ig;
+    open(Ig);
+    I.resize(height, width);
+}
+
+/**
+ * @brief vpSimulatedFrameGrabber::waitForFrame paces the frames when a frame rate is set, like the exposure
+ * of a real camera would
+ */
+void vpSimulatedFrameGrabber::waitForFrame()
+{
+    if(frameRate <= 0){
+        return;
+    }
+    double t = trajectoryTime();
+    if(nextFrameTime > t){
+        std::this_thread::sleep_for(std::chrono::duration<double>(nextFrameTime - t));
+        t = nextFrameTime;
+    }
+    nextFrameTime = t + 1.0 / frameRate;
+}
+
+void vpSimulatedFrameGrabber::acquire(vpImage<unsigned char>& I)
+{
+    if(!isConnected){
+        throw std::runtime_error("simulated camera is not open");
+    }
+    waitForFrame();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    vpHomogeneousMatrix cMo = cMo0 * objectMotion(trajectoryTime());
+    if(I.getHeight() != height || I.getWidth() != width){
+        I.resize(height, width);
+    }
+    renderer.render(I, cMo, cam);
+    {
+        std::lock_guard<std::mutex> lock(poseMutex);
+        renderedPose = cMo;
+    }
+    renderedFrames++;
+    renderTimeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void vpSimulatedFrameGrabber::acquire(vpImage<vpRGBa>& I)
+{
+    acquire(grey);
+    vpImageConvert::convert(grey, I);
+}
+
+void vpSimulatedFrameGrabber::close()
+{
+    isConnected = false;
+    init = false;
+}
+
+vpHomogeneousMatrix vpSimulatedFrameGrabber::getRenderedPose()
+{
+    std::lock_guard<std::mutex> lock(poseMutex);
+    return renderedPose;
+}
+
+void vpSimulatedFrameGrabber::printCameraParameters()
+{
+    std::cout<<"simulated camera "<<width<<"x"<<height<<", "<<renderer.getNbFaces()<<" faces"<<std::endl;
+    std::cout<<"frame rate limit (0 = none) \t"<<frameRate<<std::endl;
+    if(renderedFrames > 0){
+        std::cout<<"frames rendered \t"<<renderedFrames<<std::endl;
+        std::cout<<"mean render time (ms) \t"<<renderTimeMs / renderedFrames<<std::endl;
+    }
+}
@@ -0,0 +1,94 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VPSIMULATEDFRAMEGRABBER_H
+#define VPSIMULATEDFRAMEGRABBER_H
+
+#include <visp/vpFrameGrabber.h>
+#include <visp/vpCameraParameters.h>
+#include <visp/vpHomogeneousMatrix.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "modelrenderer.h"
+
+/*!
+ * \brief Frame grabber that renders the sample holder model instead of reading a camera, so that the
+ * tracking loop can be run and profiled without the chamber.
+ *
+ * The model moves along a stage trajectory expressed in the object frame, cMo(t) = cMo0 * oMo(t), on a
+ * clock shared by every simulated camera so that a stereo pair sees the same motion.
+ */
+class vpSimulatedFrameGrabber : public vpFrameGrabber
+{
+public:
+  vpSimulatedFrameGrabber();
+  virtual ~vpSimulatedFrameGrabber();
+  /*!
+  * \brief Load what is needed to render, must be called before open.
+  * \param[in] modelFile .cao model of the sample holder.
+  * \param[in] cameraFile tracker xml settings, the image size and intrinsics of the camera tag are used.
+  * \param[in] poseFile initial pose cMo0 as a homogeneous matrix.
+  * \return false if one of the files cannot be read.
+  */
+  bool setScene(const std::string& modelFile, const std::string& cameraFile, const std::string& poseFile);
+  /*!
+  * \brief Replace the default trajectory with a scripted one. Each line holds
+  * "t tx ty tz rx ry rz": time in s, translation in m and rotation in degrees (theta u) of the
+  * object in its initial frame. The pose is interpolated between lines and the script loops.
+  * \return false if the file cannot be read or holds fewer than two waypoints.
+  */
+  bool loadTrajectory(const std::string& filename);
+  /*!
+  * \brief Limit the rate frames are produced at, 0 renders as fast as possible.
+  */
+  void setFrameRate(double fps){frameRate = fps;}
+  virtual void open(vpImage< unsigned char >& I);
+  virtual void open(vpImage< vpRGBa >& I);
+  virtual void acquire(vpImage< unsigned char >& I);
+  virtual void acquire(vpImage< vpRGBa >& I);
+  virtual void close();
+  void getCameraParameters(vpCameraParameters& c) const {c = cam;}
+  /*!
+  * \brief Pose the last frame was rendered at, the ground truth for the tracker.
+  */
+  vpHomogeneousMatrix getRenderedPose();
+  void printCameraParameters();
+  bool isConnected;
+
+private:
+  struct waypoint
+  {
+    double t;
+    double pose[6];
+  };
+  vpHomogeneousMatrix objectMotion(double t);
+  static double trajectoryTime();
+  void waitForFrame();
+  modelrenderer renderer;
+  vpCameraParameters cam;
+  vpHomogeneousMatrix cMo0, renderedPose;
+  std::mutex poseMutex;
+  std::vector<waypoint> trajectory;
+  vpImage<unsigned char> grey;
+  double frameRate;
+  double nextFrameTime;
+  unsigned long renderedFrames;
+  double renderTimeMs;
+};
+
+#endif // VPSIMULATEDFRAMEGRABBER_H
@@ -16,16 +16,70 @@
 */
 #include "vpUeyeFrameGrabber.h"
 #include <visp/vpImageConvert.h>
+#include "rgbconvert.h"
+#include <visp/vpTime.h>
+#include <ueye.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <cstring>
+#include <set>
 //#include <imalib/ueyeImageGrabber.h>
 //#include <imalib/imageRGB.h>
+namespace {
+/*
+ * device ids of the uEye cameras some process has open, false if the driver cannot list them
+ */
+bool devicesInUse(std::set<unsigned int>& devices, std::set<unsigned int>& all)
+{
+    INT count = 0;
+    if(is_GetNumberOfCameras(&count) != IS_SUCCESS || count < 1){
+        return false;
+    }
+    std::vector<BYTE> buffer(sizeof(ULONG) + count * sizeof(UEYE_CAMERA_INFO));
+    UEYE_CAMERA_LIST* list = reinterpret_cast<UEYE_CAMERA_LIST*>(&buffer[0]);
+    list->dwCount = count;
+    if(is_GetCameraList(list) != IS_SUCCESS){
+        return false;
+    }
+    for(ULONG i = 0; i < list->dwCount && i < (ULONG)count; i++){
+        all.insert(list->uci[i].dwDeviceID);
+        if(list->uci[i].dwInUse){
+            devices.insert(list->uci[i].dwDeviceID);
+        }
+    }
+    return true;
+}
+}
+
 vpUeyeFrameGrabber::vpUeyeFrameGrabber(): theImagec1(1600,1200){
-  imageWidth = 1600;
-  imageHeight = 1200;
+  sensorWidth = 1600;
+  sensorHeight = 1200;
+  imageWidth = sensorWidth;
+  imageHeight = sensorHeight;
   posX = 0;
   posY = 0;
+  aoiPending = false;
+  aoiApplying = false;
+  sensorPending = false;
+  pendingSensorW = sensorWidth;
+  pendingSensorH = sensorHeight;
+  pixelClock = 0;
+  binning = 1;
+  binAverage = true;
+  binningPending = false;
+  pendingBinning = 1;
+  pendingAverage = true;
+  width = sensorWidth;
+  height = sensorHeight;
   upsideDown = false;
   flip = false;
   cameraNumber = 0; //default and will result in connection to first available camera
+  deviceId = 0;
+  acquiredFrames = 0;
+  acquireTimeMs = 0;
+  uGrabberc1 = NULL;
+  isConnected = false;
   //theImagec1.setSize(imageHeight,imageWidth);
   //imalib::imageRGB theImagec2(1600, 1200);
 }
@@ -37,99 +91,427 @@ vpUeyeFrameGrabber::~vpUeyeFrameGrabber()
 void vpUeyeFrameGrabber::setCameraNumber(int id){
 
   cameraNumber = id;
+  deviceId = 0;
 }
 void vpUeyeFrameGrabber::close()
 {
   delete uGrabberc1;
+  uGrabberc1 = NULL;
   isConnected = false;
 }
 
 void vpUeyeFrameGrabber::acquire(vpImage< vpRGBa >& I)
 {
-
+    double t0 = vpTime::measureTimeMs();
+    applyPendingAOI();
+    applyPendingBinning();
     uGrabberc1->getImage(&theImagec1);
-    //now convert the imalib image to the visp format
-    for (int x = 0; x < imageHeight; x++){
-      for(int y = 0; y < imageWidth; y++){
-    unsigned char rgbcomponents[3];
-    theImagec1.getPixel(x, y,rgbcomponents);
-    I[x][y].R = rgbcomponents[0];
-    I[x][y].G = rgbcomponents[1];
-    I[x][y].B = rgbcomponents[2];
+    //the caller's image is only reallocated if the image size has changed
+    const unsigned int outWidth = sensorWidth / binning;
+    const unsigned int outHeight = sensorHeight / binning;
+    if(I.getHeight() != outHeight || I.getWidth() != outWidth){
+      I.resize(outHeight, outWidth);
+    }
+    //now convert the packed imalib buffer straight into the visp bitmap
+    if(binning == 1 && imageWidth == sensorWidth && imageHeight == sensorHeight){
+      rgbconvert::toRGBa(rawFrame(), (unsigned char*)I.bitmap, (unsigned int)imageWidth * imageHeight);
+    }
+    else{
+      //area of interest and/or binning - each block of lines goes to its sensor position, the rest of the
+      //image is blanked
+      const vpRGBa black(0, 0, 0, 0);
+      unsigned char* rgb = rawFrame();
+      const unsigned int x0 = posX / binning;
+      const unsigned int w = imageWidth / binning;
+      for(unsigned int y = 0; y < outHeight; y++){
+        vpRGBa* row = I[y];
+        unsigned int sy = y * binning;
+        if(sy < posY || sy + binning > (unsigned int)posY + imageHeight){
+          std::fill(row, row + outWidth, black);
+          continue;
+        }
+        std::fill(row, row + x0, black);
+        if(binning == 1){
+          rgbconvert::toRGBa(rgb + 3 * (sy - posY) * imageWidth, (unsigned char*)(row + x0), imageWidth);
+        }
+        else{
+          rgbconvert::toRGBaReduced(rgb + 3 * (sy - posY) * imageWidth, (unsigned char*)(row + x0), imageWidth,
+                                    binning, binAverage);
+        }
+        std::fill(row + x0 + w, row + outWidth, black);
       }
     }
+    acquiredFrames++;
+    acquireTimeMs += vpTime::measureTimeMs() - t0;
 }
 
 void vpUeyeFrameGrabber::acquire(vpImage< unsigned char >& I)
 {
-  vpImage< vpRGBa > temp(1200,1600); //height, width//I had this as 1600,1200
-  uGrabberc1->getImage(&theImagec1);
-    //now convert the imalib image to the visp format
-    for (int x = 0; x < imageHeight; x++){
-      for(int y = 0; y < imageWidth; y++){
-    unsigned char rgbcomponents[3];
-    theImagec1.getPixel(y, x,rgbcomponents);
-    temp[x][y].R = rgbcomponents[0];
-    temp[x][y].G = rgbcomponents[1];
-    temp[x][y].B = rgbcomponents[2];
+    double t0 = vpTime::measureTimeMs();
+    applyPendingAOI();
+    applyPendingBinning();
+    uGrabberc1->getImage(&theImagec1);
+    //the caller's image is only reallocated if the image size has changed
+    const unsigned int outWidth = sensorWidth / binning;
+    const unsigned int outHeight = sensorHeight / binning;
+    if(I.getHeight() != outHeight || I.getWidth() != outWidth){
+      I.resize(outHeight, outWidth);
+    }
+    //convert once from the packed rgb frame buffer into the grey level bitmap, bit exact with the
+    //vpRGBa to unsigned char conversion that was previously used
+    if(binning == 1 && imageWidth == sensorWidth && imageHeight == sensorHeight){
+      rgbconvert::toGrey(rawFrame(), I.bitmap, (unsigned int)imageWidth * imageHeight);
+    }
+    else{
+      //area of interest and/or binning - each block of lines goes to its sensor position, the rest of the
+      //image is blanked
+      unsigned char* rgb = rawFrame();
+      const unsigned int x0 = posX / binning;
+      const unsigned int w = imageWidth / binning;
+      for(unsigned int y = 0; y < outHeight; y++){
+        unsigned char* row = I[y];
+        unsigned int sy = y * binning;
+        if(sy < posY || sy + binning > (unsigned int)posY + imageHeight){
+          memset(row, 0, outWidth);
+          continue;
+        }
+        memset(row, 0, x0);
+        if(binning == 1){
+          rgbconvert::toGrey(rgb + 3 * (sy - posY) * imageWidth, row + x0, imageWidth);
+        }
+        else{
+          rgbconvert::toGreyReduced(rgb + 3 * (sy - posY) * imageWidth, row + x0, imageWidth, binning, binAverage,
+                                    &binScratch[0], &binSums[0]);
+        }
+        memset(row + x0 + w, 0, outWidth - x0 - w);
       }
     }
-    //now we have an rgb visp image lets convert to a unsigned char image
-    vpImage< vpRGBa > const &t = temp;
-    vpImageConvert::convert(t,I);
+    acquiredFrames++;
+    acquireTimeMs += vpTime::measureTimeMs() - t0;
+}
 
+void vpUeyeFrameGrabber::setSensorSize(unsigned short w, unsigned short h)
+{
+    if(uGrabberc1 == NULL){
+      sensorWidth = w;
+      sensorHeight = h;
+      imageWidth = w;
+      imageHeight = h;
+      posX = 0;
+      posY = 0;
+      width = w / binning;
+      height = h / binning;
+      theImagec1.setSize(w, h);
+      return;
+    }
+    //the camera is open, reopened on the whole new sensor by the acquiring thread
+    std::lock_guard<std::mutex> lock(aoiMutex);
+    pendingSensorW = w;
+    pendingSensorH = h;
+    sensorPending = true;
+    pendingX = 0;
+    pendingY = 0;
+    pendingW = w;
+    pendingH = h;
+    aoiPending = true;
 }
 
-void vpUeyeFrameGrabber::open(vpImage< vpRGBa >& I)
+void vpUeyeFrameGrabber::setBinning(unsigned int factor, bool average)
 {
-    uGrabberc1 =  new imalib::ueyeImageGrabber(upsideDown,flip,cameraNumber,posX, posY,imageWidth, imageHeight);
-    if(uGrabberc1->isConnected()){
-      isConnected = true;
-      //initialiseCamera();
+    if(factor != 1 && factor != 2 && factor != 4){
+      //the area of interest alignment (16 columns, 4 lines) only keeps whole blocks for these
+      std::cout<<"binning factor "<<factor<<" not supported, use 1, 2 or 4"<<std::endl;
+      return;
     }
+    std::lock_guard<std::mutex> lock(aoiMutex);
+    pendingBinning = factor;
+    pendingAverage = average;
+    binningPending = true;
 }
 
-void vpUeyeFrameGrabber::open(vpImage< unsigned char >& I)
+unsigned int vpUeyeFrameGrabber::getBinning()
 {
-    uGrabberc1 =  new imalib::ueyeImageGrabber(upsideDown,flip,cameraNumber,posX, posY,imageWidth, imageHeight);
-    if(uGrabberc1->isConnected()){
-      isConnected = true;
-      //initialiseCamera();
+    std::lock_guard<std::mutex> lock(aoiMutex);
+    return binningPending ? pendingBinning : binning;
+}
+
+/**
+ * Called by the acquiring thread before reading a frame, the line buffers used for binning are only
+ * allocated here.
+ */
+void vpUeyeFrameGrabber::applyPendingBinning()
+{
+    if(!binningPending){
+      return;
     }
+    std::lock_guard<std::mutex> lock(aoiMutex);
+    binningPending = false;
+    binning = pendingBinning;
+    binAverage = pendingAverage;
+    binScratch.resize(sensorWidth);
+    binSums.resize(sensorWidth);
+    width = sensorWidth / binning;
+    height = sensorHeight / binning;
+}
 
+void vpUeyeFrameGrabber::scaleCameraParameters(const vpCameraParameters& full, unsigned int factor, bool average,
+                                               vpCameraParameters& scaled)
+{
+    //a block of factor x factor pixels becomes one pixel, its centre is the centre of the block when binning and
+    //the centre of the top left pixel of the block when subsampling
+    double s = 1.0 / factor;
+    double px = full.get_px() * s;
+    double py = full.get_py() * s;
+    double shift = average ? 0.5 * (1.0 - s) : 0.0;
+    double u0 = full.get_u0() * s - shift;
+    double v0 = full.get_v0() * s - shift;
+    if(full.get_projModel() == vpCameraParameters::perspectiveProjWithDistortion){
+      scaled.initPersProjWithDistortion(px, py, u0, v0, full.get_kud(), full.get_kdu());
+    }
+    else{
+      scaled.initPersProjWithoutDistortion(px, py, u0, v0);
+    }
 }
 
-void vpUeyeFrameGrabber::initialiseCamera(int pixClockVal){
+void vpUeyeFrameGrabber::resizeCameraParameters(const vpCameraParameters& calibrated, unsigned int fromW,
+                                                unsigned int fromH, unsigned int toW, unsigned int toH,
+                                                vpCameraParameters& resized)
+{
+    //pixel centres are at half pixels, so the principal point is scaled about the corner of the image
+    double sx = (double)toW / fromW;
+    double sy = (double)toH / fromH;
+    double px = calibrated.get_px() * sx;
+    double py = calibrated.get_py() * sy;
+    double u0 = (calibrated.get_u0() + 0.5) * sx - 0.5;
+    double v0 = (calibrated.get_v0() + 0.5) * sy - 0.5;
+    if(calibrated.get_projModel() == vpCameraParameters::perspectiveProjWithDistortion){
+      resized.initPersProjWithDistortion(px, py, u0, v0, calibrated.get_kud(), calibrated.get_kdu());
+    }
+    else{
+      resized.initPersProjWithoutDistortion(px, py, u0, v0);
+    }
+}
 
-   int pixclock = (int)uGrabberc1->getCurrentPixelClockValue();
-  /** std::cout<<"Pixelclock \t"<<pixclock<<std::endl;
-   std::cout<<"EXPOSURE= "<<uGrabberc1->getExposure()<<std::endl;
-   std::cout<<"Framerate \t"<<uGrabberc1->getFramerate()<<std::endl;
-   std::cout<<"Gain \t"<<uGrabberc1->getGain()<<std::endl;**/
-   // set pixelclock
-   uGrabberc1->setPixelClockVal(pixClockVal);
-   //std::cout<<"Pixelclock is now \t"<<uGrabberc1->getCurrentPixelClockValue()<<std::endl;
+void vpUeyeFrameGrabber::setAOI(int x, int y, int w, int h)
+{
+    std::lock_guard<std::mutex> lock(aoiMutex);
+    //uEye sensors need the area aligned, keep x and width on 16 pixels and y and height on 4 lines
+    int sw = sensorPending ? pendingSensorW : sensorWidth;
+    int sh = sensorPending ? pendingSensorH : sensorHeight;
+    int x0 = std::max(0, x) & ~15;
+    int y0 = std::max(0, y) & ~3;
+    int x1 = std::min(sw, (x + w + 15) & ~15);
+    int y1 = std::min(sh, (y + h + 3) & ~3);
+    //never smaller than 128 x 96
+    if(x1 - x0 < 128){
+      x1 = std::min(sw, x0 + 128);
+      x0 = x1 - 128;
+    }
+    if(y1 - y0 < 96){
+      y1 = std::min(sh, y0 + 96);
+      y0 = y1 - 96;
+    }
+    pendingX = x0;
+    pendingY = y0;
+    pendingW = x1 - x0;
+    pendingH = y1 - y0;
+    aoiPending = true;
+}
+
+void vpUeyeFrameGrabber::clearAOI()
+{
+    //setAOI clamps the area to the sensor, also to a sensor size not applied yet
+    setAOI(0, 0, 0xffff, 0xffff);
+}
+
+void vpUeyeFrameGrabber::getAOI(int& x, int& y, int& w, int& h)
+{
+    std::lock_guard<std::mutex> lock(aoiMutex);
+    if(aoiPending || aoiApplying){
+      x = pendingX;
+      y = pendingY;
+      w = pendingW;
+      h = pendingH;
+      //getAOI reports the area being applied rather than the one being replaced
+      aoiApplying = true;
+    }
+    else{
+      x = posX;
+      y = posY;
+      w = imageWidth;
+      h = imageHeight;
+    }
+}
+
+/**
+ * Called by the acquiring thread before reading a frame. imalib only takes the area of interest when
+ * the grabber is created so the camera is reopened with it, its pixel clock and exposure are set again and
+ * frames are grabbed until they have taken effect, the next frame returned is exposed as the ones before.
+ * The reopen and settling are done without the lock, getAOI and setAOI from other threads are not held up.
+ */
+void vpUeyeFrameGrabber::applyPendingAOI()
+{
+    if(!aoiPending){
+      return;
+    }
+    int x, y, w, h;
+    {
+      std::lock_guard<std::mutex> lock(aoiMutex);
+      aoiPending = false;
+      if(sensorPending){
+        sensorPending = false;
+        sensorWidth = pendingSensorW;
+        sensorHeight = pendingSensorH;
+        binScratch.resize(sensorWidth);
+        binSums.resize(sensorWidth);
+        width = sensorWidth / binning;
+        height = sensorHeight / binning;
+      }
+      if(pendingX == posX && pendingY == posY && pendingW == imageWidth && pendingH == imageHeight){
+        return;
+      }
+      x = pendingX;
+      y = pendingY;
+      w = pendingW;
+      h = pendingH;
+      //getAOI reports the area being applied rather than the one being replaced
+      aoiApplying = true;
+    }
+    double exposure = uGrabberc1->getExposure();
+    openGrabber(x, y, w, h);
+    theImagec1.setSize(w, h);
+    if(pixelClock > 0){
+      uGrabberc1->setAutoExposureControl(0);
+      uGrabberc1->setPixelClockVal(pixelClock);
+      uGrabberc1->setExposure(exposure);
+      std::stringstream report;
+      report<<"camera "<<cameraNumber<<" area of interest "<<w<<"x"<<h<<" at "<<x<<","<<y<<", ";
+      settle(20, report);
+      std::cout<<report.str();
+    }
+    //only the acquiring thread writes these, the lock is for getAOI
+    std::lock_guard<std::mutex> lock(aoiMutex);
+    posX = x;
+    posY = y;
+    imageWidth = w;
+    imageHeight = h;
+    aoiApplying = false;
+}
+
+/**
+ * With camera number 0 the driver connects to the first free camera. Opens of every grabber are done one at a
+ * time, with the grabber being replaced closed under the same lock, so two grabbers are never given the same
+ * camera and a grabber reopening is given its camera back. After the first open the grabber is pinned to the
+ * device it was given, the one that has become in use, and later opens ask for that device (imalib hands the
+ * camera number to is_InitCamera).
+ */
+void vpUeyeFrameGrabber::openGrabber(int x, int y, int w, int h)
+{
+    static std::mutex openMutex;
+    std::lock_guard<std::mutex> lock(openMutex);
+    delete uGrabberc1;
+    uGrabberc1 = NULL;
+    std::set<unsigned int> before, after, all;
+    bool listed = deviceId == 0 && devicesInUse(before, all);
+    int id = deviceId != 0 ? (int)(deviceId | IS_USE_DEVICE_ID) : cameraNumber;
+    uGrabberc1 =  new imalib::ueyeImageGrabber(upsideDown,flip,id,x, y,w, h);
+    isConnected = uGrabberc1->isConnected();
+    if(listed && isConnected && devicesInUse(after, all)){
+      std::set<unsigned int> opened;
+      for(std::set<unsigned int>::iterator it = after.begin(); it != after.end(); ++it){
+        if(before.count(*it) == 0){
+          opened.insert(*it);
+        }
+      }
+      if(opened.size() == 1){
+        deviceId = *opened.begin();
+        std::cout<<"camera "<<cameraNumber<<" is device "<<deviceId<<std::endl;
+      }
+    }
+}
+
+/**
+ * Returns the packed, interleaved rgb buffer (row major, 3 bytes per pixel) of the last
+ * frame read by the imalib grabber.
+ */
+unsigned char* vpUeyeFrameGrabber::rawFrame()
+{
+    return theImagec1.getData();
+}
+
+void vpUeyeFrameGrabber::open(vpImage< vpRGBa >& I)
+{
+    openGrabber(posX, posY, imageWidth, imageHeight);
+    //initialiseCamera();
+}
+
+void vpUeyeFrameGrabber::open(vpImage< unsigned char >& I)
+{
+    openGrabber(posX, posY, imageWidth, imageHeight);
+    //initialiseCamera();
+}
+
+/**
+ * Settles the camera on the given pixel clock. A frame is only taken with new settings after a few frames,
+ * the number depends on the camera and the exposure, so frames are grabbed until the readback of the settings
+ * has been stable for three frames instead of a fixed count. Everything is reported in a single output so that
+ * cameras can be initialised from several threads.
+ */
+int vpUeyeFrameGrabber::initialiseCamera(int pixClockVal, int maxFrames){
+   std::stringstream report;
+   report<<"camera "<<cameraNumber<<" initial pixelclock \t"<<uGrabberc1->getCurrentPixelClockValue()<<std::endl;
+   //kept to be set again when the camera is reopened for a new area of interest
+   pixelClock = pixClockVal;
    // check autoExposure
    long autoxposure = uGrabberc1->getAutoExposureSetting();
-   std::cout<<"AutoExposuresetting =  \t"<<autoxposure<<std::endl;
+   report<<"AutoExposuresetting =  \t"<<autoxposure<<std::endl;
    if(autoxposure == 1){
      // auto exposure setting is enabled and must be disabled before the pixel clock setting will work.
      uGrabberc1->setAutoExposureControl(0);
-     std::cout<<"AutoExposuresetting is now disabled **********  \t"<<std::endl;
+     report<<"AutoExposuresetting is now disabled **********  \t"<<std::endl;
    }
    uGrabberc1->setPixelClockVal(pixClockVal);
    //set exposure to the default for the pixelclock setting - 0 for auto, > 0 for manual exposure
    //uGrabberc1->setExposure(500);
-   //take a few images // default is 4 before settings take effect.
-   for(int i = 0; i < 20; i++){
+   int frames = settle(maxFrames, report);
+   report<<"*********************Settings now at **********  \t"<<std::endl;
+   report<<"Pixelclock \t"<<uGrabberc1->getCurrentPixelClockValue()<<std::endl;
+   report<<"EXPOSURE= "<<uGrabberc1->getExposure()<<std::endl;
+   report<<"Framerate \t"<<uGrabberc1->getFramerate()<<std::endl;
+   report<<"Gain \t"<<uGrabberc1->getGain()<<std::endl;
+   std::cout<<report.str();
+   return frames;
+}
+/**
+ * Grabs frames until the pixel clock reads back as set and the exposure and frame rate have read back unchanged on
+ * three consecutive frames, or maxFrames have been grabbed.
+ */
+int vpUeyeFrameGrabber::settle(int maxFrames, std::ostream& report){
+   double lastExposure = -1, lastFramerate = -1;
+   int stable = 0, frames = 0;
+   while(frames < maxFrames && stable < 2){
       uGrabberc1->getImage(&theImagec1);
-      std::cout<<i<<std::endl;
+      frames++;
+      double exposure = uGrabberc1->getExposure();
+      double framerate = uGrabberc1->getFramerate();
+      bool clockSet = (int)uGrabberc1->getCurrentPixelClockValue() == pixelClock;
+      if(clockSet && fabs(exposure - lastExposure) <= 1e-3 * fabs(exposure)
+         && fabs(framerate - lastFramerate) <= 1e-3 * fabs(framerate)){
+        stable++;
+      }
+      else{
+        stable = 0;
+      }
+      lastExposure = exposure;
+      lastFramerate = framerate;
    }
-   std::cout<<"*********************Settings now at **********  \t"<<std::endl;
-   std::cout<<"Pixelclock \t"<<uGrabberc1->getCurrentPixelClockValue()<<std::endl;
-   std::cout<<"EXPOSURE= "<<uGrabberc1->getExposure()<<std::endl;
-   std::cout<<"Framerate \t"<<uGrabberc1->getFramerate()<<std::endl;
-   std::cout<<"Gain \t"<<uGrabberc1->getGain()<<std::endl;
+   if(stable < 2){
+     report<<"settings still changing after "<<frames<<" frames"<<std::endl;
+   }
+   else{
+     report<<"settings took effect after "<<frames<<" frames"<<std::endl;
+   }
+   return frames;
 }
 double vpUeyeFrameGrabber::getExposure(){
    double exp = uGrabberc1->getExposure();
@@ -146,5 +528,11 @@ void vpUeyeFrameGrabber::printCameraParameters()
    std::cout<<"EXPOSURE= "<<uGrabberc1->getExposure()<<std::endl;
    std::cout<<"Framerate \t"<<uGrabberc1->getFramerate()<<std::endl;
    std::cout<<"Gain \t"<<uGrabberc1->getGain()<<std::endl;
+   std::cout<<"Conversion kernel \t"<<rgbconvert::getKernelName()<<std::endl;
+   if(acquiredFrames > 0){
+     double meanMs = acquireTimeMs / acquiredFrames;
+     std::cout<<"Acquired frames \t"<<acquiredFrames<<std::endl;
+     std::cout<<"Mean acquire time (ms) \t"<<meanMs<<"\t("<<1000.0 / meanMs<<" frames/s)"<<std::endl;
+   }
 }
 
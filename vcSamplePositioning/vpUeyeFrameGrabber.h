@@ -20,8 +20,13 @@
 
 #endif
 #include <visp/vpFrameGrabber.h>
+#include <visp/vpCameraParameters.h>
 #include <imalib/ueyeImageGrabber.h>
 #include <imalib/imageRGB.h>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <vector>
 
 class vpUeyeFrameGrabber : public vpFrameGrabber
 {
@@ -63,6 +68,47 @@ public:
   * \param[in] id Internal id of the camera.
   */
    void setCameraNumber(int id);
+  /*!
+  * \brief Set the size of the sensor, 1600x1200 by default. Once the camera is open the size is applied
+  * before the next frame is read, the camera is reopened on the whole new sensor and settled as for an area
+  * of interest. Images are then the new size / binning and the camera parameters have to be resized to match,
+  * see resizeCameraParameters. Can be called from another thread than the one acquiring.
+  * \param[in] w,h sensor size in pixels.
+  */
+  void setSensorSize(unsigned short w, unsigned short h);
+  /*!
+  * \brief Request images reduced by factor in both directions, applied before the next frame is read.
+  * imalib does not give access to the binning of the sensor, the reduction is done while converting the
+  * frame. Images are then sensor size / factor and the camera parameters have to be scaled to match,
+  * see scaleCameraParameters. Can be called from another thread than the one acquiring.
+  * \param[in] factor 1 (full resolution), 2 or 4.
+  * \param[in] average true to average each block of pixels (binning), false to keep one pixel of each
+  * block (subsampling, faster but aliased).
+  */
+  void setBinning(unsigned int factor, bool average = true);
+  /*!
+  * \brief Current reduction factor, or the requested one if it is not applied yet.
+  */
+  unsigned int getBinning();
+  /*!
+  * \brief Camera parameters for images reduced by factor from the full resolution ones.
+  * \param[in] full parameters calibrated at full sensor resolution.
+  * \param[in] factor reduction factor.
+  * \param[in] average binning (true) or subsampling (false), as given to setBinning.
+  * \param[out] scaled parameters for the reduced images, distortion is unchanged as it is expressed
+  * in normalised coordinates.
+  */
+  static void scaleCameraParameters(const vpCameraParameters& full, unsigned int factor, bool average,
+                                    vpCameraParameters& scaled);
+  /*!
+  * \brief Camera parameters for a sensor read at another resolution over the same field of view.
+  * \param[in] calibrated parameters calibrated at fromW x fromH.
+  * \param[in] fromW,fromH size of the calibration images.
+  * \param[in] toW,toH new sensor size.
+  * \param[out] resized parameters for the new sensor size, distortion is unchanged.
+  */
+  static void resizeCameraParameters(const vpCameraParameters& calibrated, unsigned int fromW, unsigned int fromH,
+                                     unsigned int toW, unsigned int toH, vpCameraParameters& resized);
     /*!
   * \brief Get the current Exposure value.
   * \param[out] double the exposure.
@@ -75,17 +121,74 @@ public:
   imalib::imageRGB* currImageA;
   imalib::imageRGB theImagec1;
   imalib::ueyeImageGrabber* uGrabberc1;
-  void initialiseCamera(int pixClockVal);
+  /*!
+  * \brief Set the pixel clock, disable auto exposure and grab frames until the settings have taken
+  * effect: the pixel clock reads back as set and the exposure and frame rate read back unchanged on
+  * consecutive frames.
+  * \param[in] pixClockVal pixel clock in MHz.
+  * \param[in] maxFrames frames grabbed at most if the readback never settles.
+  * \return the number of frames grabbed.
+  */
+  int initialiseCamera(int pixClockVal, int maxFrames = 20);
+  /*!
+  * \brief Request a sensor area of interest, applied before the next frame is read. Images are
+  * still returned at full sensor size with the area at its sensor position, so image coordinates
+  * and camera parameters are unchanged, pixels outside the area are set to 0. imalib only takes the area
+  * when the camera is opened, so the camera is reopened and settled on its pixel clock and exposure, which
+  * holds up the acquiring thread for a few frames. Can be called from another thread than the one acquiring.
+  * \param[in] x,y top left corner on the sensor.
+  * \param[in] w,h size of the area.
+  */
+  void setAOI(int x, int y, int w, int h);
+  /*!
+  * \brief Go back to reading the whole sensor.
+  */
+  void clearAOI();
+  /*!
+  * \brief Current area of interest, the whole sensor when none is set.
+  */
+  void getAOI(int& x, int& y, int& w, int& h);
   bool isConnected;
 private:
+  unsigned char* rawFrame();
+  void applyPendingAOI();
+  void applyPendingBinning();
+  int settle(int maxFrames, std::ostream& report);
+  void openGrabber(int x, int y, int w, int h);
+  unsigned short sensorWidth;
+  unsigned short sensorHeight;
+  //current area of interest read from the sensor
   unsigned short imageWidth;
   unsigned short imageHeight;
   //unsigned short imageBWidth;
   //unsigned short imageBHeight;
   unsigned short posX, posY;
+  //area of interest requested by setAOI, applied by the acquiring thread
+  std::mutex aoiMutex;
+  std::atomic<bool> aoiPending;
+  //the camera is being reopened on the pending area, the lock is not held meanwhile
+  bool aoiApplying;
+  int pendingX, pendingY, pendingW, pendingH;
+  //sensor size requested by setSensorSize, applied with the area of interest
+  bool sensorPending;
+  unsigned short pendingSensorW, pendingSensorH;
+  int pixelClock;
+  //software binning, requested by setBinning and applied by the acquiring thread
+  unsigned int binning;
+  bool binAverage;
+  std::atomic<bool> binningPending;
+  unsigned int pendingBinning;
+  bool pendingAverage;
+  std::vector<unsigned char> binScratch;
+  std::vector<unsigned short> binSums;
   bool upsideDown;
   bool flip;
   int cameraNumber;
+  //uEye device the grabber was given on its first open, 0 until known
+  unsigned int deviceId;
+  //acquisition statistics, reported by printCameraParameters
+  unsigned long acquiredFrames;
+  double acquireTimeMs;
 
 
 };
@@ -0,0 +1,118 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "warmupgate.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+//a pixel in every STEP x STEP block is compared, enough to see the sample holder move
+const unsigned int STEP = 8;
+}
+
+warmupgate::warmupgate() :
+    threshold(2.0), timeoutMs(15000), stableFrames(3)
+{
+    reset(0);
+}
+
+void warmupgate::setLimits(double threshold, unsigned int stableFrames, double timeoutMs)
+{
+    this->threshold = threshold;
+    this->stableFrames = stableFrames < 1 ? 1 : stableFrames;
+    this->timeoutMs = timeoutMs;
+}
+
+void warmupgate::reset(double now)
+{
+    started = now;
+    elapsed = 0;
+    frames = 0;
+    stable = 0;
+    difference = -1;
+    open = false;
+    timedOut = false;
+    previous2.clear();
+    previous3.clear();
+    width2 = width3 = 0;
+}
+
+bool warmupgate::update(const vpImage<unsigned char>& I2, const vpImage<unsigned char>& I3, bool drivesKnown,
+                        bool drivesMoving, bool useDrives, double now)
+{
+    if(open){
+        return true;
+    }
+    frames++;
+    elapsed = now - started;
+    double d2 = sampleDifference(I2, previous2, width2);
+    double d3 = sampleDifference(I3, previous3, width3);
+    //no difference yet on the first frame or after a change of size
+    difference = d2 < 0 || d3 < 0 ? -1 : std::max(d2, d3);
+    bool stillImage = difference >= 0 && difference < threshold;
+    bool drivesStopped = !useDrives || (drivesKnown && !drivesMoving);
+    if(stillImage && drivesStopped){
+        stable++;
+    }
+    else{
+        stable = 0;
+    }
+    if(stable >= stableFrames){
+        open = true;
+    }
+    else if(elapsed > timeoutMs){
+        open = true;
+        timedOut = true;
+    }
+    return open;
+}
+
+double warmupgate::sampleDifference(const vpImage<unsigned char>& I, std::vector<unsigned char>& previous,
+                                    unsigned int& width)
+{
+    unsigned int rows = I.getHeight() / STEP, cols = I.getWidth() / STEP;
+    size_t samples = (size_t)rows * cols;
+    if(samples == 0){
+        return -1;
+    }
+    bool comparable = width == I.getWidth() && previous.size() == samples;
+    if(!comparable){
+        previous.resize(samples);
+        width = I.getWidth();
+    }
+    unsigned long sum = 0;
+    size_t k = 0;
+    for(unsigned int r = 0; r < rows; r++){
+        const unsigned char* row = I[r * STEP + STEP / 2];
+        for(unsigned int c = 0; c < cols; c++, k++){
+            unsigned char v = row[c * STEP + STEP / 2];
+            sum += std::abs((int)v - (int)previous[k]);
+            previous[k] = v;
+        }
+    }
+    return comparable ? (double)sum / samples : -1;
+}
+
+void warmupgate::print() const
+{
+    std::cout<<"warm-up - frames \t"<<frames<<std::endl;
+    std::cout<<"warm-up - time (ms) \t"<<elapsed<<std::endl;
+    if(timedOut){
+        std::cout<<"warm-up - timed out, last frame difference \t"<<difference<<std::endl;
+    }
+}
@@ -0,0 +1,84 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WARMUPGATE_H
+#define WARMUPGATE_H
+
+#include <visp/vpImage.h>
+#include <vector>
+
+/*!
+ * \brief Decides when tracking can start after the drives have been sent to their start positions.
+ *
+ * Tracking starts once the drives have been read as stationary and the images of both cameras have
+ * stopped changing: the mean absolute grey level difference between consecutive frames, on a sparse grid
+ * of pixels, stays below a threshold for a few frames. Without drive status (simulated or replayed
+ * cameras) the images alone decide. Past the timeout tracking starts regardless.
+ */
+class warmupgate
+{
+public:
+  warmupgate();
+  /*!
+  * \brief Start condition.
+  * \param[in] threshold mean grey level difference between consecutive frames below which the image is stable.
+  * \param[in] stableFrames consecutive stable frames needed.
+  * \param[in] timeoutMs longest warm-up.
+  */
+  void setLimits(double threshold, unsigned int stableFrames, double timeoutMs);
+  /*!
+  * \brief Start a warm-up.
+  * \param[in] now time in ms on the monotonic clock.
+  */
+  void reset(double now);
+  /*!
+  * \brief Feed the frames of one iteration of the tracking loop.
+  * \param[in] I2,I3 the frames of both cameras.
+  * \param[in] drivesKnown drive motion has been read since the warm-up started, ignored when useDrives is false.
+  * \param[in] drivesMoving a drive was moving at that read.
+  * \param[in] useDrives the drives decide as well as the images.
+  * \param[in] now time in ms on the monotonic clock.
+  * \return true once tracking can start, and from then on until reset.
+  */
+  bool update(const vpImage<unsigned char>& I2, const vpImage<unsigned char>& I3, bool drivesKnown,
+              bool drivesMoving, bool useDrives, double now);
+  bool isOpen() const {return open;}
+  /*!
+  * \brief Frame to frame difference of the last frames, the larger of the two cameras.
+  */
+  double getDifference() const {return difference;}
+  unsigned int getFrames() const {return frames;}
+  /*!
+  * \brief Print how the warm-up ended.
+  */
+  void print() const;
+
+private:
+  //mean absolute difference with the previous samples of the image, which are then replaced
+  double sampleDifference(const vpImage<unsigned char>& I, std::vector<unsigned char>& previous,
+                          unsigned int& width);
+  double threshold, timeoutMs;
+  unsigned int stableFrames;
+  double started, elapsed;
+  unsigned int frames, stable;
+  double difference;
+  bool open, timedOut;
+  std::vector<unsigned char> previous2, previous3;
+  unsigned int width2, width3;
+};
+
+#endif // WARMUPGATE_H
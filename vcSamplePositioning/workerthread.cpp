@@ -0,0 +1,103 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "workerthread.h"
+#include <stdexcept>
+
+workerthread::workerthread(std::string name) :
+    name(name), busy(false), stopping(false)
+{
+}
+
+workerthread::~workerthread()
+{
+    stop();
+}
+
+void workerthread::start()
+{
+    if(worker.joinable()){
+        return;
+    }
+    stopping = false;
+    busy = false;
+    failure = std::exception_ptr();
+    worker = std::thread(&workerthread::run, this);
+}
+
+void workerthread::stop()
+{
+    if(!worker.joinable()){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        stopping = true;
+    }
+    submitted.notify_one();
+    worker.join();
+}
+
+void workerthread::submit(const std::function<void()>& task)
+{
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        if(busy || !worker.joinable()){
+            throw std::logic_error(name + " cannot take a task");
+        }
+        this->task = task;
+        busy = true;
+    }
+    submitted.notify_one();
+}
+
+void workerthread::wait()
+{
+    std::unique_lock<std::mutex> lk(lock);
+    done.wait(lk, [this]{return !busy;});
+    if(failure){
+        std::exception_ptr e = failure;
+        failure = std::exception_ptr();
+        std::rethrow_exception(e);
+    }
+}
+
+/**
+ * @brief workerthread::run worker side, a task is always finished before stopping so that its owner is never
+ * left waiting
+ */
+void workerthread::run()
+{
+    std::unique_lock<std::mutex> lk(lock);
+    while(true){
+        submitted.wait(lk, [this]{return stopping || busy;});
+        if(!busy){
+            return;
+        }
+        lk.unlock();
+        std::exception_ptr e;
+        try{
+            task();
+        }
+        catch(...){
+            e = std::current_exception();
+        }
+        lk.lock();
+        failure = e;
+        busy = false;
+        done.notify_all();
+    }
+}
@@ -0,0 +1,72 @@
+/**Automates UHV chamber Sample positioning.
+ * Copyright (C) <2018>  <Suzana Barreto>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKERTHREAD_H
+#define WORKERTHREAD_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*!
+ * \brief Thread kept for the length of a run that executes one task at a time for the thread owning it,
+ * so that work can be split across cores every frame without creating threads.
+ *
+ * The owner hands over a task with submit(), does its own share of the work and joins with wait().
+ */
+class workerthread
+{
+public:
+  explicit workerthread(std::string name);
+  /*!
+  * \brief Destructor, stops the thread.
+  */
+  ~workerthread();
+  /*!
+  * \brief Start the thread, does nothing if it is running.
+  */
+  void start();
+  /*!
+  * \brief Finish the current task and join the thread.
+  */
+  void stop();
+  /*!
+  * \brief Run task on the worker, the previous task must have been waited for.
+  */
+  void submit(const std::function<void()>& task);
+  /*!
+  * \brief Wait for the submitted task, rethrows the exception it ended with.
+  */
+  void wait();
+  bool isRunning() const {return worker.joinable();}
+  const std::string& getName() const {return name;}
+
+private:
+  void run();
+  std::string name;
+  std::thread worker;
+  std::mutex lock;
+  std::condition_variable submitted, done;
+  std::function<void()> task;
+  bool busy, stopping;
+  std::exception_ptr failure;
+};
+
+#endif // WORKERTHREAD_H